@@ -46,6 +46,7 @@
 #define NFP_NET_META_FIELD_SIZE		4
 #define NFP_NET_META_HASH		1 /* next field carries hash type */
 #define NFP_NET_META_MARK		2
+#define NFP_NET_META_VLAN		4 /* ctag or stag type */
 #define NFP_NET_META_PORTID		5
 #define NFP_NET_META_CSUM		6 /* checksum complete type */
 #define NFP_NET_META_APP		15 /* app specific meta data */
@@ -255,10 +256,28 @@
 #define   NFP_NET_CFG_BPF_ADDR_MASK	(~NFP_NET_CFG_BPF_CFG_MASK)
 
 /**
- * 40B reserved for future use (0x0098 - 0x00c0)
+ * Second control and capability words (0x0098 - 0x00a8)
+ * %NFP_NET_CFG_CTRL_WORD1:  More control bits, set by the driver as
+ *                           %NFP_NET_CFG_CTRL
+ * %NFP_NET_CFG_CAP_WORD1:   Capabilities (same bits as
+ *                           %NFP_NET_CFG_CTRL_WORD1)
+ * Bits used by NFD are assigned from bit 31 down, clear of the bits
+ * assigned to other firmware from bit 0 up.
  */
-#define NFP_NET_CFG_RESERVED		0x0098
-#define NFP_NET_CFG_RESERVED_SZ		0x0028
+#define NFP_NET_CFG_CTRL_WORD1		0x0098
+#define   NFP_NET_CFG_CTRL_RXSTRIDE	  (0x1 << 31) /* Striding RX buffers */
+#define   NFP_NET_CFG_CTRL_RXPAYALIGN	  (0x1 << 30) /* Page aligned RX payload */
+#define   NFP_NET_CFG_CTRL_RXSIZECLASS	  (0x1 << 29) /* Size class freelists */
+#define   NFP_NET_CFG_CTRL_RXCQ	  (0x1 << 28) /* Shared RX completions */
+#define   NFP_NET_CFG_CTRL_RXRWB	  (0x1 << 27) /* Write-back of RX ring */
+#define   NFP_NET_CFG_CTRL_RXRLDROP	  (0x1 << 26) /* RX rate limit drops */
+#define NFP_NET_CFG_CAP_WORD1		0x00a4
+
+/**
+ * 24B reserved for future use (0x00a8 - 0x00c0)
+ */
+#define NFP_NET_CFG_RESERVED		0x00a8
+#define NFP_NET_CFG_RESERVED_SZ		0x0018
 
 /**
  * RSS configuration (0x0100 - 0x01ac):
@@ -315,6 +334,9 @@
  * %NFP_NET_CFG_RXR_SZ:      Per RX ring ring size (1B entries)
  * %NFP_NET_CFG_RXR_VEC:     Per RX ring MSI-X table entry (1B entries)
  * %NFP_NET_CFG_RXR_PRIO:    Per RX ring priority (1B entries)
+ * %NFP_NET_CFG_RXR_BATCH:   Per RX ring descriptor batch target (1B entries)
+ *                           Zero lets the firmware pick the target from the
+ *                           ring's packet rate, one disables batching.
  * %NFP_NET_CFG_RXR_IRQ_MOD: Per RX ring interrupt moderation (4B entries)
  */
 #define NFP_NET_CFG_RXR_BASE		0x0800
@@ -322,6 +344,7 @@
 #define NFP_NET_CFG_RXR_SZ(_x)		(NFP_NET_CFG_RXR_BASE + 0x200 + (_x))
 #define NFP_NET_CFG_RXR_VEC(_x)		(NFP_NET_CFG_RXR_BASE + 0x240 + (_x))
 #define NFP_NET_CFG_RXR_PRIO(_x)	(NFP_NET_CFG_RXR_BASE + 0x280 + (_x))
+#define NFP_NET_CFG_RXR_BATCH(_x)	(NFP_NET_CFG_RXR_BASE + 0x2c0 + (_x))
 #define NFP_NET_CFG_RXR_IRQ_MOD(_x)	(NFP_NET_CFG_RXR_BASE + 0x300 + \
 					 ((_x) * 0x4))
 
@@ -375,6 +398,24 @@
 #define NFP_NET_CFG_STATS_APP3_FRAMES	(NFP_NET_CFG_STATS_BASE + 0xc0)
 #define NFP_NET_CFG_STATS_APP3_BYTES	(NFP_NET_CFG_STATS_BASE + 0xc8)
 
+/**
+ * RX completion queues (0x0e00 - 0x0f00)
+ * Only used when %NFP_NET_CFG_CTRL_RXCQ is set in %NFP_NET_CFG_CTRL_WORD1.
+ * RX rings that name a completion queue post an 8B entry to it per batch
+ * of RX descriptors written, so that the host can poll a single queue for
+ * many RX rings.
+ * %NFP_NET_CFG_RXCQ_ADDR:   Per CQ DMA address (8B entries)
+ * %NFP_NET_CFG_RXCQ_SZ:     Per CQ size as log2 of entries (1B entries)
+ * %NFP_NET_CFG_RXR_CQ:      Per RX ring CQ number plus one, zero if the
+ *                           ring does not post completions (1B entries)
+ * A CQ is (re)started when the first RX ring naming it is enabled.
+ */
+#define NFP_NET_CFG_RXCQ_BASE		0x0e00
+#define NFP_NET_RXCQ_MAX		16
+#define NFP_NET_CFG_RXCQ_ADDR(_x)	(NFP_NET_CFG_RXCQ_BASE + ((_x) * 0x8))
+#define NFP_NET_CFG_RXCQ_SZ(_x)		(NFP_NET_CFG_RXCQ_BASE + 0x80 + (_x))
+#define NFP_NET_CFG_RXR_CQ(_x)		(NFP_NET_CFG_RXCQ_BASE + 0xc0 + (_x))
+
 /**
  * Per ring stats (0x1000 - 0x1800)
  * options, 64bit per entry
@@ -418,6 +459,76 @@
 #define  NFP_NET_CFG_VLAN_FILTER_PROTO	 (NFP_NET_CFG_VLAN_FILTER + 2)
 #define NFP_NET_CFG_VLAN_FILTER_SZ	 0x0004
 
+/**
+ * RX ring write back (0x1a00 - 0x1c00)
+ * Only used when %NFP_NET_CFG_CTRL_RXRWB is set in %NFP_NET_CFG_CTRL_WORD1.
+ * After each batch of RX descriptors, the firmware writes the number of
+ * descriptors written to the ring, free running, as a 4B word to the ring's
+ * write back address.  The count restarts from zero when the ring is
+ * enabled.
+ * %NFP_NET_CFG_RXR_WB_ADDR: Per RX ring write back DMA address (8B entries)
+ *                           Zero disables write back for the ring.
+ */
+#define NFP_NET_CFG_RXR_WB_BASE		0x1a00
+#define NFP_NET_CFG_RXR_WB_ADDR(_x)	(NFP_NET_CFG_RXR_WB_BASE + ((_x) * 0x8))
+
+/**
+ * RX ring rate limits (0x1c00 - 0x2000)
+ * Only used by firmware built with rate limiting.  Read when the ring is
+ * enabled and on each %NFP_NET_CFG_UPDATE_RING.  Once per refill period,
+ * a fixed number of ME timestamp ticks set when the firmware is built, the
+ * ring's token bucket gets its rate added, up to the burst.  Each packet
+ * takes one token per byte of data_len, or one token with
+ * %NFP_NET_CFG_RXR_RL_PKTS.  A packet that finds too few tokens is sent
+ * anyway, and the firmware withholds FL credits from the application until
+ * the bucket is out of debt.  If the driver sets
+ * %NFP_NET_CFG_CTRL_RXRLDROP in %NFP_NET_CFG_CTRL_WORD1, rings without
+ * %NFP_NET_CFG_RXR_RL_HOLD drop the packet instead, and hand it to the
+ * host as an RX descriptor with zero data_len that takes its FL buffer.
+ * %NFP_NET_CFG_RXR_RL_RATE:  Per RX ring tokens per refill period, zero
+ *                            disables rate limiting (8B stride)
+ * %NFP_NET_CFG_RXR_RL_CFG:   Per RX ring burst in tokens and flags
+ *                            (8B stride)
+ * %NFP_NET_CFG_RXR_RL_DROPS: Per RX ring count of packets dropped
+ *                            (8B entries)
+ */
+#define NFP_NET_CFG_RXR_RL_BASE		0x1c00
+#define NFP_NET_CFG_RXR_RL_RATE(_x)	(NFP_NET_CFG_RXR_RL_BASE + ((_x) * 0x8))
+#define NFP_NET_CFG_RXR_RL_CFG(_x)	(NFP_NET_CFG_RXR_RL_BASE + 0x4 + \
+					 ((_x) * 0x8))
+#define   NFP_NET_CFG_RXR_RL_PKTS	  (0x1 << 31) /* Packet tokens */
+#define   NFP_NET_CFG_RXR_RL_HOLD	  (0x1 << 30) /* Backpressure */
+#define   NFP_NET_CFG_RXR_RL_BURST_MASK	  0x00ffffff
+#define NFP_NET_CFG_RXR_RL_DROPS(_x)	(NFP_NET_CFG_RXR_RL_BASE + 0x200 + \
+					 ((_x) * 0x8))
+
+/**
+ * RX ring FL starvation drops (0x2000 - 0x2200)
+ * Only used by firmware built with FL starvation drops.  Once the host has
+ * left a ring without free list buffers for a fixed number of ME timestamp
+ * ticks set when the firmware is built, packets for the ring are dropped
+ * rather than held on the NFP waiting for buffers.  Dropping stops once
+ * the host posts free list buffers again.
+ * %NFP_NET_CFG_RXR_STARVE_DROPS: Per RX ring count of packets dropped
+ *                                (8B entries)
+ */
+#define NFP_NET_CFG_RXR_STARVE_BASE	0x2000
+#define NFP_NET_CFG_RXR_STARVE_DROPS(_x) (NFP_NET_CFG_RXR_STARVE_BASE + \
+					  ((_x) * 0x8))
+
+/**
+ * RX ring size class drops (0x2200 - 0x2400)
+ * Only used by firmware built with size class freelists, on vNICs with
+ * %NFP_NET_CFG_CTRL_RXSIZECLASS set.  A packet too large for a small
+ * buffer that finds no large buffer to hand is dropped and handed to the
+ * host as an RX descriptor with the drop flag set.
+ * %NFP_NET_CFG_RXR_SC_DROPS: Per RX ring count of packets dropped
+ *                            (8B entries)
+ */
+#define NFP_NET_CFG_RXR_SC_BASE		0x2200
+#define NFP_NET_CFG_RXR_SC_DROPS(_x)	(NFP_NET_CFG_RXR_SC_BASE + \
+					 ((_x) * 0x8))
+
 /**
  * TLV capabilities
  * %NFP_NET_CFG_TLV_TYPE:	Offset of type within the TLV
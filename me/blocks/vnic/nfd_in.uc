@@ -94,6 +94,34 @@
 #define NFD_IN_SEQR_NUM(_qnum) \
     (((_qnum) >> NFD_IN_SEQR_QSHIFT) & (NFD_IN_NUM_SEQRS - 1))
 
+#ifdef NFD_IN_SEQR_TBL
+#if (NFD_IN_NUM_SEQRS == 1)
+#error "NFD_IN_SEQR_TBL requires NFD_IN_NUM_SEQRS > 1"
+#endif
+
+/* Per queue sequencer table written by PCI.IN, see pci_in.h */
+#define NFD_IN_SEQR_TBL_SZ      NFD_IN_MAX_QUEUES
+#define NFD_IN_SEQR_TBL_ALIGN   256
+#define NFD_IN_SEQR_TBL_ALLOC   (NFD_IN_SEQR_TBL_SZ + 8)
+
+#ifndef NFD_IN_SEQR_CACHE_TICKS
+#define NFD_IN_SEQR_CACHE_TICKS 4096
+#endif
+
+#ifdef NFD_PCIE0_EMEM
+    .alloc_mem nfd_in_seqr_tbl0 NFD_PCIE0_EMEM global NFD_IN_SEQR_TBL_ALLOC NFD_IN_SEQR_TBL_ALIGN
+#endif
+#ifdef NFD_PCIE1_EMEM
+    .alloc_mem nfd_in_seqr_tbl1 NFD_PCIE1_EMEM global NFD_IN_SEQR_TBL_ALLOC NFD_IN_SEQR_TBL_ALIGN
+#endif
+#ifdef NFD_PCIE2_EMEM
+    .alloc_mem nfd_in_seqr_tbl2 NFD_PCIE2_EMEM global NFD_IN_SEQR_TBL_ALLOC NFD_IN_SEQR_TBL_ALIGN
+#endif
+#ifdef NFD_PCIE3_EMEM
+    .alloc_mem nfd_in_seqr_tbl3 NFD_PCIE3_EMEM global NFD_IN_SEQR_TBL_ALLOC NFD_IN_SEQR_TBL_ALIGN
+#endif
+#endif /* NFD_IN_SEQR_TBL */
+
 
 /**
  * PCI.in Packet descriptor format
@@ -166,6 +194,10 @@
 #define NFD_IN_RING_INFO_ITEM_SZ   4
 #define NFD_IN_IS_NFD_TRUE_VAL  1
 
+/* Maximum descriptors returned by nfd_in_recv_burst(), limited by the
+ * 16 read transfer registers available per context */
+#define NFD_IN_RECV_BURST_MAX   4
+
 /* Define the default maximum length in bytes of prepended chained metadata.
  * Assume one 32-bit word is used to encode the metadata types in a chain and
  * that each metadata value for a corresponding metadata type is 4 bytes
@@ -334,6 +366,186 @@
 #endm
 
 
+/**
+ * Receive up to "in_max" packets from PCI.IN with a single ring access
+ * @param out_nfd_meta  Read transfer registers for (in_max * 4) words
+ * @param out_count     Number of valid descriptors in out_nfd_meta
+ * @param io_busy       GPR kept by the caller for the work queue, non-zero
+ *                      if the last call found descriptors, initially zero
+ * @param in_pcie_isl   PCIe island
+ * @param in_recvq      Work queue from the given island to access
+ * @param in_max        Maximum descriptors to fetch, a constant from 1 to
+ *                      NFD_IN_RECV_BURST_MAX
+ * @param LM_CTX        LM index to use to read nfd_in_ring_info
+ *
+ * The ring is polled with a "get" for in_max descriptors, then with
+ * progressively smaller gets if that fails, so a partial burst or zero
+ * descriptors may be returned.  Descriptors always start at out_nfd_meta[0].
+ * If io_busy is zero only one descriptor is polled for, so an idle work
+ * queue costs one ring access per call.
+ * The caller must update PCI.IN stats for each received descriptor.
+ *
+ * @note A work queue serviced with this macro must not also be serviced
+ * with nfd_in_recv(), as threads waiting on an empty work queue are held
+ * on the ring and would be returned to a "get".
+ */
+#macro nfd_in_recv_burst(out_nfd_meta, out_count, io_busy, in_pcie_isl, \
+                         in_recvq, in_max, LM_CTX)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .sig get_sig[2]
+
+    #if (!is_ct_const(in_max) || (in_max < 1) || \
+         (in_max > NFD_IN_RECV_BURST_MAX))
+        #error "in_max must be a constant from 1 to NFD_IN_RECV_BURST_MAX"
+    #endif
+
+    #if (is_ct_const(in_pcie_isl))
+        immed[addr_lo, (nfd_in_ring_info +
+                        (in_pcie_isl << log2(NFD_IN_RING_INFO_ITEM_SZ)))]
+    #else
+        passert(nfd_in_ring_info,  "MULTIPLE_OF",
+                (NFD_MAX_ISL * NFD_IN_RING_INFO_ITEM_SZ))
+        immed[addr_lo, nfd_in_ring_info]
+        alu[addr_lo, addr_lo, OR, in_pcie_isl,
+            <<(log2(NFD_IN_RING_INFO_ITEM_SZ))]
+    #endif
+    local_csr_wr[ACTIVE_LM_ADDR_/**/LM_CTX, addr_lo]
+    nop
+    nop
+    nop
+    ld_field_w_clr[addr_hi, 1000, *l$index/**/LM_CTX]
+    alu[addr_lo, in_recvq, +16, *l$index/**/LM_CTX]
+
+    #define_eval _BURST_LW (in_max * NFD_IN_META_SIZE_LW)
+    #if (in_max > 1)
+        alu[--, --, B, io_busy]
+        beq[recv_burst_idle#]
+    #endif
+    immed[out_count, in_max]
+    mem[get, out_nfd_meta[0], addr_hi, <<8, addr_lo, _BURST_LW], \
+        sig_done[get_sig]
+    ctx_arb[get_sig[0]]
+    br_!signal[get_sig[1], recv_burst_done#]
+
+    #if (in_max > 2)
+        /* Too few descriptors queued, try half a burst */
+        immed[out_count, 2]
+        mem[get, out_nfd_meta[0], addr_hi, <<8, addr_lo, \
+            (2 * NFD_IN_META_SIZE_LW)], sig_done[get_sig]
+        ctx_arb[get_sig[0]]
+        br_!signal[get_sig[1], recv_burst_done#]
+    #endif
+
+    #if (in_max > 1)
+recv_burst_idle#:
+        immed[out_count, 1]
+        mem[get, out_nfd_meta[0], addr_hi, <<8, addr_lo, \
+            NFD_IN_META_SIZE_LW], sig_done[get_sig]
+        ctx_arb[get_sig[0]]
+        br_!signal[get_sig[1], recv_burst_done#]
+    #endif
+
+    /* Work queue is empty */
+    immed[out_count, 0]
+
+recv_burst_done#:
+    alu[io_busy, --, B, out_count]
+    #undef _BURST_LW
+.end
+#endm
+
+
+#ifdef NFD_IN_PRIO_WQ
+/**
+ * Receive a packet from PCI.IN, servicing the priority work queue first
+ * @param out_prio      Set to 1 if io_prio_meta holds the packet, 0 if
+ *                      io_nfd_meta holds it
+ * @param io_nfd_meta   Read transfer registers for a packet from in_recvq
+ * @param io_prio_meta  Read transfer registers for a priority packet
+ * @param io_pend       Work queues with a request outstanding, zero before
+ *                      the first use
+ * @param in_pcie_isl   PCIe island
+ * @param in_recvq      Data work queue from the given island to access
+ * @param LM_CTX        LM index to use to read nfd_in_ring_info
+ * @param DATA_SIG      Signal for the in_recvq request
+ * @param PRIO_SIG      Signal for the priority work queue request
+ *
+ * A request is kept parked on both in_recvq and NFD_IN_PRIO_WQ, and the
+ * context sleeps until either delivers, as for nfd_in_recv_prio() in
+ * microC.  A parked request can't be withdrawn, so the other request
+ * remains outstanding between invocations and the memory unit may write
+ * its transfer registers at any time.  io_nfd_meta and io_prio_meta must
+ * therefore be declared for this macro alone and used for nothing else,
+ * and the same registers, signals and io_pend must be passed each time.
+ * The returned descriptor stays valid until the next invocation.  A
+ * priority packet delivered while the context processes a packet from
+ * in_recvq waits until the next invocation.  The caller must update
+ * PCI.IN stats for each received descriptor.
+ */
+#macro nfd_in_recv_prio(out_prio, io_nfd_meta, io_prio_meta, io_pend, \
+                        in_pcie_isl, in_recvq, LM_CTX, DATA_SIG, PRIO_SIG)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+
+    #if (NFD_IN_PRIO_WQ < 1 || NFD_IN_PRIO_WQ >= NFD_IN_NUM_WQS)
+        #error "NFD_IN_PRIO_WQ must be a work queue between 1 and NFD_IN_NUM_WQS-1"
+    #endif
+
+    #if (is_ct_const(in_pcie_isl))
+        immed[addr_lo, (nfd_in_ring_info +
+                        (in_pcie_isl << log2(NFD_IN_RING_INFO_ITEM_SZ)))]
+    #else
+        passert(nfd_in_ring_info,  "MULTIPLE_OF",
+                (NFD_MAX_ISL * NFD_IN_RING_INFO_ITEM_SZ))
+        immed[addr_lo, nfd_in_ring_info]
+        alu[addr_lo, addr_lo, OR, in_pcie_isl,
+            <<(log2(NFD_IN_RING_INFO_ITEM_SZ))]
+    #endif
+    local_csr_wr[ACTIVE_LM_ADDR_/**/LM_CTX, addr_lo]
+    nop
+    nop
+    nop
+    ld_field_w_clr[addr_hi, 1000, *l$index/**/LM_CTX]
+
+    /* Park a request on each work queue that has none outstanding */
+    br_bset[io_pend, 0, recv_prio_data_pend#]
+    alu[addr_lo, in_recvq, +16, *l$index/**/LM_CTX]
+    mem[qadd_thread, io_nfd_meta[0], addr_hi, <<8, addr_lo, \
+        NFD_IN_META_SIZE_LW], sig_done[DATA_SIG]
+    alu[io_pend, io_pend, OR, 1]
+recv_prio_data_pend#:
+
+    br_bset[io_pend, 1, recv_prio_wait#]
+    alu[addr_lo, NFD_IN_PRIO_WQ, +16, *l$index/**/LM_CTX]
+    mem[qadd_thread, io_prio_meta[0], addr_hi, <<8, addr_lo, \
+        NFD_IN_META_SIZE_LW], sig_done[PRIO_SIG]
+    alu[io_pend, io_pend, OR, 2]
+
+    /* Hand out a priority packet first if both requests have completed */
+recv_prio_wait#:
+    br_signal[PRIO_SIG, recv_prio_got_prio#]
+    br_signal[DATA_SIG, recv_prio_got_data#]
+    ctx_arb[DATA_SIG, PRIO_SIG], any
+    br[recv_prio_wait#]
+
+recv_prio_got_prio#:
+    alu[io_pend, io_pend, AND~, 2]
+    br[recv_prio_done#], defer[1]
+    immed[out_prio, 1]
+
+recv_prio_got_data#:
+    alu[io_pend, io_pend, AND~, 1]
+    immed[out_prio, 0]
+
+recv_prio_done#:
+.end
+#endm
+#endif /* NFD_IN_PRIO_WQ */
+
+
 #macro nfd_in_recv(io_nfd_meta, in_pcie_isl, in_recvq, LM_CTX)
 .begin
     .reg pktlen
@@ -571,6 +783,123 @@ meta_pop_cache_empty#:
 #endm
 
 
+/**
+ * Decode the whole prepended metadata chain of a packet.
+ * @param out_present       NFD_META_PRESENT() bits of the types found
+ * @param out_hash_type     Inline type of NFP_NET_META_HASH
+ * @param out_hash          Value of NFP_NET_META_HASH
+ * @param out_mark          Value of NFP_NET_META_MARK
+ * @param out_portid        Value of NFP_NET_META_PORTID
+ * @param out_vlan          Value of NFP_NET_META_VLAN
+ * @param out_csum          Value of NFP_NET_META_CSUM
+ * @param in_meta_len       Length of metadata prepended to the packet
+ * @param in_pkt_buf_hi     Upper bits of packet buffer address
+ * @param IN_ERROR_LABEL    Branch here if an error occurs
+ *
+ * The metadata is read with a single memory access and every field is
+ * decoded.  Output values are only valid if their bit is set in
+ * "out_present".  It is an error if "in_meta_len" exceeds
+ * NFD_IN_MAX_META_LEN or NFD_META_PARSE_MAX_LEN, or if a type without a
+ * known 4B value is found.  nfd_meta_parse_ref() in shared/nfd_net.h is
+ * the host reference.
+ */
+#macro nfd_in_metadata_parse(out_present, out_hash_type, out_hash, \
+                             out_mark, out_portid, out_vlan, out_csum, \
+                             in_meta_len, in_pkt_buf_hi, IN_ERROR_LABEL)
+.begin
+
+    .reg meta_offset
+    .reg meta_lw
+    .reg meta_info
+    .reg remaining
+    .reg type
+    .reg ctx_num
+    .reg t_idx
+    .reg read $meta_data[(NFD_META_PARSE_MAX_LEN >> 2)]
+    .xfer_order $meta_data
+    .sig sig_meta
+
+    #define_eval _META_PARSE_LW (NFD_META_PARSE_MAX_LEN >> 2)
+
+    move(out_present, 0)
+
+    .if ((in_meta_len > NFD_IN_MAX_META_LEN) || \
+         (in_meta_len > NFD_META_PARSE_MAX_LEN))
+        #if (!streq('IN_ERROR_LABEL', '--'))
+            br[IN_ERROR_LABEL]
+        #else
+            br[meta_parse_done#]
+        #endif
+    .endif
+
+    /* Metadata is a whole number of words */
+    alu[--, in_meta_len, AND, 3]
+    #if (!streq('IN_ERROR_LABEL', '--'))
+        bne[IN_ERROR_LABEL]
+    #else
+        bne[meta_parse_done#]
+    #endif
+
+    .if (in_meta_len == 0)
+        br[meta_parse_done#]
+    .endif
+
+    alu[meta_offset, NFD_IN_DATA_OFFSET, -, in_meta_len]
+    alu[meta_lw, --, B, in_meta_len, >>2]
+    ov_single(OV_LENGTH, meta_lw, OVF_SUBTRACT_ONE)
+    mem[read32, $meta_data[0], in_pkt_buf_hi, <<8, meta_offset, \
+        max_/**/_META_PARSE_LW], indirect_ref, ctx_swap[sig_meta]
+
+    /* Walk the data words with T_INDEX */
+    local_csr_rd[ACTIVE_CTX_STS]
+    immed[ctx_num, 0]
+    alu[ctx_num, ctx_num, AND, NFP_MECSR_ACTIVE_CTX_STS_ACNO_mask]
+    alu[t_idx, (&$meta_data[1] << 2), OR, ctx_num, <<7]
+    local_csr_wr[T_INDEX, t_idx]
+
+    move(meta_info, $meta_data[0])
+    alu[remaining, in_meta_len, -, 4]
+    nop
+
+    .while (remaining > 0)
+
+        alu[type, meta_info, AND, NFP_NET_META_FIELD_MASK]
+        alu[meta_info, --, B, meta_info, >>(NFP_NET_META_FIELD_SIZE)]
+
+        .if (type == NFP_NET_META_HASH)
+            alu[out_hash_type, meta_info, AND, NFP_NET_META_FIELD_MASK]
+            alu[meta_info, --, B, meta_info, >>(NFP_NET_META_FIELD_SIZE)]
+            move(out_hash, *$index++)
+        .elif (type == NFP_NET_META_MARK)
+            move(out_mark, *$index++)
+        .elif (type == NFP_NET_META_PORTID)
+            move(out_portid, *$index++)
+        .elif (type == NFP_NET_META_VLAN)
+            move(out_vlan, *$index++)
+        .elif (type == NFP_NET_META_CSUM)
+            move(out_csum, *$index++)
+        .else
+            #if (!streq('IN_ERROR_LABEL', '--'))
+                br[IN_ERROR_LABEL]
+            #else
+                br[meta_parse_done#]
+            #endif
+        .endif
+
+        alu[--, type, OR, 0]
+        alu[out_present, out_present, OR, 1, <<indirect]
+        alu[remaining, remaining, -, 4]
+
+    .endw
+
+meta_parse_done#:
+
+    #undef _META_PARSE_LW
+
+.end
+#endm
+
+
 #macro nfd_in_pkt_meta(out_pkt_meta, in_nfd_meta)
 .begin
     .reg v
@@ -606,6 +935,53 @@ meta_pop_cache_empty#:
 #endm
 
 
+#ifdef NFD_IN_SEQR_TBL
+
+/* Look up the sequencer PCI.IN assigned to the queue.  The entry is only
+ * rewritten while the queue is down, and PCI.IN does not let the host use
+ * the queue until notify has loaded the change, so a single read is
+ * sufficient.  Callers that look up every packet may keep their own copy
+ * of the table, provided they reread it at least every
+ * NFD_IN_SEQR_CACHE_TICKS ME timestamp ticks. */
+#macro nfd_in_get_seqr(out_seqr, in_nfd_meta)
+.begin
+    .reg qid
+    .reg pcie
+    .reg addr_hi
+    .reg read $seqr
+    .sig seqr_sig
+
+    nfd_in_get_qid(qid, in_nfd_meta)
+    nfd_in_get_pcie(pcie, in_nfd_meta)
+
+#ifdef NFD_PCIE0_EMEM
+    .if (pcie == 0)
+        move(addr_hi, (nfd_in_seqr_tbl0 >> 8))
+    .endif
+#endif
+#ifdef NFD_PCIE1_EMEM
+    .if (pcie == 1)
+        move(addr_hi, (nfd_in_seqr_tbl1 >> 8))
+    .endif
+#endif
+#ifdef NFD_PCIE2_EMEM
+    .if (pcie == 2)
+        move(addr_hi, (nfd_in_seqr_tbl2 >> 8))
+    .endif
+#endif
+#ifdef NFD_PCIE3_EMEM
+    .if (pcie == 3)
+        move(addr_hi, (nfd_in_seqr_tbl3 >> 8))
+    .endif
+#endif
+
+    mem[read8, $seqr, addr_hi, <<8, qid, 1], ctx_swap[seqr_sig]
+    alu[out_seqr, --, b, $seqr, >>24]
+.end
+#endm
+
+#else /* NFD_IN_SEQR_TBL */
+
 #macro nfd_in_get_seqr(out_seqr, in_nfd_meta)
 .begin
     .reg qid
@@ -614,6 +990,8 @@ meta_pop_cache_empty#:
 .end
 #endm
 
+#endif /* NFD_IN_SEQR_TBL */
+
 
 #macro nfd_in_get_seqn(out_seqn, in_nfd_meta)
 .begin
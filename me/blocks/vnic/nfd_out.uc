@@ -145,9 +145,34 @@
 #define NFD_OUT_ATOMICS_CREDIT      0
 #define NFD_OUT_ATOMICS_SENT        4
 #define NFD_OUT_ATOMICS_DMA_DONE    8
+#define NFD_OUT_ATOMICS_GEN         12
+
+#define NFD_OUT_STARVE_BASE         1024
+#define NFD_OUT_STARVE_SZ           8
+#define NFD_OUT_STARVE_SZ_LG2       3
+#define NFD_OUT_STARVE_FLAG         0
+#define NFD_OUT_STARVE_DROPS        4
+
+#define NFD_OUT_CREDIT_RET_BASE     1536
+#define NFD_OUT_CREDIT_RET_SZ       8
+#define NFD_OUT_CREDIT_RET_SZ_LG2   3
 
 #define NFD_OUT_RING_INFO_ITEM_SZ   4
 
+/* Number of PCI.OUT input rings per PCIe island */
+#ifndef NFD_OUT_RINGS
+#define NFD_OUT_RINGS 1
+#endif
+
+#if (NFD_OUT_RINGS < 1 || NFD_OUT_RINGS > 4)
+#error "NFD_OUT_RINGS must be from 1 to 4"
+#endif
+
+/* Input ring of this ME on each PCIe island, see nfd_out_send_init() */
+#ifndef NFD_OUT_RING_IDX
+#define NFD_OUT_RING_IDX (__ISLAND % NFD_OUT_RINGS)
+#endif
+
 
 /* Define the default maximum length in bytes of prepended chained metadata.
  * Assume one 32-bit word is used to encode the metadata types in a chain and
@@ -164,6 +189,19 @@
 #endif
 
 
+#macro _nfd_out_rings_alloc(in_isl, in_emem)
+
+    #define_eval __NFD_OUT_RING 0
+    #while (__NFD_OUT_RING < NFD_OUT_RINGS)
+        .alloc_resource nfd_out_ring_num/**/in_isl/**/__NFD_OUT_RING \
+            in_emem/**/_queues global 1 1
+        #define_eval __NFD_OUT_RING (__NFD_OUT_RING + 1)
+    #endloop
+    #undef __NFD_OUT_RING
+
+#endm
+
+
 #macro nfd_out_ring_declare()
 
     #ifndef __NFD_OUT_RINGS_DECLARED
@@ -171,25 +209,25 @@
 
         #ifdef NFD_PCIE0_EMEM
 
-            .alloc_resource nfd_out_ring_num00 NFD_PCIE0_EMEM/**/_queues global 1 1
+            _nfd_out_rings_alloc(0, NFD_PCIE0_EMEM)
 
         #endif /* NFD_PCIE0_EMEM */
 
         #ifdef NFD_PCIE1_EMEM
 
-            .alloc_resource nfd_out_ring_num10 NFD_PCIE1_EMEM/**/_queues global 1 1
+            _nfd_out_rings_alloc(1, NFD_PCIE1_EMEM)
 
         #endif /* NFD_PCIE1_EMEM */
 
         #ifdef NFD_PCIE2_EMEM
 
-            .alloc_resource nfd_out_ring_num20 NFD_PCIE2_EMEM/**/_queues global 1 1
+            _nfd_out_rings_alloc(2, NFD_PCIE2_EMEM)
 
         #endif /* NFD_PCIE2_EMEM */
 
         #ifdef NFD_PCIE3_EMEM
 
-            .alloc_resource nfd_out_ring_num30 NFD_PCIE3_EMEM/**/_queues global 1 1
+            _nfd_out_rings_alloc(3, NFD_PCIE3_EMEM)
 
         #endif /* NFD_PCIE3_EMEM */
 
@@ -207,12 +245,18 @@
         (NFD_MAX_ISL * NFD_OUT_RING_INFO_ITEM_SZ) \
         (NFD_MAX_ISL * NFD_OUT_RING_INFO_ITEM_SZ)
 
+    #define_eval __NFD_OUT_RING_IDX (NFD_OUT_RING_IDX)
+    #if (__NFD_OUT_RING_IDX >= NFD_OUT_RINGS)
+        #error "NFD_OUT_RING_IDX must be less than NFD_OUT_RINGS"
+    #endif
+
     #ifdef NFD_PCIE0_EMEM
 
         #define __EMEM_NUM
         #define_eval __EMEM_NUM strright('NFD_PCIE0_EMEM', 1)
         .init nfd_out_ring_info+0 \
-            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | nfd_out_ring_num00)
+            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | \
+             nfd_out_ring_num0/**/__NFD_OUT_RING_IDX)
         #undef __EMEM_NUM
 
     #endif /* NFD_PCIE0_EMEM */
@@ -222,7 +266,8 @@
         #define __EMEM_NUM
         #define_eval __EMEM_NUM strright('NFD_PCIE1_EMEM', 1)
         .init nfd_out_ring_info+4 \
-            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | nfd_out_ring_num10)
+            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | \
+             nfd_out_ring_num1/**/__NFD_OUT_RING_IDX)
         #undef __EMEM_NUM
 
     #endif /* NFD_PCIE1_EMEM */
@@ -232,7 +277,8 @@
         #define __EMEM_NUM
         #define_eval __EMEM_NUM strright('NFD_PCIE2_EMEM', 1)
         .init nfd_out_ring_info+8 \
-            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | nfd_out_ring_num20)
+            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | \
+             nfd_out_ring_num2/**/__NFD_OUT_RING_IDX)
         #undef __EMEM_NUM
 
     #endif /* NFD_PCIE2_EMEM */
@@ -242,11 +288,14 @@
         #define __EMEM_NUM
         #define_eval __EMEM_NUM strright('NFD_PCIE3_EMEM', 1)
         .init nfd_out_ring_info+12 \
-            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | nfd_out_ring_num30)
+            ((((__NFD_EMU_BASE_ISL+__EMEM_NUM) | __NFD_DIRECT_ACCESS) << 24) | \
+             nfd_out_ring_num3/**/__NFD_OUT_RING_IDX)
         #undef __EMEM_NUM
 
     #endif /* NFD_PCIE3_EMEM */
 
+    #undef __NFD_OUT_RING_IDX
+
 #endm
 
 
@@ -293,6 +342,259 @@
 #endm
 
 
+/**
+ * Check whether a packet that found no credits should be dropped.
+ * @param out_drop  GPR set to 1 if the packet must be dropped, else 0
+ * @param in_pcie   PCIe island
+ * @param in_qid    Queue that had no credits
+ *
+ * With NFD_OUT_FL_STARVE_DROP, PCI.OUT flags a queue once the host has
+ * left it without FL buffers for NFD_OUT_FL_STARVE_TICKS.  Use this when
+ * nfd_out_get_credits() fails.  If the queue is flagged, the drop is
+ * counted for NFP_NET_CFG_RXR_STARVE_DROPS and the caller must free the
+ * packet rather than hold it waiting for credits.
+ */
+#macro nfd_out_starve_drop(out_drop, in_pcie, in_qid)
+.begin
+    #ifdef NFD_OUT_FL_STARVE_DROP
+        .reg addr_hi
+        .reg addr_lo
+        .reg read $flag
+        .sig starve_sig
+
+        #if (is_ct_const(in_pcie))
+            move(addr_hi, (((in_pcie + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+        #else
+            alu[addr_hi, in_pcie, +, (NFD_PCIE_ISL_BASE | __NFD_DIRECT_ACCESS)]
+            alu[addr_hi, --, B, addr_hi, <<24]
+        #endif
+
+        #if (is_ct_const(in_qid))
+            move(addr_lo, (NFD_OUT_STARVE_BASE + \
+                           (in_qid << NFD_OUT_STARVE_SZ_LG2)))
+        #else
+            alu[addr_lo, --, B, in_qid, <<NFD_OUT_STARVE_SZ_LG2]
+            alu[addr_lo, addr_lo, OR, (NFD_OUT_STARVE_BASE >> 8), <<8]
+        #endif
+
+        mem[atomic_read, $flag, addr_hi, <<8, addr_lo, 1], ctx_swap[starve_sig]
+        alu[out_drop, --, B, $flag]
+        .if (out_drop != 0)
+            // PCI.OUT adds the drops to the CFG BAR
+            alu[addr_lo, addr_lo, OR, NFD_OUT_STARVE_DROPS]
+            mem[incr, --, addr_hi, <<8, addr_lo]
+            immed[out_drop, 1]
+        .endif
+    #else
+        immed[out_drop, 0]
+    #endif
+.end
+#endm
+
+
+#ifdef NFD_OUT_CREDIT_RSV
+/* Credits taken from the queue each time a credit reservation runs dry */
+#ifndef NFD_OUT_CREDIT_RSV_BLK
+#define NFD_OUT_CREDIT_RSV_BLK 32
+#endif
+
+/* Timestamp ticks (16 ME cycles) a credit reservation may sit unused
+ * before nfd_out_credit_rsv_expire() returns it to the queue */
+#ifndef NFD_OUT_CREDIT_RSV_TIMEOUT
+#define NFD_OUT_CREDIT_RSV_TIMEOUT 4096
+#endif
+
+/* Timestamp ticks (16 ME cycles) a credit reservation may be spent without
+ * checking the queue generation */
+#ifndef NFD_OUT_CREDIT_RSV_CHECK
+#define NFD_OUT_CREDIT_RSV_CHECK 256
+#endif
+
+
+#macro _nfd_out_credit_rsv_addr(out_addr_hi, out_addr_lo, in_pcie, in_qid)
+    #if (is_ct_const(in_pcie))
+        move(out_addr_hi, (((in_pcie + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+    #else
+        alu[out_addr_hi, in_pcie, +, (NFD_PCIE_ISL_BASE | __NFD_DIRECT_ACCESS)]
+        alu[out_addr_hi, --, B, out_addr_hi, <<24]
+    #endif
+
+    #if (is_ct_const(in_qid))
+        move(out_addr_lo, (in_qid << NFD_OUT_ATOMICS_SZ_LG2))
+    #else
+        alu[out_addr_lo, --, B, in_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+    #endif
+#endm
+
+
+/**
+ * Take credits from a per thread reservation.
+ * @param out_got       GPR set to "in_num" if the credits were taken, else 0
+ * @param io_credits    GPR holding the reserved credits not yet spent
+ * @param io_gen        GPR holding the queue generation of the credits
+ * @param io_ts         GPR holding the timestamp of the last credit taken
+ * @param io_chk        GPR holding the timestamp of the last generation
+ *                      check
+ * @param in_pcie       PCIe island
+ * @param in_qid        Queue the reservation is for
+ * @param in_num        Number of credits required, at most
+ *                      NFD_OUT_CREDIT_RSV_BLK
+ *
+ * Microcode version of nfd_out_credit_rsv_get(), see pci_out.h.  Zero
+ * "io_credits" and "io_chk" before first use.  The reservation is tied to
+ * one queue, release it with nfd_out_credit_rsv_release() before using it
+ * for a different queue.
+ */
+#macro nfd_out_credit_rsv_get(out_got, io_credits, io_gen, io_ts, io_chk, \
+                              in_pcie, in_qid, in_num)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg gen_addr_lo
+    .reg num
+    .reg got
+    .reg blk
+    .reg now
+    .reg since
+    .reg check
+    .reg read $gen
+    .reg $credits
+    .sig gen_sig
+    .sig credit_sig
+
+    move(num, in_num)
+    immed[out_got, 0]
+    local_csr_rd[TIMESTAMP_LOW]
+    immed[now, 0]
+
+    .if (io_credits >= num)
+        // Only check the generation every NFD_OUT_CREDIT_RSV_CHECK
+        alu[since, now, -, io_chk]
+        move(check, NFD_OUT_CREDIT_RSV_CHECK)
+        .if (since >= check)
+            _nfd_out_credit_rsv_addr(addr_hi, addr_lo, in_pcie, in_qid)
+            alu[gen_addr_lo, addr_lo, OR, NFD_OUT_ATOMICS_GEN]
+            mem[atomic_read, $gen, addr_hi, <<8, gen_addr_lo, 1], \
+                ctx_swap[gen_sig]
+            alu[io_chk, --, B, now]
+            .if ($gen != io_gen)
+                // The queue was reset, refill under the new generation
+                immed[io_credits, 0]
+            .endif
+        .endif
+    .endif
+
+    .if (io_credits < num)
+        _nfd_out_credit_rsv_addr(addr_hi, addr_lo, in_pcie, in_qid)
+        alu[gen_addr_lo, addr_lo, OR, NFD_OUT_ATOMICS_GEN]
+        move(blk, NFD_OUT_CREDIT_RSV_BLK)
+        move($credits, NFD_OUT_CREDIT_RSV_BLK)
+        mem[atomic_read, $gen, addr_hi, <<8, gen_addr_lo, 1], \
+            sig_done[gen_sig]
+        mem[test_subsat, $credits, addr_hi, <<8, addr_lo, 1], \
+            sig_done[credit_sig]
+        ctx_arb[gen_sig, credit_sig]
+        alu[io_chk, --, B, now]
+
+        .if ($gen != io_gen)
+            // The queue was reset, the old credits are void
+            immed[io_credits, 0]
+            alu[io_gen, --, B, $gen]
+        .endif
+
+        // test_subsat returns the credits before the subtract
+        alu[got, --, B, $credits]
+        .if (got > blk)
+            alu[got, --, B, blk]
+        .endif
+        alu[io_credits, io_credits, +, got]
+    .endif
+
+    .if (io_credits >= num)
+        alu[io_credits, io_credits, -, num]
+        alu[out_got, --, B, num]
+        alu[io_ts, --, B, now]
+    .endif
+.end
+#endm
+
+
+/**
+ * Return unspent reserved credits to the queue.
+ * @param io_credits    GPR holding the reserved credits, zeroed on return
+ * @param in_gen        Queue generation of the credits
+ * @param in_pcie       PCIe island
+ * @param in_qid        Queue the reservation is for
+ *
+ * Microcode version of nfd_out_credit_rsv_release(), see pci_out.h.  The
+ * credits go to the return slot of their generation, which PCI.OUT only
+ * adds back to the queue while that generation is current.
+ */
+#macro nfd_out_credit_rsv_release(io_credits, in_gen, in_pcie, in_qid)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg slot
+    .reg read $gen
+    .reg write $ret
+    .sig rsv_sig
+
+    .if (io_credits != 0)
+        _nfd_out_credit_rsv_addr(addr_hi, addr_lo, in_pcie, in_qid)
+        alu[addr_lo, addr_lo, OR, NFD_OUT_ATOMICS_GEN]
+        mem[atomic_read, $gen, addr_hi, <<8, addr_lo, 1], ctx_swap[rsv_sig]
+
+        .if ($gen == in_gen)
+            alu[$ret, --, B, io_credits]
+            #if (is_ct_const(in_qid))
+                move(addr_lo, (NFD_OUT_CREDIT_RET_BASE + \
+                               (in_qid << NFD_OUT_CREDIT_RET_SZ_LG2)))
+            #else
+                alu[addr_lo, --, B, in_qid, <<NFD_OUT_CREDIT_RET_SZ_LG2]
+                alu[addr_lo, addr_lo, OR, (NFD_OUT_CREDIT_RET_BASE >> 8), <<8]
+            #endif
+            // The slot for the parity of the generation
+            alu[slot, in_gen, AND, 1]
+            alu[addr_lo, addr_lo, OR, slot, <<2]
+            mem[add, $ret, addr_hi, <<8, addr_lo, 1], ctx_swap[rsv_sig]
+        .endif
+
+        immed[io_credits, 0]
+    .endif
+.end
+#endm
+
+
+/**
+ * Return reserved credits that have not been used for
+ * NFD_OUT_CREDIT_RSV_TIMEOUT.
+ * @param io_credits    GPR holding the reserved credits
+ * @param in_gen        Queue generation of the credits
+ * @param in_ts         Timestamp of the last credit taken
+ * @param in_pcie       PCIe island
+ * @param in_qid        Queue the reservation is for
+ *
+ * Microcode version of nfd_out_credit_rsv_expire(), see pci_out.h.
+ */
+#macro nfd_out_credit_rsv_expire(io_credits, in_gen, in_ts, in_pcie, in_qid)
+.begin
+    .reg idle
+    .reg timeout
+
+    .if (io_credits != 0)
+        local_csr_rd[TIMESTAMP_LOW]
+        immed[idle, 0]
+        alu[idle, idle, -, in_ts]
+        move(timeout, NFD_OUT_CREDIT_RSV_TIMEOUT)
+        .if (idle > timeout)
+            nfd_out_credit_rsv_release(io_credits, in_gen, in_pcie, in_qid)
+        .endif
+    .endif
+.end
+#endm
+#endif
+
+
 /**
  * Prepend packet with metadata.
  * @param io_meta_len       Length of metadata currently prepended
@@ -552,7 +854,13 @@ not_ctm_only#:
     move(io_xnfd[0], io_desc[0])
     move(io_xnfd[1], io_desc[1])
     move(io_xnfd[2], io_desc[2])
-    move(io_xnfd[3], io_desc[3])
+    #ifdef NFD_OUT_RX_SCATTER
+        // Whole packets only, segments are sent with nfd_out_scatter_desc()
+        passert(BF_W(NFD_OUT_FLAGS_fld), "EQ", 3)
+        alu[io_xnfd[3], io_desc[3], OR, PCIE_DESC_RX_EOP]
+    #else
+        move(io_xnfd[3], io_desc[3])
+    #endif
 
     alu[addr_hi, *l$index/**/LM_CTX, AND, 0xFF, <<24]
     ld_field_w_clr[addr_lo, 0011, *l$index/**/LM_CTX]
@@ -580,4 +888,94 @@ not_ctm_only#:
 .end
 #endm
 
+
+/* A single ring command can add at most 16 words of work */
+#define NFD_OUT_SEND_BURST_MAX  4
+
+/* Send in_count descriptors with a single ring command.  io_desc holds
+ * in_count consecutive descriptors, each with its queue already set in
+ * NFD_OUT_QID_fld, and io_xnfd must have room for them all. */
+#macro nfd_out_send_burst(io_xnfd, io_desc, in_pcie, in_count, LM_CTX, SIG, SIGTYPE)
+.begin
+    .reg addr_lo
+    .reg addr_hi
+    .reg qid
+    .reg total_len
+
+    #if (!is_ct_const(in_count))
+        #error "nfd_out_send_burst: in_count must be a constant"
+    #endif
+    #if ((in_count < 1) || (in_count > NFD_OUT_SEND_BURST_MAX))
+        #error "nfd_out_send_burst: in_count must be 1 to NFD_OUT_SEND_BURST_MAX"
+    #endif
+
+    #if (is_ct_const(in_pcie))
+        immed[addr_lo, (nfd_out_ring_info +
+                        (in_pcie << log2(NFD_OUT_RING_INFO_ITEM_SZ)))]
+    #else
+        passert(nfd_out_ring_info,  "MULTIPLE_OF",
+                (NFD_MAX_ISL * NFD_OUT_RING_INFO_ITEM_SZ))
+        immed[addr_lo, nfd_out_ring_info]
+        alu[addr_lo, addr_lo, OR, in_pcie, <<(log2(NFD_OUT_RING_INFO_ITEM_SZ))]
+    #endif
+    local_csr_wr[ACTIVE_LM_ADDR_/**/LM_CTX, addr_lo]
+
+    #ifdef NFD_OUT_RX_SCATTER
+        passert(BF_W(NFD_OUT_FLAGS_fld), "EQ", (NFD_OUT_DESC_SIZE_LW - 1))
+    #endif
+    #define_eval __NFD_OUT_BURST_IDX 0
+    #while (__NFD_OUT_BURST_IDX < (in_count * NFD_OUT_DESC_SIZE_LW))
+        #if (defined(NFD_OUT_RX_SCATTER) && \
+             ((__NFD_OUT_BURST_IDX & (NFD_OUT_DESC_SIZE_LW - 1)) == \
+              (NFD_OUT_DESC_SIZE_LW - 1)))
+            // Whole packets only, as for nfd_out_send()
+            alu[io_xnfd[__NFD_OUT_BURST_IDX], io_desc[__NFD_OUT_BURST_IDX],
+                OR, PCIE_DESC_RX_EOP]
+        #else
+            move(io_xnfd[__NFD_OUT_BURST_IDX], io_desc[__NFD_OUT_BURST_IDX])
+        #endif
+        #define_eval __NFD_OUT_BURST_IDX (__NFD_OUT_BURST_IDX + 1)
+    #endloop
+
+    alu[addr_hi, *l$index/**/LM_CTX, AND, 0xFF, <<24]
+    ld_field_w_clr[addr_lo, 0011, *l$index/**/LM_CTX]
+
+    #if (streq('SIGTYPE', 'SIG_DONE'))
+        mem[qadd_work, io_xnfd[0], addr_hi, <<8, addr_lo,
+            (in_count * NFD_OUT_DESC_SIZE_LW)], sig_done[SIG]
+    #elif (streq('SIGTYPE', 'SIG_WAIT'))
+        mem[qadd_work, io_xnfd[0], addr_hi, <<8, addr_lo,
+            (in_count * NFD_OUT_DESC_SIZE_LW)], ctx_swap[SIG]
+    #else
+        #error "Unknown signal handling type"
+    #endif
+
+    passert(BF_W(NFD_OUT_LEN_fld), "EQ", BF_W(NFD_OUT_QID_fld))
+    #define_eval __NFD_OUT_BURST_IDX 0
+    #while (__NFD_OUT_BURST_IDX < in_count)
+        #define_eval __NFD_OUT_BURST_W \
+            ((__NFD_OUT_BURST_IDX * NFD_OUT_DESC_SIZE_LW) + BF_W(NFD_OUT_QID_fld))
+        bitfield_extract(qid, io_desc[__NFD_OUT_BURST_W],
+                         BF_ML(NFD_OUT_QID_fld))
+        bitfield_extract(total_len, io_desc[__NFD_OUT_BURST_W],
+                         BF_ML(NFD_OUT_LEN_fld))
+        nfd_stats_update_sent(in_pcie, qid, total_len)
+        #define_eval __NFD_OUT_BURST_IDX (__NFD_OUT_BURST_IDX + 1)
+    #endloop
+    #undef __NFD_OUT_BURST_W
+    #undef __NFD_OUT_BURST_IDX
+.end
+#endm
+
+
+#macro nfd_out_send_burst(io_desc, in_pcie, in_count, LM_CTX)
+.begin
+    .reg $xnfd[(NFD_OUT_SEND_BURST_MAX * NFD_OUT_DESC_SIZE_LW)]
+    .xfer_order $xnfd
+    .sig nfd_send_sig
+    nfd_out_send_burst($xnfd, io_desc, in_pcie, in_count, LM_CTX,
+                       nfd_send_sig, SIG_WAIT)
+.end
+#endm
+
 #endif /* __NFD_OUT_UC */
@@ -21,6 +21,7 @@
 #include <nfp.h>
 
 #include <nfp/me.h>
+#include <nfp/mem_bulk.h>
 #include <nfp/mem_ring.h>
 #include <pkt/pkt.h>
 #include <std/reg_utils.h>
@@ -108,6 +109,13 @@ swapw64(uint64_t val)
 __shared __lmem struct nfd_ring_info nfd_in_ring_info[NFD_MAX_ISL];
 __shared __lmem struct pkt_cntr_addr nfd_in_cntrs_base[NFD_MAX_ISL];
 
+#ifdef NFD_IN_SEQR_TBL
+/* Local copy of each island's sequencer table, see nfd_in_seqr_num() */
+__shared __lmem unsigned int nfd_in_seqr_cache[NFD_MAX_ISL]
+                                              [NFD_IN_SEQR_TBL_SZ / 4];
+__shared __lmem unsigned int nfd_in_seqr_cache_ts[NFD_MAX_ISL];
+#endif
+
 /* XXX point unused islands at a small "stray" ring? */
 __intrinsic void
 nfd_in_recv_init()
@@ -131,6 +139,19 @@ nfd_in_recv_init()
     NFD_IN_RING_LINK(3);
     nfd_in_cntrs_base[3] = NFD_IN_CNTR_ADDR(nfd_in_cntrs3);
 #endif
+
+#ifdef NFD_IN_SEQR_TBL
+    {
+        unsigned int i;
+        unsigned int now;
+
+        /* Mark every cached sequencer table as expired */
+        now = local_csr_read(local_csr_timestamp_low);
+        for (i = 0; i < NFD_MAX_ISL; i++) {
+            nfd_in_seqr_cache_ts[i] = now - NFD_IN_SEQR_CACHE_TICKS;
+        }
+    }
+#endif
 }
 
 
@@ -164,6 +185,115 @@ nfd_in_recv(unsigned int pcie_isl, unsigned int workq,
     __nfd_in_recv(pcie_isl, workq, nfd_in_meta, ctx_swap, &sig);
 }
 
+/* Per context hint that the last nfd_in_recv_burst() found descriptors */
+__gpr unsigned int nfd_in_recv_burst_busy = 0;
+
+__intrinsic unsigned int
+nfd_in_recv_burst(unsigned int pcie_isl, unsigned int workq,
+                  __xread struct nfd_in_pkt_desc *desc,
+                  const unsigned int max)
+{
+    mem_ring_addr_t raddr;
+    unsigned int rnum;
+    unsigned int ret = 0;
+
+    ctassert(__is_ct_const(max));
+    ctassert(max >= 1 && max <= NFD_IN_RECV_BURST_MAX);
+    try_ctassert(pcie_isl < NFD_MAX_ISL);
+
+    raddr = nfd_in_ring_info[pcie_isl].addr_hi << 24;
+    rnum = nfd_in_ring_info[pcie_isl].rnum;
+
+    rnum |= workq;
+
+    /* An idle work queue costs a single get per poll.  Once a descriptor
+     * turns up, try the full burst first, then fall back to smaller gets
+     * so that a partially filled work queue is still drained.  "get" fails
+     * without removing anything if too few descriptors are queued. */
+    if (!nfd_in_recv_burst_busy) {
+        if (mem_ring_get(rnum, raddr, desc, sizeof(*desc)) == 0) {
+            nfd_in_recv_burst_busy = 1;
+            ret = 1;
+        }
+    } else if (mem_ring_get(rnum, raddr, desc, max * sizeof(*desc)) == 0) {
+        ret = max;
+    } else if (max > 2 &&
+               mem_ring_get(rnum, raddr, desc, 2 * sizeof(*desc)) == 0) {
+        ret = 2;
+    } else if (max > 1 &&
+               mem_ring_get(rnum, raddr, desc, sizeof(*desc)) == 0) {
+        ret = 1;
+    } else {
+        nfd_in_recv_burst_busy = 0;
+    }
+
+    return ret;
+}
+
+#ifdef NFD_IN_PRIO_WQ
+/* Per context state of nfd_in_recv_prio(): the work queues the context
+ * has a request parked on, and the signal and transfer registers for each
+ * request */
+#define NFD_IN_PRIO_PEND_DATA   (1 << 0)
+#define NFD_IN_PRIO_PEND_PRIO   (1 << 1)
+__gpr unsigned int nfd_in_prio_pend = 0;
+SIGNAL nfd_in_prio_data_sig;
+SIGNAL nfd_in_prio_prio_sig;
+__xread struct nfd_in_pkt_desc nfd_in_prio_data_meta;
+__xread struct nfd_in_pkt_desc nfd_in_prio_prio_meta;
+
+__intrinsic int
+nfd_in_recv_prio(unsigned int pcie_isl, unsigned int workq)
+{
+    mem_ring_addr_t raddr;
+    unsigned int rnum;
+
+    try_ctassert(pcie_isl < NFD_MAX_ISL);
+
+    raddr = nfd_in_ring_info[pcie_isl].addr_hi << 24;
+    rnum = nfd_in_ring_info[pcie_isl].rnum;
+
+    /* Park a request on each work queue that has none outstanding */
+    if (!(nfd_in_prio_pend & NFD_IN_PRIO_PEND_DATA)) {
+        __mem_workq_add_thread(rnum | workq, raddr, &nfd_in_prio_data_meta,
+                               sizeof nfd_in_prio_data_meta,
+                               sizeof nfd_in_prio_data_meta,
+                               sig_done, &nfd_in_prio_data_sig);
+        nfd_in_prio_pend |= NFD_IN_PRIO_PEND_DATA;
+    }
+
+    if (!(nfd_in_prio_pend & NFD_IN_PRIO_PEND_PRIO)) {
+        __mem_workq_add_thread(rnum | NFD_IN_PRIO_WQ, raddr,
+                               &nfd_in_prio_prio_meta,
+                               sizeof nfd_in_prio_prio_meta,
+                               sizeof nfd_in_prio_prio_meta,
+                               sig_done, &nfd_in_prio_prio_sig);
+        nfd_in_prio_pend |= NFD_IN_PRIO_PEND_PRIO;
+    }
+
+    /* Hand out a priority packet first if both requests have completed.
+     * The other request stays delivered and is returned next call. */
+    for (;;) {
+        if (signal_test(&nfd_in_prio_prio_sig)) {
+            nfd_in_prio_pend &= ~NFD_IN_PRIO_PEND_PRIO;
+            __implicit_write(&nfd_in_prio_prio_meta);
+            return 1;
+        }
+
+        if (signal_test(&nfd_in_prio_data_sig)) {
+            nfd_in_prio_pend &= ~NFD_IN_PRIO_PEND_DATA;
+            __implicit_write(&nfd_in_prio_data_meta);
+            return 0;
+        }
+
+        wait_sig_mask(__signals(&nfd_in_prio_data_sig,
+                                &nfd_in_prio_prio_sig));
+        __implicit_read(&nfd_in_prio_data_sig);
+        __implicit_read(&nfd_in_prio_prio_sig);
+    }
+}
+#endif
+
 __intrinsic void
 __nfd_in_cnt_pkt(unsigned int pcie_isl, unsigned int bmsk_queue,
                  unsigned int byte_count, sync_t sync, SIGNAL *sig)
@@ -370,6 +500,88 @@ err:
 }
 
 
+/* Decode data word "_i" of a metadata chain cached in "meta_data" */
+#define _NFD_IN_META_PARSE_FIELD(_i)                                    \
+do {                                                                    \
+    if (meta_len > ((_i) * 4)) {                                        \
+        type = meta_info & NFP_NET_META_FIELD_MASK;                     \
+        meta_info >>= NFP_NET_META_FIELD_SIZE;                          \
+                                                                        \
+        switch (type) {                                                 \
+        case NFP_NET_META_HASH:                                         \
+            parsed->hash_type = meta_info & NFP_NET_META_FIELD_MASK;    \
+            meta_info >>= NFP_NET_META_FIELD_SIZE;                      \
+            parsed->hash = meta_data[_i];                               \
+            break;                                                      \
+        case NFP_NET_META_MARK:                                         \
+            parsed->mark = meta_data[_i];                               \
+            break;                                                      \
+        case NFP_NET_META_PORTID:                                       \
+            parsed->portid = meta_data[_i];                             \
+            break;                                                      \
+        case NFP_NET_META_VLAN:                                         \
+            parsed->vlan = meta_data[_i];                               \
+            break;                                                      \
+        case NFP_NET_META_CSUM:                                         \
+            parsed->csum = meta_data[_i];                               \
+            break;                                                      \
+        default:                                                        \
+            ret = -1;                                                   \
+            goto err;                                                   \
+        }                                                               \
+                                                                        \
+        parsed->present |= NFD_META_PRESENT(type);                      \
+    }                                                                   \
+} while (0)
+
+__intrinsic int
+nfd_in_metadata_parse(struct nfd_meta_parsed *parsed,
+                      unsigned int meta_len,
+                      __mem40 void *pkt_buf_ptr)
+{
+    __mem40 char *meta_ptr;
+    __xread unsigned int meta_data[NFD_META_PARSE_MAX_LEN / 4];
+    unsigned int meta_info;
+    unsigned int type;
+    SIGNAL sig_meta;
+    int ret = 0;
+
+    ctassert(__is_in_reg_or_lmem(pkt_buf_ptr));
+
+    parsed->present = 0;
+
+    if (meta_len > NFD_IN_MAX_META_LEN || meta_len > NFD_META_PARSE_MAX_LEN ||
+        (meta_len & 3) != 0) {
+        ret = -1;
+        goto err;
+    }
+
+    if (meta_len == 0) {
+        goto done;
+    }
+
+    meta_ptr = (__mem40 char *)((unsigned long long)pkt_buf_ptr +
+                                NFD_IN_DATA_OFFSET -
+                                (unsigned long long)meta_len);
+    __mem_read32(meta_data, meta_ptr, meta_len, NFD_META_PARSE_MAX_LEN,
+                 ctx_swap, &sig_meta);
+    meta_info = meta_data[0];
+
+    _NFD_IN_META_PARSE_FIELD(1);
+    _NFD_IN_META_PARSE_FIELD(2);
+    _NFD_IN_META_PARSE_FIELD(3);
+    _NFD_IN_META_PARSE_FIELD(4);
+    _NFD_IN_META_PARSE_FIELD(5);
+    _NFD_IN_META_PARSE_FIELD(6);
+    _NFD_IN_META_PARSE_FIELD(7);
+    _NFD_IN_META_PARSE_FIELD(8);
+
+done:
+err:
+    return ret;
+}
+
+
 __intrinsic void
 nfd_in_fill_meta(void *pkt_info,
                  __xread struct nfd_in_pkt_desc *nfd_in_meta)
@@ -425,6 +637,73 @@ nfd_in_pkt_len(__xread struct nfd_in_pkt_desc *nfd_in_meta)
 }
 
 
+__intrinsic unsigned int
+nfd_in_seqr_num(unsigned int pcie_isl, unsigned int queue)
+{
+#ifdef NFD_IN_SEQR_TBL
+    __mem40 unsigned char *tbl;
+    __xread unsigned int tbl_xfer[8];
+    unsigned int now;
+    unsigned int i;
+    unsigned int j;
+    SIGNAL sig;
+
+    try_ctassert(pcie_isl < NFD_MAX_ISL);
+
+    /* Reread the table once the local copy expires.  The timestamp is
+     * taken before the read, so the copy is never younger than it seems.
+     * PCI.IN waits out NFD_IN_SEQR_CACHE_TICKS after each table change
+     * before the host can use the queue that came up. */
+    now = local_csr_read(local_csr_timestamp_low);
+    if ((now - nfd_in_seqr_cache_ts[pcie_isl]) < NFD_IN_SEQR_CACHE_TICKS) {
+        return (nfd_in_seqr_cache[pcie_isl][queue >> 2] >>
+                ((3 - (queue & 3)) * 8)) & 0xFF;
+    }
+
+    switch (pcie_isl) {
+#ifdef NFD_PCIE0_EMEM
+    case 0:
+        tbl = NFD_IN_SEQR_TBL_LINK(0);
+        break;
+#endif
+#ifdef NFD_PCIE1_EMEM
+    case 1:
+        tbl = NFD_IN_SEQR_TBL_LINK(1);
+        break;
+#endif
+#ifdef NFD_PCIE2_EMEM
+    case 2:
+        tbl = NFD_IN_SEQR_TBL_LINK(2);
+        break;
+#endif
+#ifdef NFD_PCIE3_EMEM
+    case 3:
+        tbl = NFD_IN_SEQR_TBL_LINK(3);
+        break;
+#endif
+    default:
+        return 0;
+    }
+
+    for (i = 0; i < NFD_IN_SEQR_TBL_SZ; i += sizeof tbl_xfer) {
+        __mem_read32(tbl_xfer, tbl + i, sizeof tbl_xfer, sizeof tbl_xfer,
+                     ctx_swap, &sig);
+
+        for (j = 0; j < (sizeof tbl_xfer / 4); j++) {
+            nfd_in_seqr_cache[pcie_isl][(i / 4) + j] = tbl_xfer[j];
+        }
+    }
+    nfd_in_seqr_cache_ts[pcie_isl] = now;
+
+    /* The table holds one byte per queue, packed big endian into words */
+    return (nfd_in_seqr_cache[pcie_isl][queue >> 2] >>
+            ((3 - (queue & 3)) * 8)) & 0xFF;
+#else
+    return NFD_IN_SEQR_NUM(queue);
+#endif
+}
+
+
 __intrinsic unsigned int
 nfd_in_get_seqn(__xread struct nfd_in_pkt_desc *nfd_in_meta)
 {
@@ -43,6 +43,34 @@
 #define NFD_IN_NUM_WQS         8
 #endif
 
+#ifdef NFD_IN_PRIO_WQ
+#if (NFD_IN_PRIO_WQ < 1 || NFD_IN_PRIO_WQ >= NFD_IN_NUM_WQS)
+#error "NFD_IN_PRIO_WQ must be a work queue between 1 and NFD_IN_NUM_WQS-1"
+#endif
+
+/* Queues to direct to the priority work queue, one bit per natural
+ * queue.  The CTRL vNIC queue is always included. */
+#ifndef NFD_IN_PRIO_QUEUES_LO
+#define NFD_IN_PRIO_QUEUES_LO   0
+#endif
+
+#ifndef NFD_IN_PRIO_QUEUES_HI
+#define NFD_IN_PRIO_QUEUES_HI   0
+#endif
+
+#if (defined(NFD_USE_CTRL) && NFD_CTRL_QUEUE < 32)
+#define NFD_IN_PRIO_BMSK_LO     (NFD_IN_PRIO_QUEUES_LO | (1 << NFD_CTRL_QUEUE))
+#define NFD_IN_PRIO_BMSK_HI     NFD_IN_PRIO_QUEUES_HI
+#elif defined(NFD_USE_CTRL)
+#define NFD_IN_PRIO_BMSK_LO     NFD_IN_PRIO_QUEUES_LO
+#define NFD_IN_PRIO_BMSK_HI     (NFD_IN_PRIO_QUEUES_HI |                \
+                                 (1 << (NFD_CTRL_QUEUE - 32)))
+#else
+#define NFD_IN_PRIO_BMSK_LO     NFD_IN_PRIO_QUEUES_LO
+#define NFD_IN_PRIO_BMSK_HI     NFD_IN_PRIO_QUEUES_HI
+#endif
+#endif /* NFD_IN_PRIO_WQ */
+
 #ifndef NFD_IN_BLM_REG_BLS
 #error "NFD_IN_BLM_REG_BLS must be defined by the user"
 #endif
@@ -88,6 +116,15 @@
 #error "NFD_IN_NUM_SEQRS must be a power of 2 between 1 and 64"
 #endif
 
+#ifdef NFD_IN_SEQR_TBL
+#if (NFD_IN_NUM_SEQRS == 1)
+#error "NFD_IN_SEQR_TBL requires NFD_IN_NUM_SEQRS greater than 1"
+#endif
+#ifndef NFD_IN_ADD_SEQN
+#error "NFD_IN_SEQR_TBL requires NFD_IN_ADD_SEQN"
+#endif
+#endif
+
 /** @endcond */
 
 
@@ -116,6 +153,9 @@
  * sequencer 1 from pcie2, for example.  It is the application's
  * responsibility to map these <pcie, sequencer> tuples to appropriate
  * reorder contexts in GRO or the NBI traffic manager.
+ *
+ * If NFD_IN_SEQR_TBL is defined, this mapping is only the initial
+ * preference for a queue, and nfd_in_seqr_num() must be used instead.
  */
 #define NFD_IN_SEQR_NUM(_qnum) \
     (((_qnum) >> NFD_IN_SEQR_QSHIFT) & (NFD_IN_NUM_SEQRS - 1))
@@ -123,6 +163,57 @@
 
 /** @cond DOXYGEN_SHOULD_SKIP_THIS */
 
+/* The sequencer table holds one byte per queue, giving the sequencer
+ * currently assigned to the queue.  PCI.IN assigns a sequencer each time
+ * a queue comes up, and the table is read by notify and the application.
+ * The table is 256B aligned so that microcode can address it as a 40-bit
+ * base >> 8 plus the queue number.  The word after the table holds the
+ * last table generation that notify loaded, which PCI.IN waits for before
+ * passing on the configuration message that brought the queue up. */
+#define NFD_IN_SEQR_TBL_SZ      NFD_IN_MAX_QUEUES
+#define NFD_IN_SEQR_TBL_ALIGN   256
+#define NFD_IN_SEQR_TBL_ACK     NFD_IN_SEQR_TBL_SZ
+#define NFD_IN_SEQR_TBL_ALLOC   (NFD_IN_SEQR_TBL_SZ + 8)
+
+/* Applications cache the table in local memory and reread it once the
+ * copy is older than NFD_IN_SEQR_CACHE_TICKS ME timestamp ticks.  PCI.IN
+ * holds the configuration message for the same time after notify loads a
+ * new table, so the host cannot post to a queue that came up until every
+ * cached copy that predates the change has expired. */
+#ifndef NFD_IN_SEQR_CACHE_TICKS
+#define NFD_IN_SEQR_CACHE_TICKS 4096
+#endif
+
+#define NFD_IN_SEQR_TBL_DECL_IND1(_isl, _emem)                          \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_in_seqr_tbl##_isl _emem global      \
+                     NFD_IN_SEQR_TBL_ALLOC NFD_IN_SEQR_TBL_ALIGN)
+#define NFD_IN_SEQR_TBL_DECL_IND0(_isl)                                 \
+    NFD_IN_SEQR_TBL_DECL_IND1(_isl, NFD_PCIE##_isl##_EMEM)
+#define NFD_IN_SEQR_TBL_DECL(_isl) NFD_IN_SEQR_TBL_DECL_IND0(_isl)
+
+#define NFD_IN_SEQR_TBL_LINK_IND(_isl)                                  \
+    ((__mem40 unsigned char *) _link_sym(nfd_in_seqr_tbl##_isl))
+#define NFD_IN_SEQR_TBL_LINK(_isl) NFD_IN_SEQR_TBL_LINK_IND(_isl)
+
+#ifdef NFD_IN_SEQR_TBL
+#ifdef NFD_PCIE0_EMEM
+    NFD_IN_SEQR_TBL_DECL(0);
+#endif
+
+#ifdef NFD_PCIE1_EMEM
+    NFD_IN_SEQR_TBL_DECL(1);
+#endif
+
+#ifdef NFD_PCIE2_EMEM
+    NFD_IN_SEQR_TBL_DECL(2);
+#endif
+
+#ifdef NFD_PCIE3_EMEM
+    NFD_IN_SEQR_TBL_DECL(3);
+#endif
+#endif /* NFD_IN_SEQR_TBL */
+
+
 #ifdef NFD_IN_WQ_SHARED
 
 #define NFD_IN_RINGS_DECL_IND2(_isl, _emem)                             \
@@ -314,6 +405,12 @@ struct nfd_in_pkt_desc {
  */
 #define NFD_IN_IS_NFD_TRUE_VAL  1
 
+/**
+ * Maximum number of descriptors returned by nfd_in_recv_burst().
+ * A burst is limited by the 16 read transfer registers per context.
+ */
+#define NFD_IN_RECV_BURST_MAX   4
+
 
 /**
  * Prepare ME data structures required to receive packets from NFD
@@ -346,6 +443,76 @@ __intrinsic void nfd_in_recv(unsigned int pcie_isl, unsigned int workq,
                              __xread struct nfd_in_pkt_desc *nfd_in_meta);
 
 
+/**
+ * Receive up to "max" packets from PCI.IN with a single ring access
+ * @param pcie_isl      PCIe island
+ * @param workq         Work queue from the given island to access
+ * @param desc          Array of "max" PCI.IN descriptors to fill
+ * @param max           Maximum descriptors to fetch (compile time constant,
+ *                      1 to NFD_IN_RECV_BURST_MAX)
+ * @return              The number of valid descriptors in "desc"
+ *
+ * Unlike nfd_in_recv(), this method does not park the thread on the work
+ * queue, but polls the ring with a "get" for "max" descriptors.  If fewer
+ * descriptors are available, progressively smaller gets are attempted, so
+ * the method may return a partial burst, or zero if the queue is empty.
+ * Descriptors are always placed from desc[0] onwards.  After a poll that
+ * found the work queue empty, the next poll only gets one descriptor, so
+ * an idle work queue costs one ring access per call.  This hint is kept
+ * per context, so a context should poll a single work queue.
+ *
+ * @note  A work queue serviced with nfd_in_recv_burst() must not also be
+ * serviced with nfd_in_recv(), because threads added to an empty work queue
+ * are held on the ring and would be returned to a "get".  Use NFD_IN_NUM_WQS
+ * to dedicate a work queue to burst receivers if both methods are required.
+ */
+__intrinsic unsigned int nfd_in_recv_burst(unsigned int pcie_isl,
+                                           unsigned int workq,
+                                           __xread struct nfd_in_pkt_desc *desc,
+                                           const unsigned int max);
+
+
+#ifdef NFD_IN_PRIO_WQ
+/**
+ * Transfer registers that nfd_in_recv_prio() receives into, one for each
+ * work queue.  They are reserved for nfd_in_recv_prio(), as a request may
+ * be outstanding on either between calls.
+ */
+extern __xread struct nfd_in_pkt_desc nfd_in_prio_data_meta;
+extern __xread struct nfd_in_pkt_desc nfd_in_prio_prio_meta;
+
+/**
+ * Receive a packet from PCI.IN, servicing the priority work queue first
+ * @param pcie_isl      PCIe island
+ * @param workq         Data work queue from the given island to access
+ * @return              1 if "nfd_in_prio_prio_meta" holds the packet, 0 if
+ *                      "nfd_in_prio_data_meta" holds it
+ *
+ * The priority work queue (NFD_IN_PRIO_WQ) carries packets from the CTRL
+ * vNIC and the queues in NFD_IN_PRIO_QUEUES_LO/HI.  The calling context
+ * keeps a request parked on both "workq" and the priority work queue, and
+ * sleeps until either delivers, so priority packets are serviced while
+ * the data path is idle.  A priority packet is returned first if both
+ * requests have completed.
+ *
+ * A parked request can't be withdrawn, so the request on the other work
+ * queue remains outstanding between calls, and the memory unit may write
+ * its transfer registers at any time.  The descriptors are therefore only
+ * received into nfd_in_prio_data_meta and nfd_in_prio_prio_meta, which
+ * nothing else uses.  The returned descriptor stays valid until the next
+ * call.  Each context must always pass the same "pcie_isl" and "workq".
+ *
+ * A priority packet that is delivered to a context while it processes a
+ * packet from "workq" waits until that context calls again, so priority
+ * latency is bounded by the processing time of one packet.
+ *
+ * @note  The priority work queue must not be serviced with
+ *        nfd_in_recv_burst().
+ */
+__intrinsic int nfd_in_recv_prio(unsigned int pcie_isl, unsigned int workq);
+#endif
+
+
 /**
  * Increment packet and byte counts for PCI.IN queues.
  * @param pcie_isl      PCIe island
@@ -442,6 +609,25 @@ __intrinsic int nfd_in_metadata_pop_cache(unsigned int *meta_val,
                                           __mem40 void *pkt_buf_ptr);
 
 
+/**
+ * Decode the whole prepended metadata chain of a packet.
+ * @param parsed        Decoded metadata
+ * @param meta_len      Length of metadata prepended to the packet
+ * @param pkt_buf_ptr   Pointer to start of packet buffer
+ *
+ * The metadata is read with a single memory access and every field is
+ * decoded, so the caller does not need to track "meta_len" across calls
+ * as with nfd_in_metadata_pop().  Fields are valid if their
+ * NFD_META_PRESENT() bit is set in "parsed->present".  Returns zero on
+ * success, else -1 if "meta_len" exceeds NFD_IN_MAX_META_LEN or
+ * NFD_META_PARSE_MAX_LEN, or if a type without a known 4B value is found.
+ * nfd_meta_parse_ref() in shared/nfd_net.h is the host reference.
+ */
+__intrinsic int nfd_in_metadata_parse(struct nfd_meta_parsed *parsed,
+                                      unsigned int meta_len,
+                                      __mem40 void *pkt_buf_ptr);
+
+
 /**
  * Populate a nbi_meta_pkt_info structure from the NFD meta data.
  * @param pkt_info     nbi_meta_pkt_info struct for the packet
@@ -473,6 +659,22 @@ __intrinsic unsigned int nfd_in_pkt_len(
     __xread struct nfd_in_pkt_desc *nfd_in_meta);
 
 
+/**
+ * Get the sequencer assigned to a PCI.IN queue.
+ * @param pcie_isl      PCIe island
+ * @param queue         Queue number (QID) from the packet descriptor
+ * @return              The sequencer used for the queue's sequence numbers
+ *
+ * Without NFD_IN_SEQR_TBL this is NFD_IN_SEQR_NUM(queue).  With
+ * NFD_IN_SEQR_TBL the sequencer is taken from a local memory copy of the
+ * per island sequencer table, which is reread from EMEM at most once
+ * every NFD_IN_SEQR_CACHE_TICKS.  nfd_in_recv_init() must be called
+ * before the first lookup.
+ */
+__intrinsic unsigned int nfd_in_seqr_num(unsigned int pcie_isl,
+                                         unsigned int queue);
+
+
 /**
  * Get the sequence number for a PCI.IN sourced packet.
  * @param nfd_in_meta   PCI.IN descriptor for the packet
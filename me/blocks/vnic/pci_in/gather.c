@@ -26,6 +26,7 @@
 #include <nfp.h>
 #include <nfp_chipres.h>
 
+#include <nfp/mem_bulk.h>
 #include <nfp/pcie.h>
 #include <std/event.h>
 
@@ -69,6 +70,24 @@ __shared __gpr struct qc_bitmask active_bmsk;
 __shared __gpr struct qc_bitmask pending_bmsk;
 __shared __lmem struct nfd_in_queue_info queue_data[NFD_IN_MAX_QUEUES];
 
+#ifdef NFD_IN_SEQR_TBL
+/* Number of up queues assigned to each sequencer, and a generation count
+ * that is advanced each time the sequencer table is rewritten */
+static __shared __lmem unsigned int seqr_active[NFD_IN_NUM_SEQRS];
+__shared __gpr unsigned int seqr_tbl_gen = 0;
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+/* Per queue TX.R coalescing configuration shared with notify, and a
+ * generation count that is advanced each time the table is rewritten */
+NFD_IN_TXR_COAL_DECL(PCIE_ISL);
+__shared __gpr unsigned int txr_coal_gen = 0;
+#endif
+
+#ifdef NFD_IN_LAT_TRACE
+NFD_IN_LAT_JRNL_DECL(PCIE_ISL);
+#endif
+
 #if (NFD_IN_GATHER_MAX_IN_FLIGHT > 32)
 #error "Issue DMA index ring will not work with more than 32 DMAs in flight"
 #endif
@@ -178,16 +197,170 @@ gather_compl_rst()
 }
 
 
+#ifdef NFD_IN_SEQR_TBL
+/**
+ * Select a sequencer for a queue that is coming up
+ * @param queue     Bitmask queue number of the queue
+ *
+ * The sequencer with the fewest up queues is selected, so that busy
+ * queues do not share a reorder context while other sequencers sit idle.
+ * The static NFD_IN_SEQR_NUM() choice is preferred on ties, so lightly
+ * loaded configurations keep the same mapping as without the table.
+ * The choice is written to the sequencer table in memory, which notify
+ * reloads once the reflected table generation changes.  The entry may be
+ * seen by the application before notify uses it, but the host cannot post
+ * to the queue until ME0 passes on the configuration message, which it
+ * holds until notify has acknowledged the new generation.
+ */
+__intrinsic unsigned int
+gather_seqr_alloc(unsigned int queue)
+{
+    unsigned int seqr;
+    unsigned int i;
+    __xwrite unsigned int seqr_xfer;
+
+    seqr = NFD_IN_SEQR_NUM(queue);
+    for (i = 0; i < NFD_IN_NUM_SEQRS; i++) {
+        if (seqr_active[i] < seqr_active[seqr]) {
+            seqr = i;
+        }
+    }
+    seqr_active[seqr]++;
+
+    /* Write the byte for this queue, big endian byte order */
+    seqr_xfer = seqr << 24;
+    mem_write8(&seqr_xfer, NFD_IN_SEQR_TBL_LINK(PCIE_ISL) + queue, 1);
+    seqr_tbl_gen++;
+
+    return seqr;
+}
+
+
+/**
+ * Write the static sequencer mapping to the sequencer table
+ *
+ * This matches the table notify starts with, so that every entry holds a
+ * valid sequencer before any queue comes up.
+ */
+__intrinsic void
+gather_seqr_tbl_setup()
+{
+    __xwrite unsigned int tbl_xfer[8];
+    unsigned int i;
+    unsigned int j;
+    unsigned int q;
+    SIGNAL tbl_sig;
+
+    for (i = 0; i < NFD_IN_SEQR_TBL_SZ; i += sizeof tbl_xfer) {
+        for (j = 0; j < (sizeof tbl_xfer / 4); j++) {
+            q = i + j * 4;
+            tbl_xfer[j] = ((NFD_IN_SEQR_NUM(q) << 24) |
+                           (NFD_IN_SEQR_NUM(q + 1) << 16) |
+                           (NFD_IN_SEQR_NUM(q + 2) << 8) |
+                           NFD_IN_SEQR_NUM(q + 3));
+        }
+        __mem_write32(tbl_xfer, NFD_IN_SEQR_TBL_LINK(PCIE_ISL) + i,
+                      sizeof tbl_xfer, sizeof tbl_xfer, ctx_swap, &tbl_sig);
+    }
+}
+
+
+/**
+ * Release the sequencer of a queue that is going down
+ * @param seqr      Sequencer previously returned by gather_seqr_alloc()
+ *
+ * The table entry is left as is, because packets from the queue may
+ * still be in flight to notify.
+ */
+__intrinsic void
+gather_seqr_free(unsigned int seqr)
+{
+    seqr_active[seqr]--;
+}
+#endif
+
+
+#ifdef NFD_IN_TXR_COAL
+/**
+ * Update the TX.R coalescing configuration for a queue
+ * @param vid       vNIC the queue belongs to
+ * @param ring      Ring number within the vNIC
+ * @param queue     Bitmask queue number of the queue
+ * @param up        Whether the queue is up
+ *
+ * The thresholds are taken from the TX ring interrupt moderation
+ * configuration, so that TX.R updates are coalesced the same way as
+ * the TX interrupts that follow them.  The packet count is clamped to
+ * what a single QC add can carry.
+ */
+__intrinsic void
+gather_txr_coal_set(unsigned int vid, unsigned int ring, unsigned int queue,
+                    unsigned int up)
+{
+    __xread unsigned int irq_mod;
+    __xwrite unsigned int coal_xfer;
+    unsigned int pkts;
+    unsigned int ticks;
+    unsigned int cfg = 0;
+
+    if (up) {
+        mem_read32_le(&irq_mod, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                                 NFP_NET_CFG_TXR_IRQ_MOD(ring)),
+                      sizeof irq_mod);
+
+        pkts = NFD_IN_TXR_COAL_PKTS(irq_mod);
+        ticks = NFD_IN_TXR_COAL_TICKS(irq_mod);
+        if (ticks == 0) {
+            /* Coalescing disabled, update TX.R for every batch */
+            pkts = 1;
+        } else if (pkts == 0 || pkts > NFD_IN_TXR_COAL_MAX_PKTS) {
+            pkts = NFD_IN_TXR_COAL_MAX_PKTS;
+        }
+        cfg = NFD_IN_TXR_COAL_CFG(pkts, ticks);
+    }
+
+    coal_xfer = cfg;
+    mem_write32(&coal_xfer, NFD_IN_TXR_COAL_LINK(PCIE_ISL) + queue,
+                sizeof coal_xfer);
+    txr_coal_gen++;
+}
+#endif
+
+
 /**
  * Perform shared initialisation of the gather block.
  */
 void
 gather_setup_shared()
 {
+#ifdef NFD_IN_SEQR_TBL
+    unsigned int i;
+#endif
+
      /* Zero bitmasks */
     init_bitmasks(&active_bmsk);
     init_bitmasks(&pending_bmsk);
 
+#ifdef NFD_IN_SEQR_TBL
+    for (i = 0; i < NFD_IN_NUM_SEQRS; i++) {
+        seqr_active[i] = 0;
+    }
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+    /* Mark all queues down in the coalescing table */
+    {
+        __xwrite unsigned int zero[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        unsigned int off;
+
+        for (off = 0; off < NFD_IN_TXR_COAL_TBL_SZ; off += sizeof zero) {
+            mem_write32(zero,
+                        (__mem40 char *) NFD_IN_TXR_COAL_LINK(PCIE_ISL) + off,
+                        sizeof zero);
+        }
+    }
+#endif
+
     cls_ring_setup(NFD_IN_BATCH_RING0_NUM,
                    (__cls void *)_link_sym(nfd_in_batch_ring0_mem),
                    (NFD_IN_BATCH_RING0_SIZE_LW * 4));
@@ -364,6 +537,9 @@ gather_vnic_setup(struct nfd_cfg_msg *cfg_msg)
     unsigned char ring_sz;
     unsigned int ring_base[2];
     __gpr unsigned int bmsk_queue;
+#ifdef NFD_IN_TXR_COAL
+    unsigned int ring;
+#endif
 
     nfd_cfg_proc_msg(cfg_msg, &queue, &ring_sz, ring_base, NFD_CFG_PCI_IN0);
 
@@ -371,6 +547,9 @@ gather_vnic_setup(struct nfd_cfg_msg *cfg_msg)
         return;
     }
 
+#ifdef NFD_IN_TXR_COAL
+    ring = queue;
+#endif
     queue = NFD_VID2NATQ(cfg_msg->vid, queue);
     bmsk_queue = NFD_NATQ2BMQ(queue);
 
@@ -395,10 +574,19 @@ gather_vnic_setup(struct nfd_cfg_msg *cfg_msg)
         queue_data[bmsk_queue].up = 1;
         queue_data[bmsk_queue].ring_base_hi = ring_base[1] & 0xFF;
         queue_data[bmsk_queue].ring_base_lo = ring_base[0];
+#ifdef NFD_IN_SEQR_TBL
+        queue_data[bmsk_queue].seqr = gather_seqr_alloc(bmsk_queue);
+#endif
 
         txq.event_type   = NFP_QC_STS_LO_EVENT_TYPE_NOT_EMPTY;
         txq.size         = ring_sz - 8; /* XXX add define for size shift */
         qc_init_queue(PCIE_ISL, NFD_NATQ2QC(queue, NFD_IN_TX_QUEUE), &txq);
+#ifdef NFD_IN_TXR_COAL
+        gather_txr_coal_set(cfg_msg->vid, ring, bmsk_queue, 1);
+    } else if (cfg_msg->up_bit) {
+        /* The queue is already up, pick up interrupt moderation changes */
+        gather_txr_coal_set(cfg_msg->vid, ring, bmsk_queue, 1);
+#endif
     } else if (!cfg_msg->up_bit && queue_data[bmsk_queue].up) {
         /* Down the queue:
          * - Prevent it issuing events
@@ -416,6 +604,12 @@ gather_vnic_setup(struct nfd_cfg_msg *cfg_msg)
         queue_data[bmsk_queue].tx_w = 0;
         queue_data[bmsk_queue].tx_s = 0;
         queue_data[bmsk_queue].up = 0;
+#ifdef NFD_IN_SEQR_TBL
+        gather_seqr_free(queue_data[bmsk_queue].seqr);
+#endif
+#ifdef NFD_IN_TXR_COAL
+        gather_txr_coal_set(cfg_msg->vid, ring, bmsk_queue, 0);
+#endif
 
         /* Set QC queue to safe state (known size, no events, zeroed ptrs) */
         txq.event_type   = NFP_QC_STS_LO_EVENT_TYPE_NEVER;
@@ -691,6 +885,21 @@ gather()
             __pcie_dma_enq(PCIE_ISL, &descr, NFD_IN_GATHER_DMA_QUEUE,
                            sig_done, &dma_sig);
 
+#ifdef NFD_IN_LAT_TRACE
+            /* dma_issued0/1 cannot have moved on without a ctx_swap */
+            if (idma == 0) {
+                if (NFD_IN_LAT_SAMPLED(dma_issued0)) {
+                    NFD_IN_LAT_LOG(PCIE_ISL, NFD_IN_LAT_STAGE_GATHER, 0,
+                                   dma_issued0);
+                }
+            } else {
+                if (NFD_IN_LAT_SAMPLED(dma_issued1)) {
+                    NFD_IN_LAT_LOG(PCIE_ISL, NFD_IN_LAT_STAGE_GATHER, 1,
+                                   dma_issued1);
+                }
+            }
+#endif
+
             /* wait for ring put and the dma signal */
             wait_for_all(&batch_sig, &dma_sig);
 
@@ -124,6 +124,10 @@ volatile SIGNAL lso_hdr_dma_sig;
 __shared __gpr unsigned int gather_dma_seq_compl = 0;
 __shared __gpr unsigned int gather_dma_seq_serv = 0;
 
+#ifdef NFD_IN_LAT_TRACE
+NFD_IN_LAT_JRNL_DECL(PCIE_ISL);
+#endif
+
 __shared __gpr unsigned int data_dma_seq_issued = 0;
 extern __shared __gpr unsigned int data_dma_seq_safe;
 
@@ -2240,6 +2244,9 @@ issue_dma()
     static __xread struct nfd_in_batch_desc batch;
     unsigned int queue;
     unsigned int num;
+#ifdef NFD_IN_LAT_TRACE
+    unsigned int lat_seq;
+#endif
 
     for (;;) {
 
@@ -2259,6 +2266,9 @@ issue_dma()
          * about sequence number zero
          */
         gather_dma_seq_serv++;
+#ifdef NFD_IN_LAT_TRACE
+        lat_seq = gather_dma_seq_serv;
+#endif
 
         /* Read the batch descriptor */
         cls_ring_get(NFD_IN_BATCH_RING0_NUM + PCI_IN_ISSUE_DMA_IDX,
@@ -2381,6 +2391,13 @@ issue_dma()
         /* We have finished processing the batch, let the next continue */
         reorder_done_opt(&next_ctx, &dma_order_sig);
 
+#ifdef NFD_IN_LAT_TRACE
+        if (NFD_IN_LAT_SAMPLED(lat_seq)) {
+            NFD_IN_LAT_LOG(PCIE_ISL, NFD_IN_LAT_STAGE_ISSUE,
+                           PCI_IN_ISSUE_DMA_IDX, lat_seq);
+        }
+#endif
+
         /* Here we need to check how many descriptors we still need to write */
         if (batch_desc_cnt == 0) {
             ctm_ring_put(0, NFD_IN_ISSUED_RING_NUM, &batch_out.pkt0,
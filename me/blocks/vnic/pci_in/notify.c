@@ -25,6 +25,7 @@
 #include <nfp_chipres.h>
 
 #include <nfp/me.h>
+#include <nfp/mem_bulk.h>
 #include <nfp/mem_ring.h>
 
 #include <vnic/nfd_common.h>
@@ -44,6 +45,15 @@
 #error "At least one of NFD_IN_HAS_ISSUE0 and NFD_IN_HAS_ISSUE1 must be defined"
 #endif
 
+/* With NFD_IN_NOTIFY_ME1, each notify ME serves side PCI_IN_NOTIFY_IDX */
+#ifdef NFD_IN_NOTIFY_ME1
+#ifndef PCI_IN_NOTIFY_IDX
+#error "PCI_IN_NOTIFY_IDX must be defined on each notify ME"
+#endif
+#else
+#define PCI_IN_NOTIFY_IDX       0
+#endif
+
 #define LSO_PKT_XFER_START0     16
 #define LSO_PKT_XFER_START1     24
 
@@ -218,6 +228,22 @@ do {                                                                    \
 /* Add sequence numbers, using a LM to store */
 static __shared __lmem unsigned int seq_nums[NFD_IN_NUM_SEQRS];
 
+#ifdef NFD_IN_SEQR_TBL
+/* Local copy of the sequencer table, refreshed by the side 0 manager
+ * when gather reflects a new table generation */
+static __shared __lmem unsigned int seqr_tbl[NFD_IN_MAX_QUEUES];
+__xread unsigned int nfd_in_seqr_gen_refl_in = 0;
+static __gpr unsigned int seqr_tbl_gen = 0;
+
+#define NFD_IN_ADD_SEQN_PREP                                            \
+do {                                                                    \
+    local_csr_write(                                                    \
+        local_csr_active_lm_addr_3,                                     \
+        (uint32_t) &seq_nums[seqr_tbl[batch_in.pkt0.q_num]]);           \
+} while (0)
+
+#else /* NFD_IN_SEQR_TBL */
+
 #define NFD_IN_ADD_SEQN_PREP                                            \
 do {                                                                    \
     local_csr_write(                                                    \
@@ -225,6 +251,8 @@ do {                                                                    \
         (uint32_t) &seq_nums[NFD_IN_SEQR_NUM(batch_in.pkt0.__raw[0])]); \
 } while (0)
 
+#endif /* NFD_IN_SEQR_TBL */
+
 #define NFD_IN_ADD_SEQN_PROC                                            \
 do {                                                                    \
     __asm { ld_field[pkt_desc_tmp.__raw[0], 6, NFD_IN_SEQN_PTR, <<8] }  \
@@ -246,6 +274,25 @@ do {                                                                    \
 
 #endif /* NFD_IN_ADD_SEQN */
 
+#ifdef NFD_IN_TXR_COAL
+/* TX.R coalescing state, shared by both sides.  The configuration words
+ * are copied from the table gather writes, see nfd_internal.h. */
+static __shared __lmem unsigned int txr_coal_cfg[NFD_IN_MAX_QUEUES];
+static __shared __lmem unsigned int txr_coal_pend[NFD_IN_MAX_QUEUES];
+static __shared __lmem unsigned int txr_coal_ts[NFD_IN_MAX_QUEUES];
+static __shared __gpr unsigned int txr_coal_pend_lo = 0;
+static __shared __gpr unsigned int txr_coal_pend_hi = 0;
+__xread unsigned int nfd_in_txr_coal_gen_refl_in = 0;
+static __gpr unsigned int txr_coal_gen = 0;
+
+NFD_IN_TXR_COAL_DECL(PCIE_ISL);
+#endif /* NFD_IN_TXR_COAL */
+
+#ifdef NFD_IN_LAT_TRACE
+NFD_IN_LAT_JRNL_DECL(PCIE_ISL);
+#endif
+
+
 #if (NFD_IN_NUM_WQS == 1)
 #define _SET_DST_Q(_pkt)                                                \
 do {                                                                    \
@@ -258,6 +305,25 @@ do {                                                                    \
 #endif /* (NFD_IN_NUM_WQS == 1) */
 
 
+#ifdef NFD_IN_PRIO_WQ
+/* Select the work queue for a batch, all packets in the batch are from
+ * the same queue */
+#define _SET_BATCH_WQ(_q)                                               \
+do {                                                                    \
+    dst_q = wq_num_base;                                                \
+    if ((_q) < 32) {                                                    \
+        if ((1 << (_q)) & NFD_IN_PRIO_BMSK_LO) {                        \
+            dst_q |= NFD_IN_PRIO_WQ;                                    \
+        }                                                               \
+    } else {                                                            \
+        if ((1 << ((_q) & 31)) & NFD_IN_PRIO_BMSK_HI) {                 \
+            dst_q |= NFD_IN_PRIO_WQ;                                    \
+        }                                                               \
+    }                                                                   \
+} while (0)
+#endif
+
+
 /* Registers to store reset state */
 __xread unsigned int notify_reset_state_xfer = 0;
 __shared __gpr unsigned int notify_reset_state_gpr = 0;
@@ -360,9 +426,222 @@ notify_setup_visible(void)
     __implicit_write(&notify_reset_state_xfer);
     __implicit_write(&nfd_in_data_compl_refl_in);
     __implicit_write(&nfd_in_jumbo_compl_refl_in);
+
+#ifdef NFD_IN_SEQR_TBL
+    __assign_relative_register(&nfd_in_seqr_gen_refl_in,
+                               NFD_IN_NOTIFY_SEQR_RD);
+    __implicit_write(&nfd_in_seqr_gen_refl_in);
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+    __assign_relative_register(&nfd_in_txr_coal_gen_refl_in,
+                               NFD_IN_NOTIFY_TXR_COAL_RD);
+    __implicit_write(&nfd_in_txr_coal_gen_refl_in);
+#endif
+}
+
+
+#if (defined(NFD_IN_SEQR_TBL) || defined(NFD_IN_TXR_COAL))
+/**
+ * Publish the generation of a table that notify has loaded
+ * @param ack_addr  Acknowledgement word of the table
+ * @param gen       Generation now in use
+ *
+ * Gather holds the configuration message that changed the table until
+ * this generation matches its own.
+ */
+__intrinsic void
+notify_tbl_ack(__mem40 void *ack_addr, unsigned int gen)
+{
+    __xwrite unsigned int ack_xfer;
+    SIGNAL ack_sig;
+
+    ack_xfer = gen;
+    __mem_write32(&ack_xfer, ack_addr, sizeof ack_xfer, sizeof ack_xfer,
+                  ctx_swap, &ack_sig);
+}
+#endif
+
+
+#ifdef NFD_IN_SEQR_TBL
+#define NFD_IN_SEQR_ACK_ADDR                                            \
+    ((__mem40 char *) NFD_IN_SEQR_TBL_LINK(PCIE_ISL) + NFD_IN_SEQR_TBL_ACK)
+
+/**
+ * Reload the local copy of the sequencer table
+ *
+ * The table holds one byte per queue, packed big endian into words.
+ */
+__intrinsic void
+notify_seqr_tbl_load()
+{
+    __xread unsigned int tbl_xfer[8];
+    __mem40 char *tbl_addr = (__mem40 char *) NFD_IN_SEQR_TBL_LINK(PCIE_ISL);
+    unsigned int i;
+    unsigned int j;
+    SIGNAL tbl_sig;
+
+    for (i = 0; i < NFD_IN_MAX_QUEUES; i += sizeof tbl_xfer) {
+        __mem_read32(tbl_xfer, tbl_addr + i, sizeof tbl_xfer,
+                     sizeof tbl_xfer, ctx_swap, &tbl_sig);
+
+        for (j = 0; j < sizeof tbl_xfer; j++) {
+            seqr_tbl[i + j] =
+                (tbl_xfer[j >> 2] >> ((3 - (j & 3)) * 8)) & 0xFF;
+        }
+    }
+
+    /* Tell gather that the new table is in use */
+    notify_tbl_ack(NFD_IN_SEQR_ACK_ADDR, seqr_tbl_gen);
+}
+#endif
+
+
+#ifdef NFD_IN_TXR_COAL
+__intrinsic void
+txr_coal_set_pend(unsigned int queue)
+{
+    if (queue < 32) {
+        txr_coal_pend_lo |= (1 << queue);
+    } else {
+        txr_coal_pend_hi |= (1 << (queue & 31));
+    }
+}
+
+
+__intrinsic void
+txr_coal_clr_pend(unsigned int queue)
+{
+    if (queue < 32) {
+        txr_coal_pend_lo &= ~(1 << queue);
+    } else {
+        txr_coal_pend_hi &= ~(1 << (queue & 31));
+    }
 }
 
 
+/**
+ * Reload the TX.R coalescing configuration
+ *
+ * Queues that are marked down have their pending count discarded, as
+ * gather resets the QC queue when it downs a queue.  Gather holds the
+ * configuration message that downed the queue until this load is
+ * acknowledged, so the host cannot bring the queue up again before the
+ * stale count is gone.
+ */
+__intrinsic void
+notify_txr_coal_load()
+{
+    __xread unsigned int cfg_xfer[8];
+    __mem40 unsigned int *tbl_addr = NFD_IN_TXR_COAL_LINK(PCIE_ISL);
+    unsigned int cfg;
+    unsigned int i;
+    unsigned int j;
+    SIGNAL tbl_sig;
+
+    for (i = 0; i < NFD_IN_MAX_QUEUES; i += 8) {
+        __mem_read32(cfg_xfer, tbl_addr + i, sizeof cfg_xfer,
+                     sizeof cfg_xfer, ctx_swap, &tbl_sig);
+
+        for (j = 0; j < 8; j++) {
+            cfg = cfg_xfer[j];
+            if (cfg == 0) {
+                txr_coal_pend[i + j] = 0;
+                txr_coal_clr_pend(i + j);
+                cfg = NFD_IN_TXR_COAL_CFG(1, 0);
+            }
+            txr_coal_cfg[i + j] = cfg;
+        }
+    }
+
+    notify_tbl_ack(tbl_addr + NFD_IN_TXR_COAL_ACK + PCI_IN_NOTIFY_IDX,
+                   txr_coal_gen);
+}
+
+
+/**
+ * Find a queue with pending TX.R updates that is due
+ * @param queue     Set to the bitmask queue to update
+ * @param now       Current ME timestamp
+ * @return          Amount to add to TX.R of "queue", zero for no update
+ *
+ * Every pending queue is checked, as queues may have different tick
+ * thresholds, so a queue that is not due must not hold back the others.
+ */
+__intrinsic unsigned int
+txr_coal_expired(unsigned int *queue, unsigned int now)
+{
+    unsigned int q;
+    unsigned int base;
+    unsigned int mask;
+    unsigned int pend;
+
+    for (base = 0; base < NFD_IN_MAX_QUEUES; base += 32) {
+        mask = (base == 0) ? txr_coal_pend_lo : txr_coal_pend_hi;
+
+        while (mask != 0) {
+            __asm ffs[q, mask];
+            mask &= ~(1 << q);
+            q += base;
+
+            if ((now - txr_coal_ts[q]) >=
+                NFD_IN_TXR_COAL_TICKS(txr_coal_cfg[q])) {
+                pend = txr_coal_pend[q];
+                txr_coal_pend[q] = 0;
+                txr_coal_clr_pend(q);
+                *queue = q;
+                return pend;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Account a batch against the TX.R coalescing state of its queue
+ * @param queue     Bitmask queue of the batch, set to the queue to update
+ * @param n_batch   Number of descriptors in the batch
+ * @return          Amount to add to TX.R of "queue", zero for no update
+ *
+ * TX.R is updated once the pending count reaches the packet threshold, or
+ * the oldest pending descriptor is older than the tick threshold, as for
+ * interrupt moderation.  If the batch's own queue is not due, the update
+ * goes to an expired queue instead, so that queues which stop receiving
+ * batches are still flushed.  Nothing here swaps, so the state shared
+ * between contexts needs no further protection.
+ */
+__intrinsic unsigned int
+txr_coal_add(unsigned int *queue, unsigned int n_batch)
+{
+    unsigned int q = *queue;
+    unsigned int cfg = txr_coal_cfg[q];
+    unsigned int pend = txr_coal_pend[q];
+    unsigned int now = local_csr_read(local_csr_timestamp_low);
+
+    if (n_batch != 0) {
+        if (pend == 0) {
+            txr_coal_ts[q] = now;
+        }
+        pend += n_batch;
+
+        if ((pend >= NFD_IN_TXR_COAL_PKTS(cfg)) ||
+            ((now - txr_coal_ts[q]) >= NFD_IN_TXR_COAL_TICKS(cfg))) {
+            txr_coal_pend[q] = 0;
+            txr_coal_clr_pend(q);
+            return pend;
+        }
+
+        txr_coal_pend[q] = pend;
+        txr_coal_set_pend(q);
+    }
+
+    return txr_coal_expired(queue, now);
+}
+#endif /* NFD_IN_TXR_COAL */
+
+
 /**
  * Perform shared configuration for notify
  */
@@ -377,11 +656,40 @@ notify_setup_shared()
     wq_raddr = (unsigned long long) NFD_EMEM_LINK(PCIE_ISL) >> 8;
 #endif
 
-    /* Kick off ordering */
+#ifdef NFD_IN_SEQR_TBL
+    /* Start with the static mapping, gather rewrites the table as queues
+     * come up and reflects the change */
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_IN_MAX_QUEUES; i++) {
+            seqr_tbl[i] = NFD_IN_SEQR_NUM(i);
+        }
+        notify_tbl_ack(NFD_IN_SEQR_ACK_ADDR, 0);
+    }
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+    /* Update TX.R for every batch until gather provides the thresholds */
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_IN_MAX_QUEUES; i++) {
+            txr_coal_cfg[i] = NFD_IN_TXR_COAL_CFG(1, 0);
+            txr_coal_pend[i] = 0;
+        }
+        notify_tbl_ack(NFD_IN_TXR_COAL_LINK(PCIE_ISL) + NFD_IN_TXR_COAL_ACK +
+                       PCI_IN_NOTIFY_IDX, 0);
+    }
+#endif
+
+    /* Kick off ordering, one token per side */
     reorder_start(NFD_IN_NOTIFY_MANAGER0, &msg_order_sig);
     reorder_start(NFD_IN_NOTIFY_MANAGER0, &get_order_sig);
+#if (NFD_IN_NOTIFY_SIDES > 1)
     reorder_start(NFD_IN_NOTIFY_MANAGER1, &msg_order_sig);
     reorder_start(NFD_IN_NOTIFY_MANAGER1, &get_order_sig);
+#endif
 }
 
 
@@ -621,10 +929,20 @@ _notify(__shared __gpr unsigned int *complete,
     __xread struct _issued_pkt_batch batch_in;
     struct _pkt_desc_batch batch_tmp;
     struct nfd_in_pkt_desc pkt_desc_tmp;
+#ifdef NFD_IN_LAT_TRACE
+    unsigned int lat_seq;
+    unsigned int lat_side = (input_ring == NFD_IN_ISSUED_RING0_NUM) ? 0 : 1;
+#endif
 
     /* Reorder before potentially issuing a ring get */
     wait_for_all(&get_order_sig);
 
+#ifdef NFD_IN_LAT_TRACE
+    /* Number the batch the same way as gather and issue_dma, each batch
+     * advances "served" by NFD_IN_MAX_BATCH_SZ */
+    lat_seq = (*served / NFD_IN_MAX_BATCH_SZ) + 1;
+#endif
+
     /* There is a FULL batch to process
      * XXX assume that issue_dma inc's dma seq for each nfd_in_issued_desc in
      * batch. */
@@ -680,6 +998,9 @@ _notify(__shared __gpr unsigned int *complete,
         /* Interface and queue info are the same for all packets in batch */
         pkt_desc_tmp.intf = PCIE_ISL;
         pkt_desc_tmp.q_num = batch_in.pkt0.q_num;
+#ifdef NFD_IN_PRIO_WQ
+        _SET_BATCH_WQ(pkt_desc_tmp.q_num);
+#endif
 #ifdef NFD_IN_ADD_SEQN
         NFD_IN_ADD_SEQN_PREP;
 #else
@@ -700,12 +1021,34 @@ _notify(__shared __gpr unsigned int *complete,
          * lock out other threads. */
         reorder_done_opt(&next_ctx, &msg_order_sig);
 
+#ifdef NFD_IN_TXR_COAL
+        /* Account the batch for coalescing, and update TX.R for whichever
+         * queue is due, if any */
+        qc_queue = batch_in.pkt0.q_num;
+        n_batch = txr_coal_add(&qc_queue, n_batch);
+        if (n_batch == 0) {
+            wait_msk &= ~__signals(&qc_sig);
+            __implicit_write(&qc_sig);
+        } else {
+            qc_queue = NFD_NATQ2QC(NFD_BMQ2NATQ(qc_queue), NFD_IN_TX_QUEUE);
+            __qc_add_to_ptr_wr(PCIE_ISL, qc_queue, QC_RPTR, n_batch,
+                               &batch_out.pkt0.__raw[0], sig_done, &qc_sig);
+        }
+#else
         /* Map batch.queue to a QC queue and increment the TX_R pointer
          * for that queue by n_batch */
         qc_queue = NFD_NATQ2QC(NFD_BMQ2NATQ(batch_in.pkt0.q_num),
                                NFD_IN_TX_QUEUE);
         __qc_add_to_ptr_wr(PCIE_ISL, qc_queue, QC_RPTR, n_batch,
                            &batch_out.pkt0.__raw[0], sig_done, &qc_sig);
+#endif
+
+#ifdef NFD_IN_LAT_TRACE
+        if (NFD_IN_LAT_SAMPLED(lat_seq)) {
+            NFD_IN_LAT_LOG(PCIE_ISL, NFD_IN_LAT_STAGE_NOTIFY, lat_side,
+                           lat_seq);
+        }
+#endif
 
     } else if (num_avail > 0) {
         /* There is a partial batch - process messages one at a time. */
@@ -735,13 +1078,20 @@ _notify(__shared __gpr unsigned int *complete,
          * signals that will not be set while processing a partial
          * batch and store batch info. */
         n_batch = batch_in.pkt0.num_batch;
+#ifdef NFD_IN_TXR_COAL
+        qc_queue = batch_in.pkt0.q_num;
+#else
         qc_queue = NFD_NATQ2QC(NFD_BMQ2NATQ(batch_in.pkt0.q_num),
                                NFD_IN_TX_QUEUE);
+#endif
         wait_msk = __signals(&msg_sig0, &wq_sig0);
 
         /* Interface and queue info is the same for all packets in batch */
         pkt_desc_tmp.intf = PCIE_ISL;
         pkt_desc_tmp.q_num = batch_in.pkt0.q_num;
+#ifdef NFD_IN_PRIO_WQ
+        _SET_BATCH_WQ(pkt_desc_tmp.q_num);
+#endif
 #ifdef NFD_IN_ADD_SEQN
         NFD_IN_ADD_SEQN_PREP;
 #else
@@ -806,9 +1156,28 @@ _notify(__shared __gpr unsigned int *complete,
          * lock out other threads. */
         reorder_done_opt(&next_ctx, &msg_order_sig);
 
+#ifdef NFD_IN_TXR_COAL
+        n_batch = txr_coal_add(&qc_queue, n_batch);
+        if (n_batch == 0) {
+            wait_msk &= ~__signals(&qc_sig);
+            __implicit_write(&qc_sig);
+        } else {
+            qc_queue = NFD_NATQ2QC(NFD_BMQ2NATQ(qc_queue), NFD_IN_TX_QUEUE);
+            __qc_add_to_ptr_wr(PCIE_ISL, qc_queue, QC_RPTR, n_batch,
+                               &batch_out.pkt0.__raw[0], sig_done, &qc_sig);
+        }
+#else
         /* Increment the TX_R pointer for this queue by n_batch */
         __qc_add_to_ptr_wr(PCIE_ISL, qc_queue, QC_RPTR, n_batch,
                            &batch_out.pkt0.__raw[0], sig_done, &qc_sig);
+#endif
+
+#ifdef NFD_IN_LAT_TRACE
+        if (NFD_IN_LAT_SAMPLED(lat_seq)) {
+            NFD_IN_LAT_LOG(PCIE_ISL, NFD_IN_LAT_STAGE_NOTIFY, lat_side,
+                           lat_seq);
+        }
+#endif
 
     } else {
         /* Participate in ctm_ring_get ordering */
@@ -817,6 +1186,24 @@ _notify(__shared __gpr unsigned int *complete,
         /* Participate in msg ordering */
         wait_for_all(&msg_order_sig);
         reorder_done_opt(&next_ctx, &msg_order_sig);
+
+#ifdef NFD_IN_TXR_COAL
+        /* Flush an expired queue while there is no work, unless a TX.R
+         * update from a previous batch is still outstanding */
+        if ((wait_msk & __signals(&qc_sig)) == 0) {
+            qc_queue = 0;
+            n_batch = txr_coal_expired(
+                &qc_queue, local_csr_read(local_csr_timestamp_low));
+            if (n_batch != 0) {
+                qc_queue = NFD_NATQ2QC(NFD_BMQ2NATQ(qc_queue),
+                                       NFD_IN_TX_QUEUE);
+                __qc_add_to_ptr_wr(PCIE_ISL, qc_queue, QC_RPTR, n_batch,
+                                   &batch_out.pkt0.__raw[0], sig_done,
+                                   &qc_sig);
+                wait_msk |= __signals(&qc_sig);
+            }
+        }
+#endif
     }
 }
 
@@ -833,8 +1220,8 @@ notify(int side)
     } else {
         _notify(&data_dma_seq_compl1, &data_dma_seq_served1,
                 NFD_IN_ISSUED_RING1_NUM,
-                NFD_IN_NOTIFY_MANAGER1 << 5 | NFD_IN_NOTIFY_DATA_RD,
-                NFD_IN_NOTIFY_MANAGER1 << 5 | NFD_IN_NOTIFY_JUMBO_RD,
+                NFD_IN_NOTIFY_SIDE1_MANAGER << 5 | NFD_IN_NOTIFY_DATA_RD,
+                NFD_IN_NOTIFY_SIDE1_MANAGER << 5 | NFD_IN_NOTIFY_JUMBO_RD,
                 LSO_PKT_XFER_START1);
     }
 }
@@ -882,6 +1269,23 @@ distr_notify(int side)
      * notify_reset_state_gpr is not used in this context */
     __implicit_read(&notify_reset_state_gpr);
 
+    /* One manager per ME keeps the local copies of the tables */
+    if (side == PCI_IN_NOTIFY_IDX) {
+#ifdef NFD_IN_SEQR_TBL
+        if (nfd_in_seqr_gen_refl_in != seqr_tbl_gen) {
+            seqr_tbl_gen = nfd_in_seqr_gen_refl_in;
+            notify_seqr_tbl_load();
+        }
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+        if (nfd_in_txr_coal_gen_refl_in != txr_coal_gen) {
+            txr_coal_gen = nfd_in_txr_coal_gen_refl_in;
+            notify_txr_coal_load();
+        }
+#endif
+    }
+
     if (side == 0) {
 #ifdef NFD_IN_HAS_ISSUE0
         data_dma_seq_compl0 = nfd_in_data_compl_refl_in;
@@ -942,7 +1346,31 @@ main(void)
 
     }
 
-    /* Test which side the context is servicing */
+#ifdef NFD_IN_NOTIFY_ME1
+    /* Every context of this ME services side PCI_IN_NOTIFY_IDX */
+    notify_setup(PCI_IN_NOTIFY_IDX);
+
+    if (ctx() == NFD_IN_NOTIFY_MANAGER0) {
+
+        __xread struct nfd_in_lso_desc lso_pkt0;
+        __xread struct nfd_in_lso_desc lso_pkt1;
+
+        __assign_relative_register(&lso_pkt0, LSO_PKT_XFER_START0);
+        __assign_relative_register(&lso_pkt1, LSO_PKT_XFER_START1);
+
+        for (;;) {
+            notify_manager_reorder();
+            notify_manager_reorder();
+            distr_notify(PCI_IN_NOTIFY_IDX);
+        }
+    } else {
+        for (;;) {
+            notify(PCI_IN_NOTIFY_IDX);
+        }
+    }
+#else
+    /* Test which side the context is servicing.  With a single side,
+     * every context takes part in side 0 ordering. */
     if ((ctx() & (NFD_IN_NOTIFY_STRIDE - 1)) == 0) {
 
 #ifdef NFD_IN_HAS_ISSUE0
@@ -995,4 +1423,5 @@ main(void)
 #endif
 
     }
+#endif /* NFD_IN_NOTIFY_ME1 */
 }
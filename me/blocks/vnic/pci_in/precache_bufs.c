@@ -43,11 +43,13 @@
 #if (PCI_IN_ISSUE_DMA_IDX == 0)
 #define NFD_IN_DATA_EVENT_FILTER NFD_IN_DATA0_EVENT_FILTER
 #define NFD_IN_JUMBO_EVENT_FILTER NFD_IN_JUMBO0_EVENT_FILTER
+#define NFD_IN_NOTIFY_DST_ME NFD_IN_NOTIFY_ME
 #define NFD_IN_NOTIFY_MANAGER NFD_IN_NOTIFY_MANAGER0
 #else
 #define NFD_IN_DATA_EVENT_FILTER NFD_IN_DATA1_EVENT_FILTER
 #define NFD_IN_JUMBO_EVENT_FILTER NFD_IN_JUMBO1_EVENT_FILTER
-#define NFD_IN_NOTIFY_MANAGER NFD_IN_NOTIFY_MANAGER1
+#define NFD_IN_NOTIFY_DST_ME NFD_IN_NOTIFY_SIDE1_ME
+#define NFD_IN_NOTIFY_MANAGER NFD_IN_NOTIFY_SIDE1_MANAGER
 #endif
 
 
@@ -591,7 +593,7 @@ distr_precache_bufs(__xwrite unsigned int *data_wr,
 
             /* Mirror to remote ME */
             nfd_in_data_compl_refl_out = data_dma_seq_compl;
-            reflect_data(NFD_IN_NOTIFY_ME, NFD_IN_NOTIFY_MANAGER,
+            reflect_data(NFD_IN_NOTIFY_DST_ME, NFD_IN_NOTIFY_MANAGER,
                          NFD_IN_NOTIFY_DATA_RD, 0, &nfd_in_data_compl_refl_out,
                          sizeof nfd_in_data_compl_refl_out);
 
@@ -611,7 +613,7 @@ distr_precache_bufs(__xwrite unsigned int *data_wr,
 
             /* Mirror to remote ME */
             nfd_in_jumbo_compl_refl_out = jumbo_dma_seq_compl;
-            reflect_data(NFD_IN_NOTIFY_ME, NFD_IN_NOTIFY_MANAGER,
+            reflect_data(NFD_IN_NOTIFY_DST_ME, NFD_IN_NOTIFY_MANAGER,
                          NFD_IN_NOTIFY_JUMBO_RD, 0,
                          &nfd_in_jumbo_compl_refl_out,
                          sizeof nfd_in_jumbo_compl_refl_out);
@@ -639,7 +641,7 @@ distr_precache_bufs(__xwrite unsigned int *data_wr,
 
             /* Mirror to remote ME */
             nfd_in_data_compl_refl_out = data_dma_seq_compl;
-            reflect_data(NFD_IN_NOTIFY_ME, NFD_IN_NOTIFY_MANAGER,
+            reflect_data(NFD_IN_NOTIFY_DST_ME, NFD_IN_NOTIFY_MANAGER,
                          NFD_IN_NOTIFY_DATA_RD, 0, &nfd_in_data_compl_refl_out,
                          sizeof nfd_in_data_compl_refl_out);
         }
@@ -654,7 +656,7 @@ distr_precache_bufs(__xwrite unsigned int *data_wr,
 
             /* Mirror to remote ME */
             nfd_in_jumbo_compl_refl_out = jumbo_dma_seq_compl;
-            reflect_data(NFD_IN_NOTIFY_ME, NFD_IN_NOTIFY_MANAGER,
+            reflect_data(NFD_IN_NOTIFY_DST_ME, NFD_IN_NOTIFY_MANAGER,
                          NFD_IN_NOTIFY_JUMBO_RD, 0,
                          &nfd_in_jumbo_compl_refl_out,
                          sizeof nfd_in_jumbo_compl_refl_out);
@@ -90,7 +90,162 @@ pci_in_msg_notify(unsigned int isl_reset)
                                      ((NFD_IN_NOTIFY_ME & 0xF) - 4), 0,
                                      NFD_IN_NOTIFY_RESET_RD,
                                      sizeof notify_reset_state);
+#ifdef NFD_IN_NOTIFY_ME1
+    remote_me_reg_write_signal_local(&notify_reset_state,
+                                     ((NFD_IN_NOTIFY_ME1 & 0xFF0) >> 4),
+                                     ((NFD_IN_NOTIFY_ME1 & 0xF) - 4), 0,
+                                     NFD_IN_NOTIFY_RESET_RD,
+                                     sizeof notify_reset_state);
+#endif
+}
+
+
+#if (defined(NFD_IN_SEQR_TBL) || defined(NFD_IN_TXR_COAL))
+/* Tables reflected to Notify that it has yet to acknowledge.  The
+ * configuration message that changed them is held until it has. */
+#define NOTIFY_TBL_SEQR         (1 << 0)
+#define NOTIFY_TBL_SEQR_AGE     (1 << 1)
+#define NOTIFY_TBL_TXR_COAL     (1 << 2)
+__shared __gpr unsigned int notify_tbl_pend = 0;
+
+/**
+ * Reflect a table generation to Notify if it has changed
+ * @param gen_xfer  Write transfer register to reflect from
+ * @param gen       Current generation of the table
+ * @param sent      Generation last reflected
+ * @param xfer_num  Notify transfer register to reflect to
+ * @return          Non-zero if the generation was reflected
+ */
+__intrinsic int
+pci_in_msg_notify_tbl(__xwrite unsigned int *gen_xfer, unsigned int gen,
+                      unsigned int sent, unsigned int xfer_num)
+{
+    if (gen == sent) {
+        return 0;
+    }
+
+    *gen_xfer = gen;
+    remote_me_reg_write_signal_local(gen_xfer,
+                                     ((NFD_IN_NOTIFY_ME & 0xFF0) >> 4),
+                                     ((NFD_IN_NOTIFY_ME & 0xF) - 4), 0,
+                                     xfer_num, sizeof *gen_xfer);
+#ifdef NFD_IN_NOTIFY_ME1
+    remote_me_reg_write_signal_local(gen_xfer,
+                                     ((NFD_IN_NOTIFY_ME1 & 0xFF0) >> 4),
+                                     ((NFD_IN_NOTIFY_ME1 & 0xF) - 4), 0,
+                                     xfer_num, sizeof *gen_xfer);
+#endif
+    return 1;
+}
+
+/**
+ * Test whether Notify has acknowledged a table generation
+ * @param ack_addr  Word that Notify writes the loaded generation to
+ * @param gen       Generation last reflected
+ */
+__intrinsic int
+pci_in_msg_notify_tbl_acked(__mem40 void *ack_addr, unsigned int gen)
+{
+    __xread unsigned int ack_xfer;
+    SIGNAL ack_sig;
+
+    __mem_read32(&ack_xfer, ack_addr, sizeof ack_xfer, sizeof ack_xfer,
+                 ctx_swap, &ack_sig);
+    return (ack_xfer == gen);
+}
+#endif
+
+
+#ifdef NFD_IN_SEQR_TBL
+/* Data to reflect sequencer table updates to Notify */
+__xwrite unsigned int notify_seqr_gen;
+__shared __gpr unsigned int notify_seqr_gen_sent = 0;
+__shared __gpr unsigned int notify_seqr_ack_ts;
+
+__intrinsic void
+pci_in_msg_notify_seqr()
+{
+    if (pci_in_msg_notify_tbl(&notify_seqr_gen, seqr_tbl_gen,
+                              notify_seqr_gen_sent, NFD_IN_NOTIFY_SEQR_RD)) {
+        notify_seqr_gen_sent = seqr_tbl_gen;
+        notify_tbl_pend |= NOTIFY_TBL_SEQR | NOTIFY_TBL_SEQR_AGE;
+    }
+}
+#endif
+
+
+#ifdef NFD_IN_TXR_COAL
+/* Data to reflect TX.R coalescing table updates to Notify */
+__xwrite unsigned int notify_txr_coal_gen;
+__shared __gpr unsigned int notify_txr_coal_gen_sent = 0;
+
+__intrinsic void
+pci_in_msg_notify_txr_coal()
+{
+    if (pci_in_msg_notify_tbl(&notify_txr_coal_gen, txr_coal_gen,
+                              notify_txr_coal_gen_sent,
+                              NFD_IN_NOTIFY_TXR_COAL_RD)) {
+        notify_txr_coal_gen_sent = txr_coal_gen;
+        notify_tbl_pend |= NOTIFY_TBL_TXR_COAL;
+    }
 }
+#endif
+
+
+#if (defined(NFD_IN_SEQR_TBL) || defined(NFD_IN_TXR_COAL))
+/* Test whether a held configuration message may be passed on.  Notify
+ * must have loaded every table the message changed.  Application copies
+ * of the sequencer table must also have had NFD_IN_SEQR_CACHE_TICKS to
+ * expire, and a queue that went down must have had its pending TX.R
+ * count discarded before the host can bring it up again. */
+__intrinsic int
+pci_in_msg_notify_done()
+{
+#ifdef NFD_IN_SEQR_TBL
+    if (notify_tbl_pend & NOTIFY_TBL_SEQR) {
+        if (!pci_in_msg_notify_tbl_acked(
+                ((__mem40 char *) NFD_IN_SEQR_TBL_LINK(PCIE_ISL) +
+                 NFD_IN_SEQR_TBL_ACK), notify_seqr_gen_sent)) {
+            return 0;
+        }
+        notify_tbl_pend &= ~NOTIFY_TBL_SEQR;
+        notify_seqr_ack_ts = local_csr_read(local_csr_timestamp_low);
+    }
+
+    if (notify_tbl_pend & NOTIFY_TBL_SEQR_AGE) {
+        if ((local_csr_read(local_csr_timestamp_low) - notify_seqr_ack_ts) <
+            NFD_IN_SEQR_CACHE_TICKS) {
+            return 0;
+        }
+        notify_tbl_pend &= ~NOTIFY_TBL_SEQR_AGE;
+    }
+#endif
+
+#ifdef NFD_IN_TXR_COAL
+    if (notify_tbl_pend & NOTIFY_TBL_TXR_COAL) {
+        if (!pci_in_msg_notify_tbl_acked(
+                (NFD_IN_TXR_COAL_LINK(PCIE_ISL) + NFD_IN_TXR_COAL_ACK),
+                notify_txr_coal_gen_sent)) {
+            return 0;
+        }
+#ifdef NFD_IN_NOTIFY_ME1
+        if (!pci_in_msg_notify_tbl_acked(
+                (NFD_IN_TXR_COAL_LINK(PCIE_ISL) + NFD_IN_TXR_COAL_ACK + 1),
+                notify_txr_coal_gen_sent)) {
+            return 0;
+        }
+#endif
+        notify_tbl_pend &= ~NOTIFY_TBL_TXR_COAL;
+    }
+#endif
+
+    return 1;
+}
+
+#define PCI_IN_CFG_MSG_HELD notify_tbl_pend
+#else
+#define PCI_IN_CFG_MSG_HELD 0
+#endif
 
 
 /* Helper defines for CTX1 state table */
@@ -127,6 +282,9 @@ main(void)
         /* Initialisation that swaps and takes longer */
         service_qc_setup();
         distr_gather_setup_shared();
+#ifdef NFD_IN_SEQR_TBL
+        gather_seqr_tbl_setup();
+#endif
         nfd_cfg_setup();
 
         /* TEMP: Mark initialisation complete */
@@ -184,6 +342,15 @@ main(void)
 
             /* Either check for a message, or perform one tick of processing
              * on the message each loop iteration */
+#if (defined(NFD_IN_SEQR_TBL) || defined(NFD_IN_TXR_COAL))
+            if (PCI_IN_CFG_MSG_HELD) {
+                /* Pass on the message once notify uses the new tables */
+                if (pci_in_msg_notify_done()) {
+                    nfd_cfg_start_cfg_msg(&cfg_msg,
+                                          NFD_CFG_RING_NUM(PCIE_ISL, 0));
+                }
+            } else
+#endif
             if (!cfg_msg.msg_valid) {
                 int curr_vid;
 
@@ -223,8 +390,19 @@ main(void)
                         }
                     }
 
-                    nfd_cfg_start_cfg_msg(&cfg_msg,
-                                          NFD_CFG_RING_NUM(PCIE_ISL, 0));
+#ifdef NFD_IN_SEQR_TBL
+                    /* Tell notify to reload the sequencer table */
+                    pci_in_msg_notify_seqr();
+#endif
+#ifdef NFD_IN_TXR_COAL
+                    /* Tell notify to reload the TX.R coalescing table */
+                    pci_in_msg_notify_txr_coal();
+#endif
+
+                    if (!PCI_IN_CFG_MSG_HELD) {
+                        nfd_cfg_start_cfg_msg(&cfg_msg,
+                                              NFD_CFG_RING_NUM(PCIE_ISL, 0));
+                    }
                 }
             }
 
@@ -79,12 +79,33 @@ extern __intrinsic uint64_t swapw64(uint64_t val);
 #endif
 
 
+/* Pick the input ring of this ME, NFD_OUT_RING_IDX folds at compile time */
+#if (NFD_OUT_RINGS == 1)
+#define NFD_OUT_RING_NUM(_isl)                                          \
+    NFD_RING_LINK(_isl, nfd_out, 0)
+#elif (NFD_OUT_RINGS == 2)
+#define NFD_OUT_RING_NUM(_isl)                                          \
+    ((NFD_OUT_RING_IDX == 0) ? NFD_RING_LINK(_isl, nfd_out, 0) :        \
+     NFD_RING_LINK(_isl, nfd_out, 1))
+#elif (NFD_OUT_RINGS == 3)
+#define NFD_OUT_RING_NUM(_isl)                                          \
+    ((NFD_OUT_RING_IDX == 0) ? NFD_RING_LINK(_isl, nfd_out, 0) :        \
+     (NFD_OUT_RING_IDX == 1) ? NFD_RING_LINK(_isl, nfd_out, 1) :        \
+     NFD_RING_LINK(_isl, nfd_out, 2))
+#else
+#define NFD_OUT_RING_NUM(_isl)                                          \
+    ((NFD_OUT_RING_IDX == 0) ? NFD_RING_LINK(_isl, nfd_out, 0) :        \
+     (NFD_OUT_RING_IDX == 1) ? NFD_RING_LINK(_isl, nfd_out, 1) :        \
+     (NFD_OUT_RING_IDX == 2) ? NFD_RING_LINK(_isl, nfd_out, 2) :        \
+     NFD_RING_LINK(_isl, nfd_out, 3))
+#endif
+
 #define NFD_OUT_RING_LINK(_isl)                                         \
 do {                                                                    \
     nfd_out_ring_info[_isl].addr_hi =                                   \
         ((unsigned long long) NFD_EMEM_LINK(_isl) >> 32);               \
     nfd_out_ring_info[_isl].sp0 = 0;                                    \
-    nfd_out_ring_info[_isl].rnum = NFD_RING_LINK(_isl, nfd_out, 0);     \
+    nfd_out_ring_info[_isl].rnum = NFD_OUT_RING_NUM(_isl);              \
 } while(0)
 
 __shared __lmem struct nfd_ring_info nfd_out_ring_info[NFD_MAX_ISL];
@@ -170,6 +191,184 @@ nfd_out_get_credit(unsigned int pcie_isl, unsigned int bmsk_queue,
 }
 
 
+#ifdef NFD_OUT_CREDIT_RSV
+__intrinsic void
+nfd_out_credit_rsv_init(struct nfd_out_credit_rsv *rsv)
+{
+    rsv->credits = 0;
+    rsv->gen = 0;
+    rsv->ts = 0;
+    rsv->chk = 0;
+}
+
+
+/*
+ * Reserved credits are spent without a memory access for up to
+ * NFD_OUT_CREDIT_RSV_CHECK after the queue generation was last read.
+ * PCI.OUT ME0 holds the completion of a configuration message that
+ * advances the generation for as long, so stale credits can only be spent
+ * while the queue is still down.  When the reservation runs dry, the
+ * generation is read alongside the credits.  If the queue is reset between
+ * the two reads, the reservation records the older generation and its
+ * credits are discarded rather than returned, which can leak credits but
+ * never hands out credits the queue does not have.
+ */
+__intrinsic unsigned int
+nfd_out_credit_rsv_get(unsigned int pcie_isl, unsigned int bmsk_queue,
+                       struct nfd_out_credit_rsv *rsv, unsigned int num)
+{
+    __xrw unsigned int data;
+    __xread unsigned int gen;
+    SIGNAL_PAIR credit_sig;
+    SIGNAL gen_sig;
+    unsigned int addr_hi;
+    unsigned int addr_lo;
+    unsigned int got;
+    unsigned int now;
+
+    try_ctassert(num <= NFD_OUT_CREDIT_RSV_BLK);
+
+    addr_hi = (0x84 | pcie_isl) << 24;
+    addr_lo = (bmsk_queue * NFD_OUT_ATOMICS_SZ) | NFD_OUT_ATOMICS_GEN;
+    now = local_csr_read(local_csr_timestamp_low);
+
+    if (rsv->credits >= num) {
+        if ((now - rsv->chk) < NFD_OUT_CREDIT_RSV_CHECK) {
+            goto take;
+        }
+
+        __asm mem[atomic_read, gen, addr_hi, <<8, addr_lo, 1], \
+            ctx_swap[gen_sig];
+        rsv->chk = now;
+
+        if (gen == rsv->gen) {
+            goto take;
+        }
+
+        /* The queue was reset, refill under the new generation */
+        rsv->credits = 0;
+    }
+
+    __asm mem[atomic_read, gen, addr_hi, <<8, addr_lo, 1], \
+        sig_done[gen_sig];
+    __nfd_out_get_credit(pcie_isl, bmsk_queue, NFD_OUT_CREDIT_RSV_BLK,
+                         &data, sig_done, &credit_sig);
+    wait_for_all(&gen_sig, &credit_sig);
+    rsv->chk = now;
+
+    if (gen != rsv->gen) {
+        /* The queue was reset, the old credits are void */
+        rsv->credits = 0;
+        rsv->gen = gen;
+    }
+
+    /* test_subsat returns the credits before the subtract */
+    got = data;
+    if (got > NFD_OUT_CREDIT_RSV_BLK) {
+        got = NFD_OUT_CREDIT_RSV_BLK;
+    }
+    rsv->credits += got;
+
+    if (rsv->credits < num) {
+        return 0;
+    }
+
+take:
+    rsv->credits -= num;
+    rsv->ts = now;
+
+    return num;
+}
+
+
+/*
+ * Credits are not added straight back to NFD_OUT_ATOMICS_CREDIT, as a
+ * queue reset between the generation check and the add would carry them
+ * over to the new generation.  Instead they are added to the return slot
+ * for the reservation's generation.  PCI.OUT ME0 clears the slot of a new
+ * generation when it resets the queue, and only moves the slot of the
+ * current generation to the credits, so an add that lands after a reset
+ * is discarded.  The generation check beforehand stops a reservation held
+ * across two resets from reaching the slot again once it is reused.
+ */
+__intrinsic void
+nfd_out_credit_rsv_release(unsigned int pcie_isl, unsigned int bmsk_queue,
+                           struct nfd_out_credit_rsv *rsv)
+{
+    __xread unsigned int gen;
+    __xwrite unsigned int data;
+    SIGNAL sig;
+    unsigned int addr_hi;
+    unsigned int addr_lo;
+
+    if (rsv->credits == 0) {
+        return;
+    }
+
+    addr_hi = (0x84 | pcie_isl) << 24;
+    addr_lo = (bmsk_queue * NFD_OUT_ATOMICS_SZ) | NFD_OUT_ATOMICS_GEN;
+
+    __asm mem[atomic_read, gen, addr_hi, <<8, addr_lo, 1], ctx_swap[sig];
+
+    if (gen == rsv->gen) {
+        data = rsv->credits;
+        addr_lo = (NFD_OUT_CREDIT_RET_BASE +
+                   (bmsk_queue << NFD_OUT_CREDIT_RET_SZ_LG2) +
+                   ((rsv->gen & 1) << 2));
+        __asm mem[add, data, addr_hi, <<8, addr_lo, 1], ctx_swap[sig];
+    }
+
+    rsv->credits = 0;
+}
+
+
+__intrinsic void
+nfd_out_credit_rsv_expire(unsigned int pcie_isl, unsigned int bmsk_queue,
+                          struct nfd_out_credit_rsv *rsv)
+{
+    unsigned int idle;
+
+    if (rsv->credits != 0) {
+        idle = local_csr_read(local_csr_timestamp_low) - rsv->ts;
+        if (idle > NFD_OUT_CREDIT_RSV_TIMEOUT) {
+            nfd_out_credit_rsv_release(pcie_isl, bmsk_queue, rsv);
+        }
+    }
+}
+#endif
+
+
+__intrinsic unsigned int
+nfd_out_starve_drop(unsigned int pcie_isl, unsigned int bmsk_queue)
+{
+#ifdef NFD_OUT_FL_STARVE_DROP
+    __xread unsigned int flag;
+    SIGNAL sig;
+    unsigned int addr_hi;
+    unsigned int addr_lo;
+
+    addr_hi = (0x84 | pcie_isl) << 24;
+    addr_lo = (NFD_OUT_STARVE_BASE + bmsk_queue * NFD_OUT_STARVE_SZ +
+               NFD_OUT_STARVE_FLAG);
+
+    __asm mem[atomic_read, flag, addr_hi, <<8, addr_lo, 1], ctx_swap[sig];
+
+    if (flag == 0) {
+        return 0;
+    }
+
+    /* PCI.OUT adds the drops to the CFG BAR */
+    addr_lo = (NFD_OUT_STARVE_BASE + bmsk_queue * NFD_OUT_STARVE_SZ +
+               NFD_OUT_STARVE_DROPS);
+    __asm mem[incr, --, addr_hi, <<8, addr_lo];
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
 __intrinsic void
 __nfd_out_cnt_pkt(unsigned int pcie_isl, unsigned int bmsk_queue,
                   unsigned int byte_count, sync_t sync, SIGNAL *sig)
@@ -326,6 +525,34 @@ nfd_out_check_ctm_only(__gpr struct nfd_out_input *desc)
 }
 
 
+#ifdef NFD_OUT_RX_SCATTER
+__intrinsic void
+nfd_out_scatter_desc(__gpr struct nfd_out_input *seg,
+                     __gpr struct nfd_out_input *desc,
+                     unsigned int seg_off, unsigned int seg_len)
+{
+    unsigned int start;
+    unsigned int ctm_bytes;
+
+    /* pci_out_sb works out where each segment starts from the lengths
+     * of the segments before it, so only the lengths change */
+    *seg = *desc;
+    seg->rxd.data_len = seg_len;
+    if (seg_off != 0)
+        seg->rxd.meta_len = 0;
+    seg->cpp.more = (seg_off + seg_len < desc->rxd.data_len);
+
+    seg->cpp.ctm_only = 0;
+    if (desc->cpp.isl != 0) {
+        start = desc->cpp.offset + seg_off;
+        ctm_bytes = 256 << desc->cpp.split;
+        if (ctm_bytes >= start + seg_len)
+            seg->cpp.ctm_only = 1;
+    }
+}
+#endif
+
+
 __intrinsic void
 nfd_out_dummy_vlan(__gpr struct nfd_out_input *desc, unsigned int vlan,
                    unsigned int flags)
@@ -355,7 +582,13 @@ __nfd_out_send(unsigned int pcie_isl, unsigned int bmsk_queue,
     /* Complete the basic descriptor */
     desc->rxd.dd = 1;
     desc->rxd.queue = bmsk_queue;
-    desc->cpp.reserved = 0;
+#ifdef NFD_OUT_RX_SCATTER
+    if (desc->cpp.more)
+        desc->rxd.flags &= ~PCIE_DESC_RX_EOP;
+    else
+        desc->rxd.flags |= PCIE_DESC_RX_EOP;
+#endif
+    desc->cpp.more = 0;
     *desc_out = *desc;
 
     __mem_workq_add_work(rnum, raddr, desc_out, desc_sz, desc_sz,
@@ -373,3 +606,55 @@ nfd_out_send(unsigned int pcie_isl, unsigned int bmsk_queue,
     __nfd_out_send(pcie_isl, bmsk_queue, &data, desc, sig_done, &sig);
     wait_for_all(&sig);
 }
+
+
+__intrinsic void
+__nfd_out_send_burst(unsigned int pcie_isl,
+                     __xwrite struct nfd_out_input *desc_out,
+                     __gpr struct nfd_out_input *desc,
+                     const unsigned int num, sync_t sync, SIGNAL *sig)
+{
+    unsigned int desc_sz = sizeof(struct nfd_out_input);
+    mem_ring_addr_t raddr;
+    unsigned int rnum;
+    unsigned int i;
+
+    ctassert(__is_ct_const(num));
+    ctassert(num >= 1 && num <= NFD_OUT_SEND_BURST_MAX);
+    ctassert(__is_ct_const(sync));
+    ctassert(sync == sig_done);
+    try_ctassert(pcie_isl < NFD_MAX_ISL);
+
+    raddr = nfd_out_ring_info[pcie_isl].addr_hi << 24;
+    rnum = nfd_out_ring_info[pcie_isl].rnum;
+
+    /* Complete the basic descriptors, the queues are set by the caller */
+    for (i = 0; i < num; i++) {
+        desc[i].rxd.dd = 1;
+#ifdef NFD_OUT_RX_SCATTER
+        if (desc[i].cpp.more)
+            desc[i].rxd.flags &= ~PCIE_DESC_RX_EOP;
+        else
+            desc[i].rxd.flags |= PCIE_DESC_RX_EOP;
+#endif
+        desc[i].cpp.more = 0;
+        desc_out[i] = desc[i];
+    }
+
+    /* The ring holds words, so one "add_work" of several descriptors is
+     * seen by pci_out_sb as that many separate descriptors */
+    __mem_workq_add_work(rnum, raddr, desc_out, num * desc_sz,
+                         NFD_OUT_SEND_BURST_MAX * desc_sz, sig_done, sig);
+}
+
+
+__intrinsic void
+nfd_out_send_burst(unsigned int pcie_isl, __gpr struct nfd_out_input *desc,
+                   const unsigned int num)
+{
+    __xwrite struct nfd_out_input data[NFD_OUT_SEND_BURST_MAX];
+    SIGNAL sig;
+
+    __nfd_out_send_burst(pcie_isl, data, desc, num, sig_done, &sig);
+    wait_for_all(&sig);
+}
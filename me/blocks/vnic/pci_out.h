@@ -63,6 +63,10 @@ struct nfd_out_rx_desc {
  *
  * Packets that are contained entirely in CTM must be flagged for fastpath
  * processing by setting "ctm_only".
+ *
+ * "more" is only set on segments of a packet scattered over several FL
+ * buffers (see nfd_out_scatter_desc()) and is cleared when the
+ * descriptor is sent.
  */
 struct nfd_out_cpp_desc {
     union {
@@ -71,7 +75,7 @@ struct nfd_out_cpp_desc {
             unsigned int ctm_only:1;    /**< 1 if packet is entirely in CTM */
             unsigned int pktnum:9;      /**< CTM packet number */
             unsigned int split:2;       /**< CTM buffer size of the pkt */
-            unsigned int reserved:1;    /**< Must be zero from application */
+            unsigned int more:1;        /**< Set by nfd_out_scatter_desc() */
             unsigned int offset:13;     /**< Offset where data starts in NFP */
 
             unsigned int nbi:1;         /**< NBI that received the pkt */
@@ -101,6 +105,27 @@ struct nfd_out_input {
 #define NFD_OUT_ATOMICS_CREDIT      0
 #define NFD_OUT_ATOMICS_SENT        4
 #define NFD_OUT_ATOMICS_DMA_DONE    8
+#define NFD_OUT_ATOMICS_GEN         12
+
+/*
+ * Format of the PCI.OUT FL starvation state, see NFD_OUT_FL_STARVE_DROP.
+ * It follows the atomics in the CTM of the PCIe island.
+ */
+#define NFD_OUT_STARVE_BASE         1024
+#define NFD_OUT_STARVE_SZ           8
+#define NFD_OUT_STARVE_SZ_LG2       3
+#define NFD_OUT_STARVE_FLAG         0
+#define NFD_OUT_STARVE_DROPS        4
+
+/*
+ * Format of the PCI.OUT credit return slots, see nfd_out_credit_rsv_release().
+ * It follows the FL starvation state.  Each queue has one slot per parity
+ * of NFD_OUT_ATOMICS_GEN, and PCI.OUT only adds the slot of the current
+ * generation back to the credits.
+ */
+#define NFD_OUT_CREDIT_RET_BASE     1536
+#define NFD_OUT_CREDIT_RET_SZ       8
+#define NFD_OUT_CREDIT_RET_SZ_LG2   3
 /** \endcond */
 
 
@@ -116,9 +141,42 @@ struct nfd_out_input {
 
 /** \cond DOXYGEN_SHOULD_SKIP_THIS */
 
-#define NFD_OUT_RINGS_DECL_IND2(_isl, _emem)                            \
-    _NFP_CHIPRES_ASM(.alloc_resource nfd_out_ring_num##_isl##0          \
+#ifndef NFD_OUT_RINGS
+#define NFD_OUT_RINGS 1
+#endif
+
+#if (NFD_OUT_RINGS < 1 || NFD_OUT_RINGS > 4)
+#error "NFD_OUT_RINGS must be from 1 to 4"
+#endif
+
+/* Input ring of this ME on each PCIe island, see nfd_out_send_init() */
+#ifndef NFD_OUT_RING_IDX
+#define NFD_OUT_RING_IDX (__ISLAND % NFD_OUT_RINGS)
+#endif
+
+#define NFD_OUT_RING_DECL_IND(_isl, _emem, _num)                        \
+    _NFP_CHIPRES_ASM(.alloc_resource nfd_out_ring_num##_isl##_num       \
                      _emem##_queues global 1 1)
+
+#if (NFD_OUT_RINGS == 1)
+#define NFD_OUT_RINGS_DECL_IND2(_isl, _emem)                            \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 0)
+#elif (NFD_OUT_RINGS == 2)
+#define NFD_OUT_RINGS_DECL_IND2(_isl, _emem)                            \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 0);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 1)
+#elif (NFD_OUT_RINGS == 3)
+#define NFD_OUT_RINGS_DECL_IND2(_isl, _emem)                            \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 0);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 1);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 2)
+#else
+#define NFD_OUT_RINGS_DECL_IND2(_isl, _emem)                            \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 0);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 1);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 2);                              \
+    NFD_OUT_RING_DECL_IND(_isl, _emem, 3)
+#endif
 #define NFD_OUT_RINGS_DECL_IND1(_isl, _emem)    \
     NFD_OUT_RINGS_DECL_IND2(_isl, _emem)
 #define NFD_OUT_RINGS_DECL_IND0(_isl)           \
@@ -162,6 +220,37 @@ struct nfd_out_input {
 #define NFD_OUT_MAX_META_ITEM_LEN 4
 #endif
 
+#ifdef NFD_OUT_CREDIT_RSV
+/* Credits taken from the queue each time a credit reservation runs dry */
+#ifndef NFD_OUT_CREDIT_RSV_BLK
+#define NFD_OUT_CREDIT_RSV_BLK 32
+#endif
+
+/* Timestamp ticks (16 ME cycles) a credit reservation may sit unused
+ * before nfd_out_credit_rsv_expire() returns it to the queue */
+#ifndef NFD_OUT_CREDIT_RSV_TIMEOUT
+#define NFD_OUT_CREDIT_RSV_TIMEOUT 4096
+#endif
+
+/* Timestamp ticks (16 ME cycles) a credit reservation may be spent without
+ * checking the queue generation.  PCI.OUT holds back the completion of a
+ * configuration message that resets a queue for this long. */
+#ifndef NFD_OUT_CREDIT_RSV_CHECK
+#define NFD_OUT_CREDIT_RSV_CHECK 256
+#endif
+
+
+/**
+ * Credits reserved by a thread for a single queue
+ */
+struct nfd_out_credit_rsv {
+    unsigned int credits;       /**< Reserved credits not yet spent */
+    unsigned int gen;           /**< Queue generation the credits are from */
+    unsigned int ts;            /**< Timestamp of the last credit taken */
+    unsigned int chk;           /**< Timestamp of the last generation check */
+};
+#endif
+
 
 /**
  * Prepare ME data structures required to send packets to NFD.
@@ -222,6 +311,87 @@ __intrinsic unsigned int nfd_out_get_credit(unsigned int pcie_isl,
                                             unsigned int num);
 
 
+#ifdef NFD_OUT_CREDIT_RSV
+/**
+ * Clear a credit reservation before first use.
+ * @param rsv           Credit reservation
+ */
+__intrinsic void nfd_out_credit_rsv_init(struct nfd_out_credit_rsv *rsv);
+
+/**
+ * Take credits from a per thread reservation.
+ * @param pcie_isl      PCIe island
+ * @param queue         Queue the reservation is for
+ * @param rsv           Credit reservation
+ * @param num           Number of credits required, at most
+ *                      NFD_OUT_CREDIT_RSV_BLK
+ * @return              "num" if the credits were taken, else 0
+ *
+ * If the reservation holds fewer than "num" credits, a block of up to
+ * NFD_OUT_CREDIT_RSV_BLK credits is taken from the queue with a single
+ * atomic.  Credits are only taken from the reservation if all "num" are
+ * available, otherwise they stay reserved for a later attempt.
+ *
+ * The queue generation is read when the reservation is refilled, and at
+ * most every NFD_OUT_CREDIT_RSV_CHECK otherwise, so most calls take
+ * credits without any memory access.  Credits reserved before the queue
+ * was reconfigured or downed are discarded at the next check, which
+ * PCI.OUT makes before the host can bring the queue back up.
+ *
+ * A reservation is tied to one queue.  Release it with
+ * nfd_out_credit_rsv_release() before using it for a different queue.
+ */
+__intrinsic unsigned int nfd_out_credit_rsv_get(
+    unsigned int pcie_isl, unsigned int queue,
+    struct nfd_out_credit_rsv *rsv, unsigned int num);
+
+/**
+ * Return unspent reserved credits to the queue.
+ * @param pcie_isl      PCIe island
+ * @param queue         Queue the reservation is for
+ * @param rsv           Credit reservation
+ *
+ * The credits are only returned if the queue has not been reconfigured
+ * or downed since they were reserved.  PCI.OUT adds them back to the
+ * queue within NFD_OUT_CREDIT_RSV_TIMEOUT.  The reservation is empty
+ * after this call.
+ */
+__intrinsic void nfd_out_credit_rsv_release(unsigned int pcie_isl,
+                                            unsigned int queue,
+                                            struct nfd_out_credit_rsv *rsv);
+
+/**
+ * Return reserved credits that have not been used for
+ * NFD_OUT_CREDIT_RSV_TIMEOUT.
+ * @param pcie_isl      PCIe island
+ * @param queue         Queue the reservation is for
+ * @param rsv           Credit reservation
+ *
+ * Call this when a thread is idle so that credits do not sit unused in
+ * a reservation while other threads need them.
+ */
+__intrinsic void nfd_out_credit_rsv_expire(unsigned int pcie_isl,
+                                           unsigned int queue,
+                                           struct nfd_out_credit_rsv *rsv);
+#endif
+
+/**
+ * Check whether a packet that found no credits should be dropped.
+ * @param pcie_isl      PCIe island
+ * @param queue         Queue that had no credits
+ * @return              1 if the packet must be dropped, else 0
+ *
+ * With NFD_OUT_FL_STARVE_DROP, PCI.OUT flags a queue once the host has
+ * left it without FL buffers for NFD_OUT_FL_STARVE_TICKS.  Call this when
+ * nfd_out_get_credit() or nfd_out_credit_rsv_get() fails.  If the queue is
+ * flagged, the drop is counted for NFP_NET_CFG_RXR_STARVE_DROPS and the
+ * caller must free the packet rather than hold it waiting for credits.
+ * Without NFD_OUT_FL_STARVE_DROP this always returns 0.
+ */
+__intrinsic unsigned int nfd_out_starve_drop(unsigned int pcie_isl,
+                                             unsigned int queue);
+
+
 /**
  * Packets and Bytes count for PCI.OUT queues.
  * @param pcie_isl      PCIe island
@@ -337,6 +507,36 @@ __intrinsic void nfd_out_fill_desc(__gpr struct nfd_out_input *desc,
 __intrinsic void nfd_out_check_ctm_only(__gpr struct nfd_out_input *desc);
 
 
+#ifdef NFD_OUT_RX_SCATTER
+/**
+ * Number of FL buffers, and so credits, needed to send a packet of
+ * "_data_len" bytes (metadata included) in segments of "_seg_len" bytes.
+ */
+#define NFD_OUT_SCATTER_SEGS(_data_len, _seg_len)                       \
+    (((_data_len) + (_seg_len) - 1) / (_seg_len))
+
+/**
+ * Fill the descriptor for one segment of a packet scattered over several
+ * FL buffers.
+ * @param seg           Segment descriptor to fill
+ * @param desc          Descriptor for the whole packet
+ * @param seg_off       Offset of the segment in the packet data
+ * @param seg_len       Length of the segment
+ *
+ * "desc" must be complete, as if for nfd_out_send(), and "seg_off" and
+ * "seg_len" count the prepended metadata as packet data.  Segments must
+ * be sent in order and back to back for a queue, for example with
+ * nfd_out_send_burst(), and PCI.OUT flags the last one with
+ * PCIE_DESC_RX_EOP.  Segments may start at most 64KB into the packet
+ * buffers, and each must fit the FL buffers of the queue.
+ */
+__intrinsic void nfd_out_scatter_desc(__gpr struct nfd_out_input *seg,
+                                      __gpr struct nfd_out_input *desc,
+                                      unsigned int seg_off,
+                                      unsigned int seg_len);
+#endif
+
+
 /**
  * Fill the VLAN and flag parameters in the PCI.OUT descriptor.
  *
@@ -374,6 +574,46 @@ __intrinsic void __nfd_out_send(unsigned int pcie_isl, unsigned int queue,
 __intrinsic void nfd_out_send(unsigned int pcie_isl, unsigned int queue,
                               __gpr struct nfd_out_input *desc);
 
+
+/**
+ * Maximum number of descriptors sent by nfd_out_send_burst().  A single
+ * ring command can add at most 16 words of work.
+ */
+#define NFD_OUT_SEND_BURST_MAX  4
+
+/**
+ * Add several descriptors to the PCI.OUT ring with a single command.
+ * @param pcie_isl      PCIe island
+ * @param desc_out      Write transfer registers to hold "num" descriptors
+ * @param desc          "num" RX descriptors for the packets
+ * @param num           Number of descriptors (compile time constant,
+ *                      1 to NFD_OUT_SEND_BURST_MAX)
+ * @param sync          Type of synchronisation to use
+ * @param sig           Signal on send completion
+ *
+ * Unlike __nfd_out_send(), the queue of each descriptor is taken from
+ * desc[i].rxd.queue, so the descriptors may be for different queues.
+ * The descriptors are added to the ring back to back, and PCI.OUT
+ * processes them exactly as if they had been sent one at a time.
+ */
+__intrinsic void __nfd_out_send_burst(unsigned int pcie_isl,
+                                      __xwrite struct nfd_out_input *desc_out,
+                                      __gpr struct nfd_out_input *desc,
+                                      const unsigned int num,
+                                      sync_t sync, SIGNAL *sig);
+
+
+/**
+ * Enqueue several descriptors to the PCI.OUT ring
+ * @param pcie_isl      PCIe island
+ * @param desc          "num" RX descriptors, with rxd.queue set
+ * @param num           Number of descriptors (compile time constant,
+ *                      1 to NFD_OUT_SEND_BURST_MAX)
+ */
+__intrinsic void nfd_out_send_burst(unsigned int pcie_isl,
+                                    __gpr struct nfd_out_input *desc,
+                                    const unsigned int num);
+
 #endif /* __NFP_LANG_MICROC */
 
 #endif /* !_BLOCKS__VNIC_PCI_OUT_H_ */
@@ -28,6 +28,8 @@
 #include <nfp_chipres.h>
 
 #include <nfp/me.h>
+#include <nfp/mem_atomic.h>
+#include <nfp/mem_bulk.h>
 #include <nfp/pcie.h>
 #include <std/event.h>
 
@@ -51,10 +53,6 @@
 #error "Only one NFD credit type may be specified"
 #endif
 
-#ifdef NFD_OUT_CREDITS_HOST_ISSUED
-#warning "NFD_OUT_CREDITS_HOST_ISSUED selected, use at own risk!"
-#endif
-
 
 #define NFD_OUT_FL_SZ_PER_QUEUE   \
     (NFD_OUT_FL_BUFS_PER_QUEUE * sizeof(struct nfd_out_fl_desc))
@@ -102,7 +100,111 @@ __shared __lmem unsigned int fl_cache_pending[NFD_OUT_FL_MAX_IN_FLIGHT];
 NFD_ATOMICS_ALLOC(PCIE_ISL, NFD_OUT_CREDITS_BASE);
 
 
+#ifdef NFD_OUT_CREDIT_RSV
+/*
+ * Credits released from reservations are returned through slots fixed in
+ * CTM after the FL starvation state, see nfd_out_credit_rsv_release().
+ * cache_desc_credit_ret() moves them to the credits of each up queue in
+ * turn, taking NFD_OUT_CREDIT_RSV_TIMEOUT to visit all queues.
+ */
+#if (NFD_OUT_CREDIT_RET_BASE < \
+     (NFD_OUT_STARVE_BASE + NFD_OUT_MAX_QUEUES * NFD_OUT_STARVE_SZ))
+#error "NFD_OUT_CREDIT_RET_BASE overlaps the PCI.OUT FL starvation state"
+#endif
+
+#define CREDIT_RET_ALLOC_IND(_isl, _off)                                  \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_out_credit_ret##_isl pcie##_isl##.ctm+##_off \
+                     global (NFD_OUT_CREDIT_RET_SZ * NFD_OUT_MAX_QUEUES))
+#define CREDIT_RET_ALLOC(_isl, _off) CREDIT_RET_ALLOC_IND(_isl, _off)
+
+CREDIT_RET_ALLOC(PCIE_ISL, NFD_OUT_CREDIT_RET_BASE);
+
+#define CREDIT_RET_MEM_IND(_isl)                                        \
+    ((__mem40 unsigned int *) _link_sym(nfd_out_credit_ret##_isl))
+#define CREDIT_RET_MEM(_isl) CREDIT_RET_MEM_IND(_isl)
+
+static __gpr unsigned int credit_ret_ts;
+static __gpr unsigned int credit_ret_q;
+
+/* Reservations may spend credits for NFD_OUT_CREDIT_RSV_CHECK without
+ * reading the generation, so ME0 holds the configuration message that
+ * advanced it for that long, see cache_desc_credit_gen_done(). */
+static __gpr unsigned int credit_gen_pend;
+static __gpr unsigned int credit_gen_ts;
+#endif
+
+#define ATOMICS_MEM_IND(_isl)                                           \
+    ((__mem40 unsigned int *) _link_sym(nfd_out_atomics##_isl))
+#define ATOMICS_MEM(_isl) ATOMICS_MEM_IND(_isl)
+
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+/*
+ * The FL starvation state is fixed in CTM after the atomics, so that apps
+ * can reach it the same way as the credits.  Each queue has a flag that
+ * cache_desc_starve() sets while the queue is starved, and a count of the
+ * packets apps dropped for it that is yet to reach the CFG BAR.
+ */
+#if (NFD_OUT_STARVE_BASE < \
+     (NFD_OUT_CREDITS_BASE + NFD_OUT_MAX_QUEUES * NFD_OUT_ATOMICS_SZ))
+#error "NFD_OUT_STARVE_BASE overlaps the PCI.OUT atomics"
+#endif
+
+#define FL_STARVE_ALLOC_IND(_isl, _off)                                  \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_out_starve##_isl pcie##_isl##.ctm+##_off \
+                     global (NFD_OUT_STARVE_SZ * NFD_OUT_MAX_QUEUES))
+#define FL_STARVE_ALLOC(_isl, _off) FL_STARVE_ALLOC_IND(_isl, _off)
+
+FL_STARVE_ALLOC(PCIE_ISL, NFD_OUT_STARVE_BASE);
+
+#define FL_STARVE_MEM_IND(_isl)                                 \
+    ((__mem40 unsigned int *) _link_sym(nfd_out_starve##_isl))
+#define FL_STARVE_MEM(_isl) FL_STARVE_MEM_IND(_isl)
+
+/* Checks in a row that find a queue starved before it is flagged */
+#define FL_STARVE_CHECKS        4
+
+__shared __lmem struct nfd_out_fl_starve
+    nfd_out_fl_starve[NFD_OUT_MAX_QUEUES];
+
+static __gpr unsigned int fl_starve_ts;
+static __gpr unsigned int fl_starve_q;
+#endif
+
+
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+/*
+ * The FL cache is a pool of FL_CACHE_CHUNKS chunks of
+ * NFD_OUT_FL_CACHE_MIN_BUFS descriptors.  Each up queue holds a naturally
+ * aligned run of (1 << fl_cache_lg2) chunks starting at fl_cache_chunk.
+ */
+#define FL_CACHE_SIZE (NFD_OUT_FL_CACHE_POOL_BUFS * 8)
+#define FL_CACHE_CHUNKS                                         \
+    (NFD_OUT_FL_CACHE_POOL_BUFS / NFD_OUT_FL_CACHE_MIN_BUFS)
+#define FL_CACHE_CHUNK_SZ                                               \
+    (NFD_OUT_FL_CACHE_MIN_BUFS * sizeof(struct nfd_out_fl_desc))
+#define FL_CACHE_MAX_LG2                                                \
+    (__log2(NFD_OUT_FL_BUFS_PER_QUEUE / NFD_OUT_FL_CACHE_MIN_BUFS))
+#define FL_CACHE_DEPTH(_q)                                      \
+    (NFD_OUT_FL_CACHE_MIN_BUFS << queue_data[_q].fl_cache_lg2)
+
+#if ((NFD_OUT_FL_CACHE_POOL_BUFS & (NFD_OUT_FL_CACHE_POOL_BUFS - 1)) != 0)
+#error "NFD_OUT_FL_CACHE_POOL_BUFS must be a power of two"
+#endif
+
+#if (NFD_OUT_FL_CACHE_POOL_BUFS < \
+     (NFD_OUT_MAX_QUEUES * NFD_OUT_FL_CACHE_MIN_BUFS))
+#error "NFD_OUT_FL_CACHE_POOL_BUFS must hold every queue at minimum depth"
+#endif
+
+#if (FL_CACHE_CHUNKS < 32 || FL_CACHE_CHUNKS > 256)
+#error "NFD_OUT_FL_CACHE_POOL_BUFS must be 32 to 256 minimum depth chunks"
+#endif
+
+#else
 #define FL_CACHE_SIZE (NFD_OUT_MAX_QUEUES * NFD_OUT_FL_BUFS_PER_QUEUE * 8)
+#define FL_CACHE_DEPTH(_q) NFD_OUT_FL_BUFS_PER_QUEUE
+#endif
 
 #define FL_CACHE_MEM_ALLOC_IND2(_isl, _mem)             \
     _NFP_CHIPRES_ASM(.alloc_mem fl_cache_mem##_isl _mem \
@@ -123,6 +225,42 @@ FL_CACHE_MEM_ALLOC(PCIE_ISL);
 static __gpr unsigned int fl_cache_mem_addr_lo;
 
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+#define FL_CACHE_CFG_ALLOC_IND2(_isl, _emem)                            \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_out_fl_cache_cfg##_isl _emem global  \
+                     NFD_OUT_FL_CACHE_CFG_SZ 256);
+#define FL_CACHE_CFG_ALLOC_IND1(_isl, _emem) FL_CACHE_CFG_ALLOC_IND2(_isl, _emem)
+#define FL_CACHE_CFG_ALLOC_IND0(_isl)                           \
+    FL_CACHE_CFG_ALLOC_IND1(_isl, NFD_PCIE##_isl##_EMEM)
+#define FL_CACHE_CFG_ALLOC(_isl) FL_CACHE_CFG_ALLOC_IND0(_isl)
+
+FL_CACHE_CFG_ALLOC(PCIE_ISL);
+
+#define FL_CACHE_CFG_IND(_isl)                                  \
+    ((__mem40 unsigned int *) _link_sym(nfd_out_fl_cache_cfg##_isl))
+#define FL_CACHE_CFG(_isl) FL_CACHE_CFG_IND(_isl)
+
+/*
+ * Adaptive FL cache state, see cache_desc_adapt().  "fl_cache_used" has a
+ * bit per pool chunk and "fl_cache_batches" counts the FL batches fetched
+ * per queue since the queue was last checked.  One queue at a time may be
+ * resized, "fl_cache_resize_q" holds it plus one, or zero, and
+ * "fl_cache_resize_ts" when the resize started.
+ */
+__shared __lmem unsigned int fl_cache_used[FL_CACHE_CHUNKS / 32];
+__shared __lmem unsigned int fl_cache_batches[NFD_OUT_MAX_QUEUES];
+
+static __gpr unsigned int fl_cache_free;
+static __gpr unsigned int fl_cache_nup;
+static __gpr unsigned int fl_cache_adapt_ts;
+static __gpr unsigned int fl_cache_adapt_q;
+static __gpr unsigned int fl_cache_resize_q;
+static __gpr unsigned int fl_cache_resize_lg2;
+static __gpr unsigned int fl_cache_resize_ack;
+static __gpr unsigned int fl_cache_resize_ts;
+#endif
+
+
 /*
  * send_desc variables
  */
@@ -131,6 +269,66 @@ __shared __lmem struct nfd_out_send_desc_msg
 
 #ifdef NFD_OUT_USE_RX_BATCH_TGT
 __shared __lmem unsigned long long nfd_out_rx_ts[NFD_OUT_MAX_QUEUES];
+__shared __lmem struct nfd_out_rx_batch nfd_out_rx_batch[NFD_OUT_MAX_QUEUES];
+#endif
+
+#ifdef NFD_OUT_RX_CQ
+#define RX_CQ_MEM_ALLOC_IND2(_isl, _mem)                                \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_out_rx_cq##_isl _mem global         \
+                     NFD_OUT_RX_CQ_MEM_SZ 256);
+#define RX_CQ_MEM_ALLOC_IND1(_isl, _mem) RX_CQ_MEM_ALLOC_IND2(_isl, _mem)
+#define RX_CQ_MEM_ALLOC_IND0(_isl)                                  \
+    RX_CQ_MEM_ALLOC_IND1(_isl, NFD_PCIE##_isl##_FL_CACHE_MEM)
+#define RX_CQ_MEM_ALLOC(_isl) RX_CQ_MEM_ALLOC_IND0(_isl)
+
+RX_CQ_MEM_ALLOC(PCIE_ISL);
+
+#define RX_CQ_MEM_IND(_isl)                         \
+    ((__mem40 char *) _link_sym(nfd_out_rx_cq##_isl))
+#define RX_CQ_MEM(_isl) RX_CQ_MEM_IND(_isl)
+
+/* Each RX descriptor batch costs two DMAs when the queue posts to a CQ */
+#define RX_DESC_DMAS_PER_BATCH  2
+
+/*
+ * Completion queue of each queue, see _rx_cq_cfg().  Entries hold the ring
+ * number in the PCIE_DESC_RX_CQ_RING bits and the natural queue number of
+ * the CQ state plus one in the low byte, or zero if the queue does not
+ * post completions.
+ */
+__shared __lmem unsigned int nfd_out_rx_cq_map[NFD_OUT_MAX_QUEUES];
+
+static __gpr unsigned int rx_cq_mem_addr_lo;
+#elif defined(NFD_OUT_RX_WB)
+#define RX_WB_MEM_ALLOC_IND2(_isl, _mem)                                \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_out_rx_wb##_isl _mem global         \
+                     NFD_OUT_RX_WB_MEM_SZ 256);
+#define RX_WB_MEM_ALLOC_IND1(_isl, _mem) RX_WB_MEM_ALLOC_IND2(_isl, _mem)
+#define RX_WB_MEM_ALLOC_IND0(_isl)                                  \
+    RX_WB_MEM_ALLOC_IND1(_isl, NFD_PCIE##_isl##_FL_CACHE_MEM)
+#define RX_WB_MEM_ALLOC(_isl) RX_WB_MEM_ALLOC_IND0(_isl)
+
+RX_WB_MEM_ALLOC(PCIE_ISL);
+
+#define RX_WB_MEM_IND(_isl)                         \
+    ((__mem40 char *) _link_sym(nfd_out_rx_wb##_isl))
+#define RX_WB_MEM(_isl) RX_WB_MEM_IND(_isl)
+
+/* Each RX descriptor batch costs two DMAs when the queue writes back */
+#define RX_DESC_DMAS_PER_BATCH  2
+
+/*
+ * Write back state of each queue, see _rx_wb_cfg().  Entries hold
+ * RX_WB_MAP_EN and the high bits of the host write back address, or zero if
+ * the queue does not write back.  The low bits are in the RX_WB_MEM state.
+ */
+#define RX_WB_MAP_EN            (1 << 31)
+
+__shared __lmem unsigned int nfd_out_rx_wb_map[NFD_OUT_MAX_QUEUES];
+
+static __gpr unsigned int rx_wb_mem_addr_lo;
+#else
+#define RX_DESC_DMAS_PER_BATCH  1
 #endif
 
 __gpr unsigned int rx_desc_mem_addr_lo;
@@ -168,7 +366,7 @@ static __gpr struct nfp_pcie_dma_cmd descr_tmp;
 PCIE_DMA_ALLOC(nfd_out_fl_desc_dma, island, PCIE_ISL, frompci_hi,
                NFD_OUT_FL_MAX_IN_FLIGHT);
 PCIE_DMA_ALLOC(nfd_out_rx_desc_dma, island, PCIE_ISL, topci_med,
-               NFD_OUT_DESC_MAX_IN_FLIGHT);
+               NFD_OUT_DESC_MAX_IN_FLIGHT * RX_DESC_DMAS_PER_BATCH);
 
 
 /**
@@ -223,6 +421,72 @@ _zero_imm(unsigned int base, unsigned int queue, size_t size)
 }
 
 
+#ifdef NFD_OUT_FL_STARVE_DROP
+/**
+ * Clear the FL starvation state of a queue
+ * @param queue     Bitmask numbered queue
+ *
+ * Drops that apps counted but cache_desc_starve() has not yet added to the
+ * CFG BAR are discarded.
+ */
+__intrinsic void
+_fl_starve_reset(unsigned int queue)
+{
+    __xwrite unsigned int starve_xfer[2];
+
+    nfd_out_fl_starve[queue].fl_s = 0;
+    nfd_out_fl_starve[queue].spare = 0;
+    nfd_out_fl_starve[queue].starved = 0;
+    nfd_out_fl_starve[queue].checks = 0;
+
+    starve_xfer[0] = 0;
+    starve_xfer[1] = 0;
+    mem_write_atomic(starve_xfer, (FL_STARVE_MEM(PCIE_ISL) +
+                                   queue * (NFD_OUT_STARVE_SZ / 4)),
+                     sizeof starve_xfer);
+}
+#endif
+
+
+/**
+ * Advance the credit generation of a queue and open its return slot
+ * @param queue     Bitmask numbered queue
+ *
+ * With NFD_OUT_CREDIT_RSV, the slot of the new generation is cleared of
+ * credits released under the generation before last.  Credits released
+ * under the old generation land in the other slot, which
+ * cache_desc_credit_ret() no longer collects.
+ */
+__intrinsic void
+_credit_gen_next(unsigned int queue)
+{
+    __xrw unsigned int gen_xfer;
+#ifdef NFD_OUT_CREDIT_RSV
+    __xwrite unsigned int ret_xfer;
+    unsigned int gen;
+#endif
+
+    gen_xfer = 1;
+    mem_test_add(&gen_xfer, (ATOMICS_MEM(PCIE_ISL) +
+                             ((queue * NFD_OUT_ATOMICS_SZ +
+                               NFD_OUT_ATOMICS_GEN) / 4)),
+                 sizeof gen_xfer);
+
+#ifdef NFD_OUT_CREDIT_RSV
+    gen = gen_xfer + 1;
+
+    ret_xfer = 0;
+    mem_write_atomic(&ret_xfer, (CREDIT_RET_MEM(PCIE_ISL) +
+                                 queue * (NFD_OUT_CREDIT_RET_SZ / 4) +
+                                 (gen & 1)),
+                     sizeof ret_xfer);
+
+    credit_gen_pend = 1;
+    credit_gen_ts = local_csr_read(local_csr_timestamp_low);
+#endif
+}
+
+
 /**
  * Perform once off, CTX0-only initialisation of the FL descriptor cacher
  */
@@ -258,6 +522,66 @@ cache_desc_setup_shared()
     /* Initialise addresses of the FL cache and credits */
     fl_cache_mem_addr_lo =
         ((unsigned long long) FL_CACHE_MEM(PCIE_ISL) & 0xffffffff);
+
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+    {
+        unsigned int i;
+
+        for (i = 0; i < FL_CACHE_CHUNKS / 32; i++) {
+            fl_cache_used[i] = 0;
+        }
+    }
+    fl_cache_free = FL_CACHE_CHUNKS;
+    fl_cache_nup = 0;
+    fl_cache_adapt_ts = local_csr_read(local_csr_timestamp_low);
+    fl_cache_adapt_q = 0;
+    fl_cache_resize_q = 0;
+#endif
+
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_OUT_MAX_QUEUES; i++) {
+            _credit_gen_next(i);
+        }
+    }
+#ifdef NFD_OUT_CREDIT_RSV
+    credit_ret_ts = local_csr_read(local_csr_timestamp_low);
+    credit_ret_q = 0;
+    credit_gen_pend = 0;
+#endif
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_OUT_MAX_QUEUES; i++) {
+            _fl_starve_reset(i);
+        }
+    }
+    fl_starve_ts = local_csr_read(local_csr_timestamp_low);
+    fl_starve_q = 0;
+#endif
+
+#ifdef NFD_OUT_RX_CQ
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_OUT_MAX_QUEUES; i++) {
+            nfd_out_rx_cq_map[i] = 0;
+        }
+    }
+#endif
+
+#ifdef NFD_OUT_RX_WB
+    {
+        unsigned int i;
+
+        for (i = 0; i < NFD_OUT_MAX_QUEUES; i++) {
+            nfd_out_rx_wb_map[i] = 0;
+        }
+    }
+#endif
 }
 
 
@@ -275,6 +599,269 @@ cache_desc_setup()
 }
 
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+/**
+ * Allocate a naturally aligned run of FL cache chunks
+ * @param lg2       log2 of the run length in chunks
+ *
+ * Returns the first chunk of the run, or -1 if no run is free.  Runs are at
+ * most 16 chunks, so a run never spans two words of "fl_cache_used".
+ */
+__intrinsic int
+_fl_cache_alloc(unsigned int lg2)
+{
+    unsigned int run = 1 << lg2;
+    unsigned int msk = (1 << run) - 1;
+    unsigned int chunk;
+
+    for (chunk = 0; chunk < FL_CACHE_CHUNKS; chunk += run) {
+        if ((fl_cache_used[chunk / 32] & (msk << (chunk & 31))) == 0) {
+            fl_cache_used[chunk / 32] |= msk << (chunk & 31);
+            fl_cache_free -= run;
+            return chunk;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Free the FL cache region of a queue
+ * @param queue     Bitmask numbered queue
+ */
+__intrinsic void
+_fl_cache_free(unsigned int queue)
+{
+    unsigned int run = 1 << queue_data[queue].fl_cache_lg2;
+    unsigned int chunk = queue_data[queue].fl_cache_chunk;
+
+    fl_cache_used[chunk / 32] &= ~(((1 << run) - 1) << (chunk & 31));
+    fl_cache_free += run;
+}
+
+
+/**
+ * Place a queue in the FL cache and publish its region to stage_batch
+ * @param queue     Bitmask numbered queue
+ * @param lg2       Requested log2 of the region length in chunks
+ *
+ * The queue must have nothing cached, and must not hold a region.  If no
+ * run of the requested length is free, shorter runs are tried.  A single
+ * chunk is always free as long as growth leaves a chunk for each down
+ * queue, see cache_desc_adapt().
+ */
+__intrinsic void
+_fl_cache_place(unsigned int queue, unsigned int lg2)
+{
+    __xwrite unsigned int cfg;
+    int chunk;
+
+    for (;;) {
+        chunk = _fl_cache_alloc(lg2);
+        if (chunk >= 0 || lg2 == 0) {
+            break;
+        }
+        lg2--;
+    }
+
+    queue_data[queue].fl_cache_chunk = chunk;
+    queue_data[queue].fl_cache_lg2 = lg2;
+
+    cfg = (chunk * FL_CACHE_CHUNK_SZ) | (FL_CACHE_MAX_LG2 - lg2);
+    mem_write32(&cfg, FL_CACHE_CFG(PCIE_ISL) + queue, sizeof cfg);
+}
+#endif
+
+
+#ifdef NFD_OUT_USE_RX_BATCH_TGT
+/**
+ * Load the RX descriptor batch target of a queue from the CFG BAR
+ * @param vid       vNIC the queue belongs to
+ * @param ring      Ring number within the vNIC
+ * @param queue     Bitmask queue number of the queue
+ *
+ * NFP_NET_CFG_RXR_BATCH holds a byte per ring.  Zero selects the adaptive
+ * target, which starts from the current rate estimate.
+ */
+__intrinsic void
+_rx_batch_cfg(unsigned int vid, unsigned int ring, unsigned int queue)
+{
+    __xread unsigned int batch_xfer;
+    unsigned int cfg;
+    unsigned int tgt;
+
+    mem_read32_le(&batch_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                                NFP_NET_CFG_RXR_BATCH(ring & ~3)),
+                  sizeof batch_xfer);
+
+    cfg = (batch_xfer >> ((ring & 3) * 8)) & 0xff;
+    if (cfg > NFD_OUT_RX_DESC_REQ_BATCH) {
+        cfg = NFD_OUT_RX_DESC_REQ_BATCH;
+    }
+
+    tgt = cfg;
+    if (tgt == 0) {
+        tgt = (nfd_out_rx_batch[queue].rate + 8) >> 4;
+        if (tgt == 0) {
+            tgt = 1;
+        }
+    }
+
+    nfd_out_rx_batch[queue].cfg = cfg;
+    nfd_out_rx_batch[queue].tgt = tgt;
+}
+#endif
+
+
+#ifdef NFD_OUT_RX_CQ
+/**
+ * Attach a queue to the RX completion queue the CFG BAR selects for it
+ * @param vid       vNIC the queue belongs to
+ * @param ring      Ring number within the vNIC
+ * @param queue     Bitmask queue number of the queue
+ *
+ * NFP_NET_CFG_RXR_CQ holds a byte per ring, the CQ number plus one.  The
+ * CQ is (re)started from NFP_NET_CFG_RXCQ_ADDR and NFP_NET_CFG_RXCQ_SZ
+ * when no other queue is attached to it.  Queues of vNICs without
+ * NFP_NET_CFG_CTRL_RXCQ set, or naming a CQ beyond the vNIC's rings, are
+ * left unattached.
+ */
+__intrinsic void
+_rx_cq_cfg(unsigned int vid, unsigned int ring, unsigned int queue)
+{
+    __xread unsigned int ctrl_xfer;
+    __xread unsigned int cq_xfer;
+    __xread unsigned int cq_addr_xfer[2];
+    __xread unsigned int cq_sz_xfer;
+    __xwrite unsigned int cq_state_xfer[3];
+    unsigned int cq;
+    unsigned int cq_natq;
+    unsigned int map;
+    unsigned int i;
+
+    nfd_out_rx_cq_map[queue] = 0;
+
+    mem_read32(&ctrl_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                            NFP_NET_CFG_CTRL_WORD1), sizeof ctrl_xfer);
+    if (!(ctrl_xfer & NFP_NET_CFG_CTRL_RXCQ)) {
+        return;
+    }
+
+    mem_read32_le(&cq_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                             NFP_NET_CFG_RXR_CQ(ring & ~3)), sizeof cq_xfer);
+    cq = (cq_xfer >> ((ring & 3) * 8)) & 0xff;
+    if (cq == 0 || cq > NFD_VID_MAXQS(vid) || cq > NFP_NET_RXCQ_MAX) {
+        return;
+    }
+    cq--;
+
+    cq_natq = NFD_VID2NATQ(vid, cq);
+    map = (ring << PCIE_DESC_RX_CQ_RING_shf) | (cq_natq + 1);
+
+    /* Restart the CQ unless another queue already posts to it */
+    for (i = 0; i < NFD_OUT_MAX_QUEUES; i++) {
+        if ((nfd_out_rx_cq_map[i] & 0xff) == (cq_natq + 1)) {
+            nfd_out_rx_cq_map[queue] = map;
+            return;
+        }
+    }
+
+    mem_read64(cq_addr_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                              NFP_NET_CFG_RXCQ_ADDR(cq)),
+               sizeof cq_addr_xfer);
+    mem_read32_le(&cq_sz_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                                NFP_NET_CFG_RXCQ_SZ(cq & ~3)),
+                  sizeof cq_sz_xfer);
+
+    cq_state_xfer[0] = cq_addr_xfer[0];
+    cq_state_xfer[1] = ((((cq_sz_xfer >> ((cq & 3) * 8)) & 0xff) << 8) |
+                        (cq_addr_xfer[1] & 0xff));
+    cq_state_xfer[2] = 0;
+    mem_write32(cq_state_xfer,
+                RX_CQ_MEM(PCIE_ISL) + cq_natq * NFD_OUT_RX_CQ_STATE_SZ,
+                sizeof cq_state_xfer);
+
+    nfd_out_rx_cq_map[queue] = map;
+}
+#endif
+
+
+#ifdef NFD_OUT_RX_WB
+/**
+ * Set up RX ring write back for a queue from the CFG BAR
+ * @param vid       vNIC the queue belongs to
+ * @param ring      Ring number within the vNIC
+ * @param queue     Bitmask queue number of the queue
+ *
+ * Queues of vNICs without NFP_NET_CFG_CTRL_RXRWB set, or with a zero
+ * NFP_NET_CFG_RXR_WB_ADDR, do not write back.
+ */
+__intrinsic void
+_rx_wb_cfg(unsigned int vid, unsigned int ring, unsigned int queue)
+{
+    __xread unsigned int ctrl_xfer;
+    __xread unsigned int wb_addr_xfer[2];
+    __xwrite unsigned int wb_state_xfer;
+
+    nfd_out_rx_wb_map[queue] = 0;
+
+    mem_read32(&ctrl_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                            NFP_NET_CFG_CTRL_WORD1), sizeof ctrl_xfer);
+    if (!(ctrl_xfer & NFP_NET_CFG_CTRL_RXRWB)) {
+        return;
+    }
+
+    mem_read64(wb_addr_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                              NFP_NET_CFG_RXR_WB_ADDR(ring)),
+               sizeof wb_addr_xfer);
+    if (wb_addr_xfer[0] == 0 && (wb_addr_xfer[1] & 0xff) == 0) {
+        return;
+    }
+
+    wb_state_xfer = wb_addr_xfer[0];
+    mem_write32(&wb_state_xfer,
+                RX_WB_MEM(PCIE_ISL) + queue * NFD_OUT_RX_WB_STATE_SZ,
+                sizeof wb_state_xfer);
+
+    nfd_out_rx_wb_map[queue] = RX_WB_MAP_EN | (wb_addr_xfer[1] & 0xff);
+}
+#endif
+
+
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+/**
+ * Mark every FL cache slot of a queue as not yet fetched
+ * @param queue     Bitmask numbered queue
+ *
+ * SB waits while the slot it uses has the DD bit set.  Slots hold RX
+ * descriptors once used, so only the slots left over from before the queue
+ * came up need the mark.
+ */
+__intrinsic void
+_fl_cache_mark(unsigned int queue)
+{
+    __xwrite unsigned int mark_xfer[8];
+    __mem40 char *addr;
+    unsigned int i;
+
+    /* The mark must look like no FL descriptor the host can post */
+    ctassert(sizeof(struct nfd_out_fl_desc) == 8);
+    ctassert((NFD_OUT_FL_SZ_PER_QUEUE % sizeof mark_xfer) == 0);
+
+    for (i = 0; i < 8; i += 2) {
+        mark_xfer[i] = 1 << 31;
+        mark_xfer[i + 1] = 0;
+    }
+
+    addr = FL_CACHE_MEM(PCIE_ISL) + queue * NFD_OUT_FL_SZ_PER_QUEUE;
+    for (i = 0; i < NFD_OUT_FL_SZ_PER_QUEUE; i += sizeof mark_xfer) {
+        mem_write32(mark_xfer, addr + i, sizeof mark_xfer);
+    }
+}
+#endif
+
+
 /**
  * Setup PCI.OUT configuration fro the vNIC specified in cfg_msg
  * @param cfg_msg   Standard configuration message
@@ -290,6 +877,10 @@ cache_desc_vnic_setup(struct nfd_cfg_msg *cfg_msg)
     unsigned char ring_sz;
     unsigned int ring_base[2];
     __gpr unsigned int bmsk_queue;
+#if (defined(NFD_OUT_USE_RX_BATCH_TGT) || defined(NFD_OUT_RX_CQ) || \
+     defined(NFD_OUT_RX_WB))
+    unsigned int ring;
+#endif
 
     nfd_cfg_proc_msg(cfg_msg, &queue_s, &ring_sz, ring_base, NFD_CFG_PCI_OUT);
 
@@ -297,6 +888,10 @@ cache_desc_vnic_setup(struct nfd_cfg_msg *cfg_msg)
         return;
     }
 
+#if (defined(NFD_OUT_USE_RX_BATCH_TGT) || defined(NFD_OUT_RX_CQ) || \
+     defined(NFD_OUT_RX_WB))
+    ring = queue_s;
+#endif
     queue_s = NFD_VID2NATQ(cfg_msg->vid, queue_s);
     bmsk_queue = NFD_NATQ2BMQ(queue_s);
 
@@ -318,6 +913,7 @@ cache_desc_vnic_setup(struct nfd_cfg_msg *cfg_msg)
                                                    NFD_CFG_VF_OFFSET);
         }
         queue_data[bmsk_queue].spare0 = 0;
+        queue_data[bmsk_queue].fl_cache_hold = 0;
         queue_data[bmsk_queue].up = 1;
         queue_data[bmsk_queue].ring_base_hi = ring_base[1] & 0xFF;
         queue_data[bmsk_queue].ring_base_lo = ring_base[0];
@@ -327,13 +923,51 @@ cache_desc_vnic_setup(struct nfd_cfg_msg *cfg_msg)
 
         nfd_out_fl_u[bmsk_queue] = 0;
 
-        /* Reset credits and other atomics */
-        _zero_imm(NFD_OUT_CREDITS_BASE, bmsk_queue, NFD_OUT_ATOMICS_SZ);
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+        /* Start at the minimum depth, busy queues grow from there.
+         * The region is published before the configuration message
+         * reaches stage_batch. */
+        fl_cache_batches[bmsk_queue] = 0;
+        fl_cache_nup++;
+        _fl_cache_place(bmsk_queue, 0);
+#endif
+
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+        /* Mark the slots before qc_init_queue() lets fetches start */
+        _fl_cache_mark(bmsk_queue);
+#endif
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+        _fl_starve_reset(bmsk_queue);
+#endif
+
+        /* Reset credits and other atomics, and advance the generation
+         * so that stale credit reservations are not returned */
+        _zero_imm(NFD_OUT_CREDITS_BASE, bmsk_queue, NFD_OUT_ATOMICS_GEN);
+        _credit_gen_next(bmsk_queue);
+
+#ifdef NFD_OUT_USE_RX_BATCH_TGT
+        nfd_out_rx_batch[bmsk_queue].rate = 0;
+        _rx_batch_cfg(cfg_msg->vid, ring, bmsk_queue);
+#endif
+
+#ifdef NFD_OUT_RX_CQ
+        _rx_cq_cfg(cfg_msg->vid, ring, bmsk_queue);
+#endif
+
+#ifdef NFD_OUT_RX_WB
+        _rx_wb_cfg(cfg_msg->vid, ring, bmsk_queue);
+#endif
 
         rxq.event_type   = NFP_QC_STS_LO_EVENT_TYPE_HI_WATERMARK;
         rxq.size         = ring_sz - 8; /* XXX add define for size shift */
         qc_init_queue(PCIE_ISL, NFD_NATQ2QC(queue_s, NFD_OUT_FL_QUEUE), &rxq);
 
+#ifdef NFD_OUT_USE_RX_BATCH_TGT
+    } else if (cfg_msg->up_bit) {
+        /* The queue is already up, pick up batch target changes */
+        _rx_batch_cfg(cfg_msg->vid, ring, bmsk_queue);
+#endif
     } else if (!cfg_msg->up_bit && queue_data[bmsk_queue].up) {
         /* Down the queue:
          * - Prevent it issuing events
@@ -356,8 +990,29 @@ cache_desc_vnic_setup(struct nfd_cfg_msg *cfg_msg)
 
         nfd_out_fl_u[bmsk_queue] = 0;
 
-        /* Reset credits and other atomics */
-        _zero_imm(NFD_OUT_CREDITS_BASE, bmsk_queue, NFD_OUT_ATOMICS_SZ);
+#ifdef NFD_OUT_RX_CQ
+        nfd_out_rx_cq_map[bmsk_queue] = 0;
+#endif
+
+#ifdef NFD_OUT_RX_WB
+        nfd_out_rx_wb_map[bmsk_queue] = 0;
+#endif
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+        _fl_starve_reset(bmsk_queue);
+#endif
+
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+        /* A resize still waiting to drain is dropped by cache_desc_adapt(),
+         * one already handed to stage_batch runs to completion. */
+        fl_cache_nup--;
+        _fl_cache_free(bmsk_queue);
+#endif
+
+        /* Reset credits and other atomics, and advance the generation
+         * so that stale credit reservations are not returned */
+        _zero_imm(NFD_OUT_CREDITS_BASE, bmsk_queue, NFD_OUT_ATOMICS_GEN);
+        _credit_gen_next(bmsk_queue);
 
         /* Set QC queue to safe state (known size, no events, zeroed ptrs) */
         /* XXX configure both queues without swapping? */
@@ -431,9 +1086,6 @@ _fetch_fl(__gpr unsigned int *queue)
         ptr_inc = (unsigned int) wptr.writeptr - queue_data[*queue].fl_w;
         ptr_inc &= queue_data[*queue].ring_sz_msk;
         queue_data[*queue].fl_w += ptr_inc;
-#ifdef NFD__OUT_CREDITS_HOST_ISSUED
-        _add_imm(NFD_OUT_CREDITS_BASE, *queue, ptr_inc, NFD_OUT_ATOMICS_CREDIT);
-#endif
         if (!wptr.wmreached) {
             /* Mark the queue not urgent
              * The credit schemes ensure that when the FL buffers available are
@@ -456,8 +1108,14 @@ _fetch_fl(__gpr unsigned int *queue)
     /* We have a batch available, is there space to put it?
      * Space = ring size - (fl_s - rx_w). We require
      * space >= batch size. */
-    space_chk = ((NFD_OUT_FL_BUFS_PER_QUEUE - NFD_OUT_FL_BATCH_SZ) +
+    space_chk = ((FL_CACHE_DEPTH(*queue) - NFD_OUT_FL_BATCH_SZ) +
                  queue_data[*queue].rx_w - queue_data[*queue].fl_s);
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+    /* A queue being resized must drain, so treat its cache as full */
+    if (queue_data[*queue].fl_cache_hold) {
+        space_chk = -1;
+    }
+#endif
     if (space_chk >= 0 && NFD_RST_STATE_TEST_UP(PCIE_ISL)) {
         __xread unsigned int qc_xfer;
         unsigned int pending_slot;
@@ -503,6 +1161,17 @@ _fetch_fl(__gpr unsigned int *queue)
         __qc_add_to_ptr(PCIE_ISL, qc_queue, QC_RPTR, NFD_OUT_FL_BATCH_SZ,
                         &qc_xfer, sig_done, &qc_sig);
 
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+        /* Issue the credits with the fetch rather than on its completion.
+         * SB waits for the descriptors to land in the cache before use.
+         * The queue may have gone down while the FL.W reread swapped, and
+         * credits zeroed on down must stay zero. */
+        if (queue_data[*queue].up) {
+            _add_imm(NFD_OUT_CREDITS_BASE, *queue, NFD_OUT_FL_BATCH_SZ,
+                     NFD_OUT_ATOMICS_CREDIT);
+        }
+#endif
+
         /* Add batch message to LM queue
          * XXX check defer slots filled */
         pending_slot = (fl_cache_dma_seq_issued & (NFD_OUT_FL_MAX_IN_FLIGHT -1));
@@ -573,6 +1242,9 @@ _complete_fetch()
              * NB: If NFP cached credits are not used, there is nothing to
              * fill the LM pointer usage slots */
             queue_data[queue_c].fl_a += NFD_OUT_FL_BATCH_SZ;
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+            fl_cache_batches[queue_c]++;
+#endif
 
             /* Set the queue in the cached_bmsk for send_desc */
             set_queue(&queue_c, &cached_bmsk);
@@ -674,6 +1346,324 @@ cache_desc_check_urgent()
 }
 
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+/**
+ * Adapt the FL cache depth of each queue to its RX rate
+ *
+ * Every NFD_OUT_FL_CACHE_ADAPT_TICKS, the queues are checked one per call.
+ * A queue that fetched NFD_OUT_FL_CACHE_GROW_BATCHES or more FL batches
+ * since its last check doubles its depth, as long as a chunk remains for
+ * each down queue, and an idle queue with nothing cached halves its
+ * depth.  The region only moves once the queue has nothing cached, so
+ * fetches are held off while it drains and until stage_batch clears the
+ * mailbox to show that it has loaded the new region.  Only one queue is
+ * resized at a time, and a resize that has not drained within
+ * NFD_OUT_FL_CACHE_ADAPT_TICKS is abandoned so that a queue that stops
+ * receiving does not hold up its fetches and the other queues.
+ */
+__intrinsic void
+cache_desc_adapt()
+{
+    unsigned int queue;
+    unsigned int batches;
+    unsigned int lg2;
+    unsigned int now;
+
+    if (fl_cache_resize_q != 0) {
+        queue = fl_cache_resize_q - 1;
+
+        if (fl_cache_resize_ack) {
+            __xread unsigned int mbox;
+
+            mem_read32(&mbox, FL_CACHE_CFG(PCIE_ISL) + NFD_OUT_MAX_QUEUES,
+                       sizeof mbox);
+            if (mbox == 0) {
+                queue_data[queue].fl_cache_hold = 0;
+                fl_cache_resize_q = 0;
+            }
+        } else if (!queue_data[queue].up ||
+                   !queue_data[queue].fl_cache_hold) {
+            /* The queue went down, drop the resize */
+            fl_cache_resize_q = 0;
+        } else if (queue_data[queue].fl_s != queue_data[queue].rx_w) {
+            now = local_csr_read(local_csr_timestamp_low);
+            if ((now - fl_cache_resize_ts) >= NFD_OUT_FL_CACHE_ADAPT_TICKS) {
+                /* Not drained in time, the region has not moved */
+                queue_data[queue].fl_cache_hold = 0;
+                fl_cache_resize_q = 0;
+            }
+        } else {
+            __xwrite unsigned int mbox;
+
+            _fl_cache_free(queue);
+            _fl_cache_place(queue, fl_cache_resize_lg2);
+
+            mbox = fl_cache_resize_q;
+            mem_write32(&mbox, FL_CACHE_CFG(PCIE_ISL) + NFD_OUT_MAX_QUEUES,
+                        sizeof mbox);
+            fl_cache_resize_ack = 1;
+        }
+        return;
+    }
+
+    if (fl_cache_adapt_q == 0) {
+        now = local_csr_read(local_csr_timestamp_low);
+        if ((now - fl_cache_adapt_ts) < NFD_OUT_FL_CACHE_ADAPT_TICKS) {
+            return;
+        }
+        fl_cache_adapt_ts = now;
+    }
+
+    queue = fl_cache_adapt_q;
+    fl_cache_adapt_q = (queue + 1) & (NFD_OUT_MAX_QUEUES - 1);
+
+    batches = fl_cache_batches[queue];
+    fl_cache_batches[queue] = 0;
+    if (!queue_data[queue].up) {
+        return;
+    }
+
+    lg2 = queue_data[queue].fl_cache_lg2;
+    if (batches >= NFD_OUT_FL_CACHE_GROW_BATCHES) {
+        if (lg2 == FL_CACHE_MAX_LG2 ||
+            fl_cache_free < ((1 << lg2) + NFD_OUT_MAX_QUEUES - fl_cache_nup)) {
+            return;
+        }
+        lg2++;
+    } else if (batches == 0 && lg2 > 0 &&
+               queue_data[queue].fl_s == queue_data[queue].rx_w) {
+        lg2--;
+    } else {
+        return;
+    }
+
+    queue_data[queue].fl_cache_hold = 1;
+    fl_cache_resize_q = queue + 1;
+    fl_cache_resize_lg2 = lg2;
+    fl_cache_resize_ack = 0;
+    fl_cache_resize_ts = local_csr_read(local_csr_timestamp_low);
+}
+#endif
+
+
+#ifdef NFD_OUT_CREDIT_RSV
+/**
+ * Check whether a configuration message may complete
+ *
+ * Returns 0 until NFD_OUT_CREDIT_RSV_CHECK has passed since the last queue
+ * generation change.  By then every reservation has read the new
+ * generation before spending more credits, so the host cannot bring a
+ * downed queue back up while stale reserved credits can still be spent.
+ */
+__intrinsic int
+cache_desc_credit_gen_done()
+{
+    if (credit_gen_pend) {
+        if ((local_csr_read(local_csr_timestamp_low) - credit_gen_ts) <
+            NFD_OUT_CREDIT_RSV_CHECK) {
+            return 0;
+        }
+        credit_gen_pend = 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Move credits released from reservations back to the queue credits
+ *
+ * One queue is visited per call, starting a new pass over all queues every
+ * NFD_OUT_CREDIT_RSV_TIMEOUT.  Only the return slot of the current
+ * generation is collected, see nfd_out_credit_rsv_release().  This runs in
+ * the same context as the queue resets, so the generation cannot change
+ * under it.
+ */
+__intrinsic void
+cache_desc_credit_ret()
+{
+    __xread unsigned int gen_xfer;
+    __xrw unsigned int ret_xfer;
+    unsigned int queue;
+    unsigned int now;
+
+    if (credit_ret_q == 0) {
+        now = local_csr_read(local_csr_timestamp_low);
+        if ((now - credit_ret_ts) < NFD_OUT_CREDIT_RSV_TIMEOUT) {
+            return;
+        }
+        credit_ret_ts = now;
+    }
+
+    queue = credit_ret_q;
+    credit_ret_q = (queue + 1) & (NFD_OUT_MAX_QUEUES - 1);
+
+    if (!queue_data[queue].up) {
+        return;
+    }
+
+    mem_read_atomic(&gen_xfer, (ATOMICS_MEM(PCIE_ISL) +
+                                ((queue * NFD_OUT_ATOMICS_SZ +
+                                  NFD_OUT_ATOMICS_GEN) / 4)),
+                    sizeof gen_xfer);
+
+    ret_xfer = 0xffffffff;
+    mem_test_clr(&ret_xfer, (CREDIT_RET_MEM(PCIE_ISL) +
+                             queue * (NFD_OUT_CREDIT_RET_SZ / 4) +
+                             (gen_xfer & 1)),
+                 sizeof ret_xfer);
+    if (ret_xfer != 0) {
+        _add_imm(NFD_OUT_CREDITS_BASE, queue, ret_xfer,
+                 NFD_OUT_ATOMICS_CREDIT);
+    }
+}
+#endif
+
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+/**
+ * Flag queues that the host has left without FL buffers
+ *
+ * Every NFD_OUT_FL_STARVE_TICKS / FL_STARVE_CHECKS, the queues are checked
+ * one per call.  A queue whose cached FL buffers have all been used, and
+ * that has fetched none since its last check, is starved.  After
+ * FL_STARVE_CHECKS such checks in a row, its CTM flag is set, and apps that
+ * find no credits for the queue drop their packets instead of holding the
+ * buffers, see nfd_out_starve_drop().  The flag is cleared by the first
+ * check after a fetch.  Queues held back by other means, such as rate
+ * limiting, still have FL buffers cached and are not flagged.  The drops
+ * counted by the apps are added to NFP_NET_CFG_RXR_STARVE_DROPS as the
+ * flagged queues are checked.
+ */
+__intrinsic void
+cache_desc_starve()
+{
+    __xwrite unsigned int flag_xfer;
+    __xrw unsigned int drops_xfer;
+    __xwrite unsigned int add_xfer;
+    __mem40 unsigned int *starve;
+    unsigned int queue;
+    unsigned int fl_s;
+    unsigned int now;
+    unsigned int vid;
+    unsigned int ring;
+
+    if (fl_starve_q == 0) {
+        now = local_csr_read(local_csr_timestamp_low);
+        if ((now - fl_starve_ts) <
+            (NFD_OUT_FL_STARVE_TICKS / FL_STARVE_CHECKS)) {
+            return;
+        }
+        fl_starve_ts = now;
+    }
+
+    queue = fl_starve_q;
+    fl_starve_q = (queue + 1) & (NFD_OUT_MAX_QUEUES - 1);
+
+    if (!queue_data[queue].up) {
+        return;
+    }
+
+    starve = FL_STARVE_MEM(PCIE_ISL) + queue * (NFD_OUT_STARVE_SZ / 4);
+
+    fl_s = queue_data[queue].fl_s & 0xffffff;
+    if (fl_s != nfd_out_fl_starve[queue].fl_s ||
+        queue_data[queue].fl_a != queue_data[queue].rx_s) {
+        nfd_out_fl_starve[queue].fl_s = fl_s;
+        nfd_out_fl_starve[queue].checks = 0;
+        if (!nfd_out_fl_starve[queue].starved) {
+            return;
+        }
+
+        /* Apps may count drops until they see the flag clear,
+         * those left over are collected next time the queue starves */
+        nfd_out_fl_starve[queue].starved = 0;
+        flag_xfer = 0;
+        mem_write_atomic(&flag_xfer, starve + NFD_OUT_STARVE_FLAG / 4,
+                         sizeof flag_xfer);
+    } else if (!nfd_out_fl_starve[queue].starved) {
+        nfd_out_fl_starve[queue].checks++;
+        if (nfd_out_fl_starve[queue].checks == FL_STARVE_CHECKS) {
+            nfd_out_fl_starve[queue].starved = 1;
+            flag_xfer = 1;
+            mem_write_atomic(&flag_xfer, starve + NFD_OUT_STARVE_FLAG / 4,
+                             sizeof flag_xfer);
+        }
+        return;
+    }
+
+    /* Move the drops counted by the apps to the CFG BAR */
+    drops_xfer = 0xffffffff;
+    mem_test_clr(&drops_xfer, starve + NFD_OUT_STARVE_DROPS / 4,
+                 sizeof drops_xfer);
+    if (drops_xfer != 0) {
+        /* The host reads the counter little endian, so this is its
+         * low word */
+        NFD_NATQ2VID(vid, ring, NFD_BMQ2NATQ(queue));
+        add_xfer = drops_xfer;
+        mem_add32(&add_xfer, (NFD_CFG_BAR_ISL(PCIE_ISL, vid) +
+                              NFP_NET_CFG_RXR_STARVE_DROPS(ring)),
+                  sizeof add_xfer);
+    }
+}
+#endif
+
+
+#ifdef NFD_OUT_USE_RX_BATCH_TGT
+/**
+ * Update the RX descriptor batch target of a queue as a batch is sent
+ * @param queue     Bitmask numbered queue
+ * @param n_batch   Number of descriptors in the batch
+ *
+ * The batch is scaled by powers of two to the descriptors the queue would
+ * receive within NFD_OUT_RX_DESC_LAT_LIMIT, given the time since the last
+ * batch, and averaged into "rate".  Unless the CFG BAR sets a target, the
+ * target is the averaged rate, so a queue that receives fewer descriptors
+ * than that within the latency limit is not held back at all.
+ */
+__intrinsic void
+_rx_batch_update(__gpr unsigned int *queue, unsigned int n_batch)
+{
+    unsigned long long time_now = me_tsc_read();
+    unsigned long long delta;
+    unsigned int elapsed = 0xffffffff;
+    unsigned int lim = NFD_OUT_RX_DESC_LAT_LIMIT >> 4;
+    unsigned int sample = n_batch;
+    unsigned int rate;
+    unsigned int tgt;
+
+    delta = time_now - nfd_out_rx_ts[*queue];
+    nfd_out_rx_ts[*queue] = time_now;
+    if (delta < 0xffffffff) {
+        elapsed = delta;
+    }
+
+    while (elapsed < (lim >> 1) && sample < NFD_OUT_RX_DESC_REQ_BATCH) {
+        sample <<= 1;
+        elapsed <<= 1;
+    }
+    while (elapsed >= (lim << 1) && sample != 0) {
+        sample >>= 1;
+        elapsed >>= 1;
+    }
+
+    rate = nfd_out_rx_batch[*queue].rate;
+    rate = (3 * rate + (sample << 4)) >> 2;
+    nfd_out_rx_batch[*queue].rate = rate;
+
+    if (nfd_out_rx_batch[*queue].cfg == 0) {
+        tgt = (rate + 8) >> 4;
+        if (tgt == 0) {
+            tgt = 1;
+        } else if (tgt > NFD_OUT_RX_DESC_REQ_BATCH) {
+            tgt = NFD_OUT_RX_DESC_REQ_BATCH;
+        }
+        nfd_out_rx_batch[*queue].tgt = tgt;
+    }
+}
+#endif
+
+
 /**
  * Service function to determine the address of a specific FL entry
  * @param queue     Bitmask numbered queue
@@ -684,10 +1674,17 @@ cache_desc_compute_fl_addr(__gpr unsigned int *queue, unsigned int seq)
 {
     unsigned int ret;
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+    ret = seq & (FL_CACHE_DEPTH(*queue) - 1);
+    ret *= sizeof(struct nfd_out_fl_desc);
+    ret |= queue_data[*queue].fl_cache_chunk * FL_CACHE_CHUNK_SZ;
+    ret |= fl_cache_mem_addr_lo;
+#else
     ret = seq & (NFD_OUT_FL_BUFS_PER_QUEUE - 1);
     ret *= sizeof(struct nfd_out_fl_desc);
     ret |= (*queue * NFD_OUT_FL_SZ_PER_QUEUE );
     ret |= fl_cache_mem_addr_lo;
+#endif
 
     return ret;
 }
@@ -723,7 +1720,135 @@ send_desc_setup_shared()
     /* cpp_addr_hi = 0 will target local CTM, as desired. */
     rx_descr_tmp.cpp_addr_hi =
         (((unsigned long long) FL_CACHE_MEM(PCIE_ISL) >> 32) & 0xff);
+
+#ifdef NFD_OUT_RX_CQ
+    /* The CQ memory shares the FL cache memory unit */
+    rx_cq_mem_addr_lo =
+        ((unsigned long long) RX_CQ_MEM(PCIE_ISL) & 0xffffffff);
+#endif
+
+#ifdef NFD_OUT_RX_WB
+    /* The write back memory shares the FL cache memory unit */
+    rx_wb_mem_addr_lo =
+        ((unsigned long long) RX_WB_MEM(PCIE_ISL) & 0xffffffff);
+#endif
+}
+
+
+#ifdef NFD_OUT_RX_CQ
+/**
+ * Prepare the RX completion queue entry for a batch of RX descriptors
+ * @param cq_map    nfd_out_rx_cq_map entry of the queue
+ * @param rx_idx    Ring index of the first descriptor of the batch
+ * @param count     Number of descriptors in the batch
+ * @param slot      Staging slot for the entry, the pending slot of the batch
+ *
+ * The entry is written to its staging slot and "rx_descr_tmp" is set up to
+ * DMA it to the host, apart from the completion event.  send_desc is the
+ * only writer of the CQ write index once the CQ is started, so the index
+ * is advanced without atomics.
+ */
+__intrinsic void
+_rx_cq_prep(unsigned int cq_map, unsigned int rx_idx, unsigned int count,
+            unsigned int slot)
+{
+    __xread struct nfd_out_rx_cq cq_state;
+    __xwrite unsigned int entry_xfer[2];
+    __xwrite unsigned int wr_xfer;
+    __mem40 char *state_addr;
+    unsigned int stage_off;
+    unsigned int entry;
+    unsigned int wr;
+    unsigned int pcie_addr_off;
+    unsigned int pcie_addr_hi_tmp, pcie_addr_lo_tmp;
+    SIGNAL entry_sig;
+    SIGNAL wr_sig;
+
+    state_addr = (RX_CQ_MEM(PCIE_ISL) +
+                  ((cq_map & 0xff) - 1) * NFD_OUT_RX_CQ_STATE_SZ);
+    mem_read32(&cq_state, state_addr, sizeof cq_state);
+
+    /* The phase bit is set on the first pass over the CQ */
+    wr = cq_state.wr;
+    entry = cq_map & (PCIE_DESC_RX_CQ_RING_msk << PCIE_DESC_RX_CQ_RING_shf);
+    entry |= count;
+    if (((wr >> cq_state.sz_lg2) & 1) == 0) {
+        entry |= PCIE_DESC_RX_CQ_PHASE;
+    }
+
+    stage_off = NFD_OUT_RX_CQ_STAGE_OFF + slot * NFD_OUT_RX_CQ_ENTRY_SZ;
+    entry_xfer[0] = entry;
+    entry_xfer[1] = rx_idx;
+    __mem_write32(entry_xfer, RX_CQ_MEM(PCIE_ISL) + stage_off,
+                  sizeof entry_xfer, sizeof entry_xfer, sig_done, &entry_sig);
+
+    /* "wr" is the third word of struct nfd_out_rx_cq */
+    wr_xfer = wr + 1;
+    __mem_write32(&wr_xfer, state_addr + 8, sizeof wr_xfer, sizeof wr_xfer,
+                  sig_done, &wr_sig);
+
+    pcie_addr_off = wr & ((1 << cq_state.sz_lg2) - 1);
+    pcie_addr_off = pcie_addr_off * NFD_OUT_RX_CQ_ENTRY_SZ;
+    pcie_addr_hi_tmp = cq_state.base_hi;
+    pcie_addr_lo_tmp = cq_state.base_lo;
+    __asm {
+        alu[pcie_addr_lo_tmp, pcie_addr_lo_tmp, +, pcie_addr_off];
+        alu[pcie_addr_hi_tmp, pcie_addr_hi_tmp, +carry, 0];
+    }
+    rx_descr_tmp.pcie_addr_hi = pcie_addr_hi_tmp;
+    rx_descr_tmp.pcie_addr_lo = pcie_addr_lo_tmp;
+    rx_descr_tmp.cpp_addr_lo = rx_cq_mem_addr_lo + stage_off;
+    rx_descr_tmp.length = NFD_OUT_RX_CQ_ENTRY_SZ - 1;
+
+    /* The entry must be staged before its DMA is enqueued */
+    wait_for_all(&entry_sig, &wr_sig);
 }
+#endif
+
+
+#ifdef NFD_OUT_RX_WB
+/**
+ * Prepare the RX ring write back for a batch of RX descriptors
+ * @param queue     Bitmask queue number of the queue
+ * @param wb_map    nfd_out_rx_wb_map entry of the queue
+ * @param rx_s      Descriptors sent on the queue including the batch
+ * @param slot      Staging slot for the word, the pending slot of the batch
+ *
+ * The free running descriptor count is written to its staging slot and
+ * "rx_descr_tmp" is set up to DMA it to the host, apart from the
+ * completion event.
+ */
+__intrinsic void
+_rx_wb_prep(unsigned int queue, unsigned int wb_map, unsigned int rx_s,
+            unsigned int slot)
+{
+    __xread unsigned int wb_state_xfer;
+    __xwrite unsigned int entry_xfer;
+    unsigned int stage_off;
+    unsigned int pcie_addr_lo_tmp;
+    SIGNAL state_sig;
+    SIGNAL entry_sig;
+
+    __mem_read32(&wb_state_xfer,
+                 RX_WB_MEM(PCIE_ISL) + queue * NFD_OUT_RX_WB_STATE_SZ,
+                 sizeof wb_state_xfer, sizeof wb_state_xfer,
+                 sig_done, &state_sig);
+
+    stage_off = NFD_OUT_RX_WB_STAGE_OFF + slot * NFD_OUT_RX_WB_ENTRY_SZ;
+    entry_xfer = rx_s;
+    __mem_write32(&entry_xfer, RX_WB_MEM(PCIE_ISL) + stage_off,
+                  sizeof entry_xfer, sizeof entry_xfer, sig_done, &entry_sig);
+
+    /* The word must be staged before its DMA is enqueued */
+    wait_for_all(&state_sig, &entry_sig);
+
+    pcie_addr_lo_tmp = wb_state_xfer;
+    rx_descr_tmp.pcie_addr_hi = wb_map & 0xff;
+    rx_descr_tmp.pcie_addr_lo = pcie_addr_lo_tmp;
+    rx_descr_tmp.cpp_addr_lo = rx_wb_mem_addr_lo + stage_off;
+    rx_descr_tmp.length = NFD_OUT_RX_WB_ENTRY_SZ - 1;
+}
+#endif
 
 
 __intrinsic void
@@ -760,6 +1885,12 @@ _start_send(__gpr unsigned int *queue)
             unsigned int dma_length;
             unsigned int pending_slot;
             struct nfd_out_send_desc_msg send_msg;
+#ifdef NFD_OUT_RX_CQ
+            unsigned int cq_map;
+#endif
+#ifdef NFD_OUT_RX_WB
+            unsigned int wb_map;
+#endif
 
             /* Increment desc_dma_issued upfront
              * to avoid ambiguity about sequence number zero */
@@ -784,7 +1915,10 @@ _start_send(__gpr unsigned int *queue)
             }
 
 #ifdef NFD_OUT_USE_RX_BATCH_TGT
-            if (dma_batch < NFD_OUT_RX_DESC_REQ_BATCH) {
+            /* Batches cut short by the NFD_OUT_DESC_MAX_BATCH_SZ
+             * alignment are not held back */
+            if (dma_batch < nfd_out_rx_batch[*queue].tgt &&
+                dma_batch_correction < 0) {
                 unsigned long long time_now = me_tsc_read();
 
                 if ((time_now - nfd_out_rx_ts[*queue]) <
@@ -821,6 +1955,22 @@ _start_send(__gpr unsigned int *queue)
             /* Can replace with ld_field instruction if 8bit seqn is enough */
             dma_seqn_set_event(&rx_descr_tmp, NFD_OUT_DESC_EVENT_TYPE,
                                NFD_OUT_DESC_EXT_TYPE, desc_dma_issued);
+#ifdef NFD_OUT_RX_CQ
+            cq_map = nfd_out_rx_cq_map[*queue];
+            if (cq_map != 0) {
+                /* The CQ entry DMA carries the completion event */
+                rx_descr_tmp.mode_sel = 0;
+                rx_descr_tmp.dma_mode = 0;
+            }
+#endif
+#ifdef NFD_OUT_RX_WB
+            wb_map = nfd_out_rx_wb_map[*queue];
+            if (wb_map != 0) {
+                /* The write back DMA carries the completion event */
+                rx_descr_tmp.mode_sel = 0;
+                rx_descr_tmp.dma_mode = 0;
+            }
+#endif
             descr = rx_descr_tmp;
 
             /* Increment rx_s and desc_dma_pkts_served */
@@ -840,8 +1990,39 @@ _start_send(__gpr unsigned int *queue)
                 dma_sig_msk = __signals(&dma_sig);
                 __pcie_dma_enq(PCIE_ISL, &descr, NFD_OUT_DESC_DMA_QUEUE,
                                sig_done, &dma_sig);
+#ifdef NFD_OUT_RX_CQ
+                if (cq_map != 0) {
+                    /* DMAs on a queue complete in order, so the host sees
+                     * the entry after the descriptors that it covers */
+                    _rx_cq_prep(cq_map,
+                                ((rx_s - dma_batch) &
+                                 queue_data[*queue].ring_sz_msk),
+                                dma_batch, pending_slot);
+                    dma_seqn_set_event(&rx_descr_tmp, NFD_OUT_DESC_EVENT_TYPE,
+                                       NFD_OUT_DESC_EXT_TYPE,
+                                       desc_dma_issued);
+                    wait_for_all(&dma_sig);
+                    descr = rx_descr_tmp;
+                    __pcie_dma_enq(PCIE_ISL, &descr, NFD_OUT_DESC_DMA_QUEUE,
+                                   sig_done, &dma_sig);
+                }
+#endif
+#ifdef NFD_OUT_RX_WB
+                if (wb_map != 0) {
+                    /* DMAs on a queue complete in order, so the host sees
+                     * the count after the descriptors that it covers */
+                    _rx_wb_prep(*queue, wb_map, rx_s, pending_slot);
+                    dma_seqn_set_event(&rx_descr_tmp, NFD_OUT_DESC_EVENT_TYPE,
+                                       NFD_OUT_DESC_EXT_TYPE,
+                                       desc_dma_issued);
+                    wait_for_all(&dma_sig);
+                    descr = rx_descr_tmp;
+                    __pcie_dma_enq(PCIE_ISL, &descr, NFD_OUT_DESC_DMA_QUEUE,
+                                   sig_done, &dma_sig);
+                }
+#endif
 #ifdef NFD_OUT_USE_RX_BATCH_TGT
-                nfd_out_rx_ts[*queue] = me_tsc_read();
+                _rx_batch_update(queue, dma_batch);
 #endif
             }
         }
@@ -962,6 +2143,9 @@ send_desc_check_pending()
  * We do _not_ check whether each queue is up at this stage, if it had
  * been down when we were processing the send, the send would have been
  * aborted.  The MSIX code ignores sent packet counts on down queues.
+ * With NFD_OUT_RX_CQ, the event of a batch posting to a CQ comes from
+ * the CQ entry DMA, which completes after the descriptor DMA.  The same
+ * holds for the write back DMA with NFD_OUT_RX_WB.
  */
 __intrinsic void
 send_desc_complete_send()
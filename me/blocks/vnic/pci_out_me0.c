@@ -35,6 +35,11 @@ SIGNAL cfg_msg_sig;
 struct nfd_cfg_msg cfg_msg;
 __xread struct nfd_cfg_msg cfg_msg_rd;
 
+#ifdef NFD_OUT_CREDIT_RSV
+/* Set while a processed message waits for cache_desc_credit_gen_done() */
+__gpr unsigned int cfg_msg_held = 0;
+#endif
+
 
 #ifdef NFD_USER_CTX_DECL
 NFD_USER_CTX_DECL(PCIE_ISL);
@@ -44,14 +49,51 @@ NFD_USER_CTX_DECL(PCIE_ISL);
 #error "NFD_OUT_PD_ME0 is not defined."
 #endif
 
-#ifndef NFD_OUT_PD_ME1
+#if (NFD_OUT_PD_MES > 1) && !defined(NFD_OUT_PD_ME1)
 #error "NFD_OUT_PD_ME1 is not defined."
 #endif
 
-#ifdef NFD_OUT_3_PD_MES
-#ifndef NFD_OUT_PD_ME2
+#if (NFD_OUT_PD_MES > 2) && !defined(NFD_OUT_PD_ME2)
 #error "NFD_OUT_PD_ME2 is not defined."
 #endif
+
+#if (NFD_OUT_PD_MES > 3) && !defined(NFD_OUT_PD_ME3)
+#error "NFD_OUT_PD_ME3 is not defined."
+#endif
+
+#if (NFD_OUT_PD_MES > 4) && !defined(NFD_OUT_PD_ME4)
+#error "NFD_OUT_PD_ME4 is not defined."
+#endif
+
+#if (NFD_OUT_PD_MES > 5) && !defined(NFD_OUT_PD_ME5)
+#error "NFD_OUT_PD_ME5 is not defined."
+#endif
+
+#if (NFD_OUT_PD_MES > 6) && !defined(NFD_OUT_PD_ME6)
+#error "NFD_OUT_PD_ME6 is not defined."
+#endif
+
+#if (NFD_OUT_PD_MES > 7) && !defined(NFD_OUT_PD_ME7)
+#error "NFD_OUT_PD_ME7 is not defined."
+#endif
+
+/* The message to the last PD ME swaps for all of them */
+#if (NFD_OUT_PD_MES == 1)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME0
+#elif (NFD_OUT_PD_MES == 2)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME1
+#elif (NFD_OUT_PD_MES == 3)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME2
+#elif (NFD_OUT_PD_MES == 4)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME3
+#elif (NFD_OUT_PD_MES == 5)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME4
+#elif (NFD_OUT_PD_MES == 6)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME5
+#elif (NFD_OUT_PD_MES == 7)
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME6
+#else
+#define PCI_OUT_PD_ME_LAST      NFD_OUT_PD_ME7
 #endif
 
 
@@ -110,21 +152,43 @@ pci_out_msg_pd(unsigned int isl_reset)
                                 ((NFD_OUT_PD_RST_CTX << 4) |
                                  NFD_OUT_PD_RST_NN_OFF));
 
+#if (NFD_OUT_PD_MES > 1)
     addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME0) | addr_part;
-
     __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
 
+#if (NFD_OUT_PD_MES > 2)
     addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME1) | addr_part;
-
-#ifndef NFD_OUT_PD_ME2
-    __asm { ct[ctnn_write, data, 0, addr, 1], ctx_swap[nn_sig] };
-#else
     __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
 
+#if (NFD_OUT_PD_MES > 3)
     addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME2) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
 
-    __asm { ct[ctnn_write, data, 0, addr, 1], ctx_swap[nn_sig] };
+#if (NFD_OUT_PD_MES > 4)
+    addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME3) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
+
+#if (NFD_OUT_PD_MES > 5)
+    addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME4) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
+
+#if (NFD_OUT_PD_MES > 6)
+    addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME5) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1] };
+#endif
+
+#if (NFD_OUT_PD_MES > 7)
+    addr = PCI_OUT_PD_ADDR(NFD_OUT_PD_ME6) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1] };
 #endif
+
+    addr = PCI_OUT_PD_ADDR(PCI_OUT_PD_ME_LAST) | addr_part;
+    __asm { ct[ctnn_write, data, 0, addr, 1], ctx_swap[nn_sig] };
 }
 
 
@@ -171,12 +235,32 @@ main(void)
             cache_desc_check_urgent(); /* Swaps min once */
 
             cache_desc_status();
+#ifdef NFD_OUT_CREDIT_RSV
+            cache_desc_credit_ret();
+#endif
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+            cache_desc_adapt();
+#endif
+#ifdef NFD_OUT_FL_STARVE_DROP
+            cache_desc_starve();
+#endif
             ctx_swap();
 
             cache_desc_check_active(); /* Swaps min once */
 
             /* Either check for a message, or perform one tick of processing
              * on the message each loop iteration */
+#ifdef NFD_OUT_CREDIT_RSV
+            if (cfg_msg_held) {
+                /* Pass on the message once reservations see the new
+                 * queue generations */
+                if (cache_desc_credit_gen_done()) {
+                    cfg_msg_held = 0;
+                    nfd_cfg_complete_cfg_msg(&cfg_msg,
+                                             NFD_CFG_RING_NUM(PCIE_ISL, 3));
+                }
+            } else
+#endif
             if (!cfg_msg.msg_valid) {
                 nfd_cfg_check_cfg_msg(&cfg_msg, NFD_CFG_RING_NUM(PCIE_ISL, 2),
                                       &cfg_msg_rd, &cfg_msg_sig);
@@ -206,8 +290,17 @@ main(void)
                         cache_desc_compl_rst();
                     }
 
+#ifdef NFD_OUT_CREDIT_RSV
+                    if (!cache_desc_credit_gen_done()) {
+                        cfg_msg_held = 1;
+                    } else {
+                        nfd_cfg_complete_cfg_msg(
+                            &cfg_msg, NFD_CFG_RING_NUM(PCIE_ISL, 3));
+                    }
+#else
                     nfd_cfg_complete_cfg_msg(&cfg_msg,
                                              NFD_CFG_RING_NUM(PCIE_ISL, 3));
+#endif
                 }
             }
 
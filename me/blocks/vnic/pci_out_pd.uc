@@ -76,6 +76,42 @@
 // See NFP Databook Section 9.2.2.1.2.10 "TicketRelease Command"
 #define TICKET_ERROR                    255
 
+#ifdef NFD_OUT_STRIDE_RX
+// Per context staging of the RX descriptor copy DMAed to the head of a
+// stride, indexed by ME number and context
+.alloc_mem nfd_out_pd_stride_hdr/**/PCIE_ISL ctm island \
+    (16 * 8 * NFD_OUT_STRIDE_HDR_SZ) NFD_OUT_STRIDE_HDR_SZ
+#endif
+
+#if (defined(NFD_OUT_PD_DONE_BATCH) && \
+     (NFD_OUT_PD_DONE_BATCH < 1 || NFD_OUT_PD_DONE_BATCH > 255))
+#error "NFD_OUT_PD_DONE_BATCH must be 1 to 255"
+#endif
+
+// The last segment of a scattered packet waits for DMA_DONE to pass the
+// earlier segments, whose tickets other contexts could be holding back
+#if (defined(NFD_OUT_PD_DONE_BATCH) && defined(NFD_OUT_RX_SCATTER))
+#error "NFD_OUT_PD_DONE_BATCH is incompatible with NFD_OUT_RX_SCATTER"
+#endif
+
+#ifdef NFD_OUT_RX_SCATTER
+// Polls of 64 x 32 cycles the last segment of a packet waits for the DMAs
+// of the earlier segments before freeing the buffers regardless
+#ifndef NFD_OUT_PD_SCATTER_POLLS
+#define NFD_OUT_PD_SCATTER_POLLS        4096
+#endif
+
+#if (NFD_OUT_PD_SCATTER_POLLS < 1 || NFD_OUT_PD_SCATTER_POLLS > 0xFFFF)
+#error "NFD_OUT_PD_SCATTER_POLLS must be 1 to 65535"
+#endif
+
+// scatter_wait# reads DMA_DONE and the generation together
+#if (NFD_OUT_ATOMICS_GEN != (NFD_OUT_ATOMICS_DMA_DONE + 4))
+#error "NFD_OUT_ATOMICS_GEN must follow NFD_OUT_ATOMICS_DMA_DONE"
+#endif
+#endif
+
+// Largest packet, or segment with NFD_OUT_RX_SCATTER, that PD will DMA
 #define NFD_OUT_MAX_PKT_BYTES           (10 * 1024)
 
 // Debug parameters
@@ -98,16 +134,11 @@
     #if ONE_PKT_AT_A_TIME
         #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT (1 * 2)
     #else
-        #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT (3 * 2)
+        #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT NFD_OUT_PD_DMAS_PER_CTX
     #endif
 
-    #ifdef NFD_OUT_3_PD_MES
-        #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT \
-            (7 * _NFD_OUT_DATA_MAX_IN_FLIGHT)
-    #else
-        #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT \
-            (8 * _NFD_OUT_DATA_MAX_IN_FLIGHT)
-    #endif
+    #define_eval _NFD_OUT_DATA_MAX_IN_FLIGHT \
+        (NFD_OUT_PD_CTXS * _NFD_OUT_DATA_MAX_IN_FLIGHT)
 
     PCIE_DMA_ALLOC(nfd_out_data_dma, me, PCIE_ISL, topci_lo, \
                    _NFD_OUT_DATA_MAX_IN_FLIGHT)
@@ -216,6 +247,15 @@
 
 #define PCIE_DMA_SIZE_LW        4
 
+#ifdef NFD_OUT_PD_FREE_BATCH
+#if (NFD_OUT_PD_FREE_BATCH < 2 || NFD_OUT_PD_FREE_BATCH > PCIE_DMA_SIZE_LW)
+#error "NFD_OUT_PD_FREE_BATCH must be 2 to 4"
+#endif
+
+// Per context list of MU buffers held back, see _hold_mu_buf()
+.alloc_mem pd_free_lm lmem me (PCIE_DMA_SIZE_LW * 4 * 8) 16
+#endif
+
 #define PCIE_DMA_MAX_LEN        2048
 
 #define PCIE_DMA_WORD1_NOSIG_val \
@@ -240,11 +280,7 @@
     .if (ctx() == NFD_OUT_PD_RST_CTX)
         .if (BIT(*n$index, NFD_OUT_PD_RST_BIT))
 
-            #ifdef NFD_OUT_3_PD_MES
-                #define _NUM_CTX 7
-            #else
-                #define _NUM_CTX 8
-            #endif
+            #define_eval _NUM_CTX NFD_OUT_PD_CTXS
 
             #define _IDX 0
             #while _IDX < _NUM_CTX
@@ -352,6 +388,148 @@
 #endm
 
 
+/**
+ * Compute where the DMA data starts in the host buffer.
+ *
+ * @param out_off       Offset from the host buffer address
+ * @param in_work       Read-only work queue entry from stage batch
+ *
+ * The data normally starts NFD_OUT_RX_OFFSET bytes into the buffer, less
+ * the metadata length.  For header split packets, the first
+ * NFD_OUT_HDR_SPLIT_LEN bytes of data end at NFD_OUT_HDR_SPLIT_DATA_OFF.
+ */
+#macro _host_buf_offset(out_off, in_work)
+.begin
+
+    .reg tmp
+
+    #ifdef NFD_OUT_HDR_SPLIT
+
+        br_bclr[in_work[SB_WQ_HDR_SPLIT_wrd], SB_WQ_HDR_SPLIT_shf, no_split#]
+        wsm_extract(tmp, in_work, SB_WQ_DATALEN)
+        .if (tmp > NFD_OUT_HDR_SPLIT_LEN)
+            immed[tmp, NFD_OUT_HDR_SPLIT_LEN]
+        .endif
+        immed[out_off, NFD_OUT_HDR_SPLIT_DATA_OFF]
+        br[done#], defer[1]
+        alu[out_off, out_off, -, tmp]
+
+    no_split#:
+
+    #endif /* NFD_OUT_HDR_SPLIT */
+
+    #if NFD_OUT_RX_OFFSET > 0
+
+        wsm_extract(tmp, in_work, SB_WQ_METALEN)
+        alu[out_off, NFD_OUT_RX_OFFSET, -, tmp]
+
+    #else /* NFD_OUT_RX_OFFSET > 0 */
+
+        immed[out_off, 0]
+
+    #endif /* NFD_OUT_RX_OFFSET > 0 */
+
+done#:
+
+.end
+#endm
+
+
+#ifdef NFD_OUT_PD_DONE_BATCH
+/**
+ * Add the tickets held back by the context to the DMA_DONE counter of
+ * their queue.  g_done_cnt must be non-zero.
+ */
+#macro _flush_dma_done()
+    alu[--, g_add_imm_iref, OR, g_done_cnt, <<16]
+    mem[add_imm, --, g_send_cntrs_addr_hi, <<8, g_done_cntr], indirect_ref
+    immed[g_done_cnt, 0]
+#endm
+#endif
+
+
+#ifdef NFD_OUT_PD_FREE_BATCH
+/**
+ * Return the MU buffers held back by the context to the BLM one at a
+ * time.  Used when the held buffers can't make up a full batch.
+ */
+#macro _flush_mu_bufs()
+.begin
+
+    .reg buf
+
+    alu[--, g_free_cnt, OR, 0]
+    beq[flush_done#]
+
+    local_csr_wr[ACTIVE_LM_ADDR_0, g_free_lm]
+    nop
+    nop
+    nop
+
+flush_loop#:
+    alu[buf, --, B, *l$index0++]
+    alu[--, g_blm_iref, OR, g_free_ring, <<16]
+    mem[fast_journal, --, g_blm_addr_hi, <<8, buf], indirect_ref
+    alu[g_free_cnt, g_free_cnt, -, 1]
+    bne[flush_loop#]
+
+    local_csr_wr[ACTIVE_LM_ADDR_0, g_free_lm]
+
+flush_done#:
+
+.end
+#endm
+
+
+/**
+ * Hold back a MU buffer to free and return the buffers held with a single
+ * journal command once NFD_OUT_PD_FREE_BATCH are held for one BLS.
+ *
+ * @param in_addr       MU buffer address, as for mem[fast_journal]
+ * @param in_bls        BLS of the buffer
+ * @param out_xfer      Idle write transfer registers to journal from
+ */
+#macro _hold_mu_buf(in_addr, in_bls, out_xfer)
+.begin
+
+    .reg ring
+    .sig free_sig
+
+    alu[--, in_bls, -, g_free_ring]
+    beq[hold_same_bls#]
+    _flush_mu_bufs()
+    // The flush rewinds ACTIVE_LM_ADDR_0, which takes 3 cycles to settle
+    alu[g_free_ring, --, B, in_bls]
+    nop
+    nop
+
+hold_same_bls#:
+    alu[*l$index0++, --, B, in_addr]
+    alu[g_free_cnt, g_free_cnt, +, 1]
+    alu[--, g_free_cnt, -, NFD_OUT_PD_FREE_BATCH]
+    blo[hold_done#]
+
+    local_csr_wr[ACTIVE_LM_ADDR_0, g_free_lm]
+    move(ring, NFD_OUT_BLM_POOL_START)
+    alu[ring, ring, OR, g_free_ring]
+    immed[g_free_cnt, 0]
+
+    #define_eval _IDX 0
+    #while (_IDX < NFD_OUT_PD_FREE_BATCH)
+        alu[out_xfer[_IDX], --, B, *l$index0[_IDX]]
+        #define_eval _IDX (_IDX + 1)
+    #endloop
+    #undef _IDX
+
+    mem[journal, out_xfer[0], g_blm_addr_hi, <<8, ring, NFD_OUT_PD_FREE_BATCH], ctx_swap[free_sig]
+
+hold_done#:
+
+.end
+#endm
+#endif
+
+
 /**
  * Issue the DMAs required to send a packet to a host buffer.  The parameters
  * for transmission are specified in 'in_work'.  The macro is given two
@@ -402,6 +580,9 @@
     .io_completed in_work[2]
     .io_completed in_work[3]
     .io_completed in_work[4]
+#ifdef NFD_OUT_STRIDE_RX
+    .io_completed in_work[SB_WQ_RXD_W1_wrd]
+#endif
     .io_completed out_dma0[0]
     .io_completed out_dma0[1]
     .io_completed out_dma0[2]
@@ -417,6 +598,10 @@
 start_packet_dma#:
     br_bset[*n$index, NFD_OUT_PD_RST_BIT, no_dma#]
     wsm_test_bit_clr(in_work, SB_WQ_ENABLED, no_dma#)
+#ifdef NFD_OUT_STRIDE_RX
+    br_bset[in_work[SB_WQ_STRIDE_wrd], SB_WQ_STRIDE_shf, stride_hdr#]
+stride_hdr_done#:
+#endif
     wsm_test_bit_clr(in_work, SB_WQ_CTM_ONLY, not_ctm_only#)
 
     // Super fast path
@@ -431,24 +616,23 @@ ctm_only#:
     alu[out_dma0[1], word, OR, (&dma_sig), <<PCIE_DMA_SIGNUM_shf]
 
     // Word 2
-    #if NFD_OUT_RX_OFFSET > 0
+    #if (NFD_OUT_RX_OFFSET > 0 || defined(NFD_OUT_HDR_SPLIT))
 
-        wsm_extract(tmp2, in_work, SB_WQ_METALEN)
-        alu[tmp, NFD_OUT_RX_OFFSET, -, tmp2]
+        _host_buf_offset(tmp, in_work)
         alu[out_dma0[2], tmp, +, in_work[SB_WQ_HOST_ADDR_LO_wrd]]
 
-    #else /* NFD_OUT_RX_OFFSET > 0 */
+    #else /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
 
         alu[out_dma0[2], --, B, in_work[SB_WQ_HOST_ADDR_LO_wrd]]
 
-    #endif /* NFD_OUT_RX_OFFSET > 0 */
+    #endif /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
 
     // Word 3
     alu[word, g_dma_word3_vals, +8, in_work[SB_WQ_HOST_ADDR_HI_wrd]], no_cc
-    #if NFD_OUT_RX_OFFSET > 0
+    #if (NFD_OUT_RX_OFFSET > 0 || defined(NFD_OUT_HDR_SPLIT))
         alu[word, word, +carry, 0]
         // FIXME: possibly carry past 40-bit address into traffic class?
-    #endif /* NFD_OUT_RX_OFFSET > 0 */
+    #endif /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
     wsm_extract(tmp, in_work,  SB_WQ_RID)
     sm_set_noclr(word, PCIE_DMA_RID, tmp)
 
@@ -471,25 +655,24 @@ not_ctm_only#:
     // Prepare data that is required for all further branches:
 
     // (1) the start address in host mem
-    #if NFD_OUT_RX_OFFSET > 0
+    #if (NFD_OUT_RX_OFFSET > 0 || defined(NFD_OUT_HDR_SPLIT))
 
-        wsm_extract(tmp2, in_work, SB_WQ_METALEN)
-        alu[tmp, NFD_OUT_RX_OFFSET, -, tmp2]
+        _host_buf_offset(tmp, in_work)
         alu[pcie_lo_start, tmp, +, in_work[SB_WQ_HOST_ADDR_LO_wrd]]
 
-    #else /* NFD_OUT_RX_OFFSET > 0 */
+    #else /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
 
         alu[pcie_lo_start, --, B, in_work[SB_WQ_HOST_ADDR_LO_wrd]]
 
-    #endif /* NFD_OUT_RX_OFFSET > 0 */
+    #endif /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
 
     // (2) the partial word 3 (pcie_hi_word).  Aside from the DMA length,
     // it is constant for all DMAs
     alu[pcie_hi_word, g_dma_word3_vals, +8, in_work[SB_WQ_HOST_ADDR_HI_wrd]], no_cc
-    #if NFD_OUT_RX_OFFSET > 0
+    #if (NFD_OUT_RX_OFFSET > 0 || defined(NFD_OUT_HDR_SPLIT))
         alu[pcie_hi_word, pcie_hi_word, +carry, 0]
         // FIXME: possibly carry past 40-bit address into traffic class?
-    #endif /* NFD_OUT_RX_OFFSET > 0 */
+    #endif /* NFD_OUT_RX_OFFSET > 0 || NFD_OUT_HDR_SPLIT */
 
     wsm_extract(tmp, in_work,  SB_WQ_RID)
     sm_set_noclr(pcie_hi_word, PCIE_DMA_RID, tmp)
@@ -512,6 +695,12 @@ ctm_and_mu_dma#:
     // critical, so we start with the work that is a priority for
     // those packets.
 
+#ifdef NFD_OUT_RX_SCATTER
+    // Segments of scattered packets past the first MU page are MU only
+    alu[tmp, SB_WQ_MU_PAGE_msk, AND, in_work[SB_WQ_MU_PAGE_wrd], >>SB_WQ_MU_PAGE_shf]
+    bne[mu_only_dma#]
+#endif
+
     // Compute how many bytes are in CTM from the split length
     // and starting offset
     move(tmp, 256)
@@ -663,6 +852,10 @@ mu_only_dma#:
     alu[mu_lo_start, --, b, in_work[3], <<11]
     wsm_extract(tmp, in_work,  SB_WQ_OFFSET)
     alu[mu_lo_start, mu_lo_start, +, tmp]
+#ifdef NFD_OUT_RX_SCATTER
+    alu[tmp, SB_WQ_MU_PAGE_msk, AND, in_work[SB_WQ_MU_PAGE_wrd], >>SB_WQ_MU_PAGE_shf]
+    alu[mu_lo_start, mu_lo_start, +, tmp, <<13]
+#endif
 
     // DMA0 Word 0
     move(out_dma0[0], mu_lo_start)
@@ -771,6 +964,48 @@ no_dma#:
     wait_br_next_state(in_wait_sig0, in_wait_sig1, LABEL)
 
 
+#ifdef NFD_OUT_STRIDE_RX
+stride_hdr#:
+    /*
+     * Packet in a stride buffer: DMA the copy of its RX descriptor, with
+     * a zero queue field, from the context's staging slot to the 8B in
+     * front of it first.  Wait for it so that the packet still has at
+     * most two DMAs in flight.
+     */
+    alu[out_dma1[0], in_work[4], AND~, SB_WQ_QNUM_msk, <<SB_WQ_QNUM_shf]
+    alu[out_dma1[1], --, B, in_work[SB_WQ_RXD_W1_wrd]]
+    mem[write, out_dma1[0], 0, g_stride_hdr_lo, 1], ctx_swap[dma_sig]
+
+    // Word 0 and 1: staging slot in CTM, direct access
+    alu[out_dma1[0], --, B, g_stride_hdr_lo]
+    alu[word, g_dma_word1_vals, OR, __ISLAND]
+    alu[out_dma1[1], word, OR, (&dma_sig), <<PCIE_DMA_SIGNUM_shf]
+
+    // Word 2 and 3: the host address less the descriptor, with borrow
+    ld_field_w_clr[tmp2, 0001, in_work[SB_WQ_HOST_ADDR_HI_wrd]]
+    move(tmp, -NFD_OUT_STRIDE_HDR_SZ)
+    alu[out_dma1[2], tmp, +, in_work[SB_WQ_HOST_ADDR_LO_wrd]]
+    alu[tmp2, tmp2, +carry, g_neg_one]
+    alu[word, g_dma_word3_vals, +8, tmp2]
+    wsm_extract(tmp, in_work, SB_WQ_RID)
+    sm_set_noclr(word, PCIE_DMA_RID, tmp)
+    move(len, (NFD_OUT_STRIDE_HDR_SZ - 1))
+    sm_set_noclr_to(out_dma1[3], word, PCIE_DMA_XLEN, len)
+
+    #pragma warning(disable:5117)
+    pcie[write_pci, out_dma1[0], g_pcie_addr_hi, <<8, g_pcie_addr_lo, 4]
+    #pragma warning(default:5117)
+
+    ctx_arb[dma_sig, g_reset_sig], ANY
+    .io_completed out_dma1[0]
+    .io_completed out_dma1[1]
+    .io_completed out_dma1[2]
+    .io_completed out_dma1[3]
+    br_!signal[dma_sig, no_dma#]
+    br[stride_hdr_done#]
+#endif
+
+
     // Exception targets
 ctm_only_not_flagged#:
     // We should only reach this point if the user did not flag
@@ -822,13 +1057,15 @@ add_wq_credits#:
  *                      After "completing" the DMA, this macro will
  *                      ask for more work from the work queue using
  *                      this signal.
+ * @param io_dma        Write transfer registers of the completed DMAs,
+ *                      idle until the next packet is issued on them.
  * @param LABEL         Label to branch to after receiving state
  *                      transition signals.
  * @param in_wait_sig0  First state transition signal.  Must be specified.
  * @param in_wait_sig0  Second state transition signal.  Can be '--'
  *                      indicating no signal.
  */
-#macro _complete_packet_dma(io_work, in_wq_sig, LABEL, in_wait_sig0, \
+#macro _complete_packet_dma(io_work, in_wq_sig, io_dma, LABEL, in_wait_sig0, \
                             in_wait_sig1)
 .begin
 
@@ -843,11 +1080,27 @@ add_wq_credits#:
 
     .reg $ticket
     .sig ticket_sig
+#ifdef NFD_OUT_STRIDE_RX
+    .reg $stride_cnt
+    .reg stride_tmp
+#endif
+#ifdef NFD_OUT_RX_SCATTER
+    .reg read $dma_done[2]
+    .xfer_order $dma_done
+    .reg tmp
+    .reg gen
+    .reg polls
+#endif
 
     wsm_extract(qnum, io_work, SB_WQ_QNUM)
     alu[bitmap_lo, g_bitmap_base, OR, qnum, <<4]
     alu[$ticket, g_seq_mask, AND, io_work[SB_WQ_SEQ_wrd], >>SB_WQ_SEQ_shf]
 
+#ifdef NFD_OUT_RX_SCATTER
+    br_bset[io_work[SB_WQ_SCATTER_wrd], SB_WQ_SCATTER_shf, scatter_seg#]
+
+scatter_free#:
+#endif
     wsm_extract(isl, io_work, SB_WQ_CTM_ISL)
 #ifndef NFD_OUT_ALWAYS_FREE_CTM
     beq[no_ctm_buffer#], defer[1]
@@ -864,6 +1117,10 @@ add_wq_credits#:
     mem[packet_free, --, addr_hi, <<8, addr_lo]
 
 no_ctm_buffer#:
+#ifdef NFD_OUT_STRIDE_RX
+    br_bset[io_work[SB_WQ_STRIDE_wrd], SB_WQ_STRIDE_shf, stride_pkt#]
+stride_release#:
+#endif
     mem[release_ticket, $ticket, 0, bitmap_lo, 1], sig_done[ticket_sig]
 
     ctx_arb[ticket_sig], defer[2]
@@ -871,10 +1128,42 @@ no_ctm_buffer#:
     alu[cntr_addr_lo, NFD_OUT_ATOMICS_DMA_DONE, OR, qnum, <<4]
 
     // Free the MU buffer
+#ifdef NFD_OUT_PD_FREE_BATCH
+    _hold_mu_buf(addr_lo, ring_num, io_dma)
+#else
     alu[-- , g_blm_iref, OR, ring_num, <<16]
     mem[fast_journal, --, g_blm_addr_hi, <<8, addr_lo], indirect_ref
+#endif
 
 ticket_ready#:
+#ifdef NFD_OUT_PD_DONE_BATCH
+    br=byte[$ticket, 0, TICKET_ERROR, ticket_error#]
+
+    /*
+     * Hold back the tickets released while the context completes
+     * packets for the same queue and add them to DMA_DONE together.
+     * DMA_DONE still only moves forward over released tickets, so
+     * cache_desc sends the RX descriptors in order.
+     */
+    alu[--, g_done_cntr, -, cntr_addr_lo]
+    beq[done_same_queue#]
+    alu[--, g_done_cnt, OR, 0]
+    beq[done_new_queue#]
+    _flush_dma_done()
+done_new_queue#:
+    alu[g_done_cntr, --, B, cntr_addr_lo]
+done_same_queue#:
+    alu[g_done_cnt, g_done_cnt, +, $ticket]
+
+    #if (streq('in_wait_sig1', '--'))
+        // No more DMAs in flight on this context, add what is held
+        beq[complete_done#]
+    #else
+        alu[--, g_done_cnt, -, NFD_OUT_PD_DONE_BATCH]
+        blo[complete_done#]
+    #endif
+    _flush_dma_done()
+#else
 #ifndef NFD_OUT_ADD_ZERO_TKT
     // XXX Minimise atomic OPs for ticket release add, at the expense of
     // cycles for test and branch taken
@@ -884,8 +1173,15 @@ ticket_ready#:
 
     alu[--, g_add_imm_iref, OR, $ticket, <<16]
     mem[add_imm, --, g_send_cntrs_addr_hi, <<8, cntr_addr_lo], indirect_ref
+#endif /* NFD_OUT_PD_DONE_BATCH */
 
 complete_done#:
+#ifdef NFD_OUT_PD_FREE_BATCH
+    #if (streq('in_wait_sig1', '--'))
+        // No more DMAs in flight on this context, free what is held
+        _flush_mu_bufs()
+    #endif
+#endif
     #pragma warning(disable:5009)
     pci_out_pd_request_work(io_work[0], in_wq_sig)
     #pragma warning(default:5009)
@@ -901,6 +1197,90 @@ ticket_error#:
     mem[release_ticket, $ticket, 0, bitmap_lo, 1], sig_done[ticket_sig]
     ctx_arb[ticket_sig], br[ticket_ready#]
 
+#ifdef NFD_OUT_STRIDE_RX
+stride_pkt#:
+    /*
+     * Packet in a stride buffer, count it on the completion counter of
+     * the buffer's slot.  SB takes the packet count off the counter when
+     * it closes the buffer, and whichever of the two brings the counter
+     * back to zero releases the slot, see _stride_close() in
+     * pci_out_sb.uc.
+     */
+    move(stride_tmp, (NFD_OUT_FL_BUFS_PER_QUEUE - 1))
+    alu[addr_lo, stride_tmp, AND, io_work[SB_WQ_SEQ_wrd], >>SB_WQ_SEQ_shf]
+    alu[addr_lo, addr_lo, OR, qnum, <<(log2(NFD_OUT_FL_BUFS_PER_QUEUE))]
+    move(stride_tmp, (nfd_out_stride_cnt/**/PCIE_ISL & 0xFFFFFFFF))
+    alu[addr_lo, stride_tmp, +, addr_lo, <<2]
+    move(addr_hi, ((nfd_out_stride_cnt/**/PCIE_ISL >> 8) & 0xFF000000))
+    immed[$stride_cnt, 1]
+    mem[test_add, $stride_cnt, addr_hi, <<8, addr_lo, 1], ctx_swap[ticket_sig]
+    alu[--, $stride_cnt, +, 1]
+    beq[stride_release#]
+
+    // More packets of the buffer to come, free the MU buffer only
+    wsm_extract(addr_lo, io_work, SB_WQ_MUBUF)
+#ifdef NFD_OUT_PD_FREE_BATCH
+    _hold_mu_buf(addr_lo, ring_num, io_dma)
+#else
+    alu[-- , g_blm_iref, OR, ring_num, <<16]
+    mem[fast_journal, --, g_blm_addr_hi, <<8, addr_lo], indirect_ref
+#endif
+#ifdef NFD_OUT_PD_DONE_BATCH
+    #if (streq('in_wait_sig1', '--'))
+        // No more DMAs in flight on this context, add what is held
+        alu[--, g_done_cnt, OR, 0]
+        beq[complete_done#]
+        _flush_dma_done()
+    #endif
+#endif
+    br[complete_done#]
+#endif
+
+#ifdef NFD_OUT_RX_SCATTER
+scatter_seg#:
+    /*
+     * Segment of a packet scattered over several FL buffers.  All the
+     * segments DMA from the same NFP buffers, so only the last segment
+     * frees them, once the DMAs of the earlier segments are done.  The
+     * earlier segments have the preceding sequence numbers, so they are
+     * done when DMA_DONE for the queue reaches the sequence number of
+     * the last segment.
+     */
+    br_bclr[io_work[SB_WQ_EOP_wrd], SB_WQ_EOP_shf, scatter_more#], defer[1]
+    alu[cntr_addr_lo, NFD_OUT_ATOMICS_DMA_DONE, OR, qnum, <<4]
+
+    wsm_extract(seq, io_work, SB_WQ_SEQ)
+
+scatter_wait#:
+    /*
+     * DMA_DONE never gets there if the queue is reset meanwhile, which
+     * advances the generation that follows it in the atomics.  Give up
+     * then, on a PCIe reset, or after NFD_OUT_PD_SCATTER_POLLS polls, and
+     * free the buffers for a ring the host has dropped.
+     */
+    mem[atomic_read, $dma_done[0], g_send_cntrs_addr_hi, <<8, cntr_addr_lo, 2], ctx_swap[ticket_sig]
+    alu[gen, --, B, $dma_done[1]]
+    immed[polls, NFD_OUT_PD_SCATTER_POLLS]
+
+scatter_poll#:
+    alu[tmp, seq, -, $dma_done[0]]
+    alu[--, tmp, AND, g_seq_mask]
+    beq[scatter_free#]
+    alu[--, gen, -, $dma_done[1]]
+    bne[scatter_free#]
+    br_bset[*n$index, NFD_OUT_PD_RST_BIT, scatter_free#]
+    alu[polls, polls, -, 1]
+    beq[scatter_free#]
+    cycle32_sleep(64)
+    mem[atomic_read, $dma_done[0], g_send_cntrs_addr_hi, <<8, cntr_addr_lo, 2], ctx_swap[ticket_sig]
+    br[scatter_poll#]
+
+scatter_more#:
+    // More segments follow, release the ticket only
+    mem[release_ticket, $ticket, 0, bitmap_lo, 1], sig_done[ticket_sig]
+    ctx_arb[ticket_sig], br[ticket_ready#]
+#endif
+
 .end
 #endm
 
@@ -930,6 +1310,7 @@ ticket_error#:
 
     _complete_packet_dma($work_in/**/XNUM,
                          work_sig/**/XNUM,
+                         $dma_out/**/XNUM,
                         LABEL,
                         wsig0,
                         wsig1)
@@ -974,13 +1355,14 @@ ticket_error#:
      *
      * We lose some small amount of hardware supported latency hiding
      * ability per thread in exchange for more latency hiding overall and
-     * much more CPU power available.
+     * much more CPU power available.  NFD_OUT_PD_CTXS generalises this
+     * to NFD_OUT_PD_MES MEs.
      */
-    #ifdef NFD_OUT_3_PD_MES
-        .if (ctx() == 7)
+    #if (NFD_OUT_PD_CTXS < 8)
+        .if (ctx() >= NFD_OUT_PD_CTXS)
             ctx_arb[kill]
         .endif
-    #endif /* NFD_OUT_3_PD_MES */
+    #endif /* NFD_OUT_PD_CTXS < 8 */
 
 #endm
 
@@ -1011,6 +1393,18 @@ main#:
     .reg volatile g_dma_max
     .reg volatile g_num_ticket_errors
     .reg volatile g_neg_one
+#ifdef NFD_OUT_STRIDE_RX
+    .reg volatile g_stride_hdr_lo
+#endif
+#ifdef NFD_OUT_PD_FREE_BATCH
+    .reg volatile g_free_lm
+    .reg volatile g_free_cnt
+    .reg volatile g_free_ring
+#endif
+#ifdef NFD_OUT_PD_DONE_BATCH
+    .reg volatile g_done_cnt
+    .reg volatile g_done_cntr
+#endif
 
     .reg @ndequeued
     .init @ndequeued SB_WQ_CREDIT_BATCH
@@ -1166,6 +1560,30 @@ main#:
     move(g_dma_max, PCIE_DMA_MAX_LEN)
     move(g_num_ticket_errors, 0)
     move(g_neg_one, -1)
+#ifdef NFD_OUT_STRIDE_RX
+    // Each context stages stride RX descriptors in its own slot of CTM
+    local_csr_rd[ACTIVE_CTX_STS]
+    immed[tmp, 0]
+    alu[tmp, tmp, AND, 7]
+    alu[tmp, tmp, OR, (__MEID & 0xf), <<3]
+    move(g_stride_hdr_lo, nfd_out_pd_stride_hdr/**/PCIE_ISL)
+    alu[g_stride_hdr_lo, g_stride_hdr_lo, +, tmp, <<(log2(NFD_OUT_STRIDE_HDR_SZ))]
+#endif
+#ifdef NFD_OUT_PD_FREE_BATCH
+    // Each context keeps its held MU buffers in its own slice of LM
+    local_csr_rd[ACTIVE_CTX_STS]
+    immed[tmp, 0]
+    alu[tmp, tmp, AND, 7]
+    move(g_free_lm, pd_free_lm)
+    alu[g_free_lm, g_free_lm, +, tmp, <<(log2(PCIE_DMA_SIZE_LW * 4))]
+    local_csr_wr[ACTIVE_LM_ADDR_0, g_free_lm]
+    move(g_free_cnt, 0)
+    move(g_free_ring, 0)
+#endif
+#ifdef NFD_OUT_PD_DONE_BATCH
+    move(g_done_cnt, 0)
+    move(g_done_cntr, 0)
+#endif
 
 
     /*
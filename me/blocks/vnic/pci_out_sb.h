@@ -20,22 +20,36 @@
 #ifndef __PCI_OUT_SB_H
 #define __PCI_OUT_SB_H
 
+#include "nfd_common.h"
+
 /*
  * Work queue descriptor (to Packet DMA MEs):
  *
  * Bit    3 3 2 2 2 2 2 2 2 2 2 2 1 1 1 1 1 1 1 1 1 1 0 0 0 0 0 0 0 0 0 0
  * -----\ 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
- * Word  +-+---------------+---------+-------------------+---------------+
- *    0  |E| Requester ID  | Unused  |   Sequence Num    | HostBuf[39:32]|
- *       +-+---------------+---------+-------------------+---------------+
+ * Word  +-+---------------+-+-----+-+-------------------+---------------+
+ *    0  |E| Requester ID  |H|MuPg |P|   Sequence Num    | HostBuf[39:32]|
+ *       +-+---------------+-+-----+-+-------------------+---------------+
  *    1  |                       Host Buffer [31:0]                      |
  *       +-----------+-+-----------------+---+-+-------------------------+
- *    2  |  CTM ISL  |C|  Packet Number  |SPL|0|     Starting Offset     |
+ *    2  |  CTM ISL  |C|  Packet Number  |SPL|S|     Starting Offset     |
  *       +-+---+-----+-+-----------------+---+-+-------------------------+
  *    3  |N|BLS|           MU Buffer Address [39:11]                     |
  *       +-+---+---------+---------------+-------------------------------+
  *    4  |D| Meta Length |  RX Queue     |           Data Length         |
  *       +-+-------------+---------------+-------------------------------+
+ *    5  |             VLAN              |             Flags             |
+ *       +-------------------------------+-------------------------------+
+ *
+ * H is set for packets to place with header split, see NFD_OUT_HDR_SPLIT.
+ * S, P and MuPg are only used with NFD_OUT_RX_SCATTER.  S is set on each
+ * segment of a packet scattered over several FL buffers and P on the last
+ * segment.  The segment starts (MuPg * 8K) + Starting Offset bytes into
+ * the packet buffers, so segments with a non-zero MuPg are taken from MU.
+ * With NFD_OUT_STRIDE_RX, P is set instead on packets placed in a stride
+ * of a shared host buffer.  Their sequence number is that of the slot of
+ * the buffer, and word 5 is only sent for them to complete the RX
+ * descriptor that PD copies to the head of the stride.
  */
 
 // Word 0
@@ -47,6 +61,22 @@
 #define SB_WQ_RID_wrd           0
 #define SB_WQ_RID_shf           23
 #define SB_WQ_RID_msk           0xFF
+#define SB_WQ_HDR_SPLIT_bf      0, 22, 22
+#define SB_WQ_HDR_SPLIT_wrd     0
+#define SB_WQ_HDR_SPLIT_shf     22
+#define SB_WQ_HDR_SPLIT_msk     0x1
+#define SB_WQ_MU_PAGE_bf        0, 21, 19
+#define SB_WQ_MU_PAGE_wrd       0
+#define SB_WQ_MU_PAGE_shf       19
+#define SB_WQ_MU_PAGE_msk       0x7
+#define SB_WQ_EOP_bf            0, 18, 18
+#define SB_WQ_EOP_wrd           0
+#define SB_WQ_EOP_shf           18
+#define SB_WQ_EOP_msk           0x1
+#define SB_WQ_STRIDE_bf         SB_WQ_EOP_bf
+#define SB_WQ_STRIDE_wrd        SB_WQ_EOP_wrd
+#define SB_WQ_STRIDE_shf        SB_WQ_EOP_shf
+#define SB_WQ_STRIDE_msk        SB_WQ_EOP_msk
 #define SB_WQ_SEQ_bf            0, 17, 8
 #define SB_WQ_SEQ_wrd           0
 #define SB_WQ_SEQ_shf           8
@@ -79,6 +109,10 @@
 #define SB_WQ_CTM_SPLIT_wrd     2
 #define SB_WQ_CTM_SPLIT_shf     14
 #define SB_WQ_CTM_SPLIT_msk     0x3
+#define SB_WQ_SCATTER_bf        2, 13, 13
+#define SB_WQ_SCATTER_wrd       2
+#define SB_WQ_SCATTER_shf       13
+#define SB_WQ_SCATTER_msk       0x1
 #define SB_WQ_OFFSET_bf         2, 12, 0
 #define SB_WQ_OFFSET_wrd        2
 #define SB_WQ_OFFSET_shf        0
@@ -116,8 +150,13 @@
 #define SB_WQ_DATALEN_shf       0
 #define SB_WQ_DATALEN_msk       0xFFFF
 
-#define SB_WQ_SIZE_LW           5
+// Word 5
+#define SB_WQ_RXD_W1_wrd        5
 
-#define SB_WQ_CREDIT_BATCH      64
+#ifdef NFD_OUT_STRIDE_RX
+#define SB_WQ_SIZE_LW           6
+#else
+#define SB_WQ_SIZE_LW           5
+#endif
 
 #endif /* __PCI_OUT_SB_H */
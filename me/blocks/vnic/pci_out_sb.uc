@@ -22,6 +22,7 @@
 
 #include <stdmac.uc>
 #include <aggregate.uc>
+#include <cycle.uc>
 
 #include "wsm.uc"
 #include "nfd_common.h"
@@ -56,9 +57,9 @@
  *
  * Bit    3 3 2 2 2 2 2 2 2 2 2 2 1 1 1 1 1 1 1 1 1 1 0 0 0 0 0 0 0 0 0 0
  * -----\ 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
- * Word  +-+---------------+---------+-------------------+---------------+
- *    0  |E| Requester ID  | Unused  |   Sequence Num    | HostBuf[39:32]|
- *       +-+---------------+---------+-------------------+---------------+
+ * Word  +-+---------------+-+-------+-------------------+---------------+
+ *    0  |E| Requester ID  |H|Unused |   Sequence Num    | HostBuf[39:32]|
+ *       +-+---------------+-+-------+-------------------+---------------+
  *    1  |                       Host Buffer [31:0]                      |
  *       +---------------------------------------------------------------+
  *    2  |  CTM ISL  |C|  Packet Number  |SPL|0|     Starting Offset     |
@@ -88,6 +89,7 @@
 
 
 #define NUM_IO_BLOCKS           5
+#define PCI_OUT_SB_PARK_SIG_NUM 12
 //#define PCI_OUT_SB_WQ_CREDIT_SIG_NUM       13
 #define PCI_OUT_SB_CFG_SIG_NUM  14
 #define ORDER_SIG_NUM           15
@@ -109,16 +111,39 @@
  * -----\ 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
  * Word  +-----------------------------------------------+---------------+
  *    0  |                 Sequence Number               |     Zero      |
- *       +---------------------------------------------+-+---------------+
- *    1  |                 Unused                      |E| Requester ID  |
- *       +---------------------------------------------+-+---------------+
+ *       +---------------+-+-+-+-+-------+-+-+-+-+-+-+-+-+---------------+
+ *    1  | Stride Buf Hi |U|K|B|R|StrIdx |U|T|L|V|C|H|S|E| Requester ID  |
+ *       +---------------+-+-+-+-+-------+-+-+-+-+-+-+-+-+---------------+
  *    2  |            RX desc cache address right shifted 8              |
  *       +---------------------------------------------------------------+
- *    3  |                            Unused                             |
+ *    3  |              Stride Buffer Lo / Scatter Offset                |
  *       +---------------------------------------------------------------+
  *
  * The sequence number is shifted over 8 to enabled optimized use of the
  * alu[.., +8, ..] instruction to add in the host buffer's high 8 bits.
+ * With NFD_OUT_FL_CACHE_ADAPTIVE, the low 5 bits of word 0 hold the log2
+ * of NFD_OUT_FL_BUFS_PER_QUEUE over the queue's FL cache depth instead of
+ * zero.
+ *
+ * S, T, StrIdx and the stride buffer address are only used with
+ * NFD_OUT_STRIDE_RX.  S is set if the host enabled striding RX on the
+ * vNIC, StrIdx is the next free stride in the open buffer (zero if no
+ * buffer is open), and the stride buffer is the host address of the open
+ * buffer.  The open buffer belongs to the slot before the sequence
+ * number.  T is set whenever a packet goes into the open buffer, and the
+ * manager closes buffers that go without a packet for an alarm period.
+ * H is set if the host enabled page aligned payloads on the vNIC
+ * (NFD_OUT_HDR_SPLIT).  C, V and L are only used with
+ * NFD_OUT_FL_SIZE_CLASS, which holds the spare buffer in the stride
+ * buffer fields.  C is set if the host enabled size classes on the vNIC,
+ * V if the spare is valid and L if the spare is a large buffer.  Word 1
+ * is shifted up by SB_WQ_RID_shf to build the work queue word 0, so bits
+ * above E must not be used for anything PD needs.  With NFD_OUT_RX_SCATTER,
+ * word 3 holds the offset in the packet buffers of the next segment of a
+ * scattered packet, or zero between packets.  R, B and K are only used with
+ * NFD_OUT_RX_RATE_LIMIT.  R is set if the host configured a rate for the
+ * queue, B if the queue holds packets back rather than dropping them and K
+ * if its tokens are packets rather than bytes.
  */
 
 #define LM_QSTATE_SEQ_bf        0, 31, 0
@@ -138,6 +163,67 @@
 #define LM_QSTATE_CACHE_ADDR_RS8_wrd 2
 #define LM_QSTATE_CACHE_ADDR_RS8_shf 0
 #define LM_QSTATE_CACHE_ADDR_RS8_msk 0xFFFFFFFF
+#define LM_QSTATE_STRIDE_EN_bf       1, 9, 9
+#define LM_QSTATE_STRIDE_EN_wrd      1
+#define LM_QSTATE_STRIDE_EN_shf      9
+#define LM_QSTATE_STRIDE_EN_msk      0x1
+#define LM_QSTATE_STRIDE_EN_bit      9
+#define LM_QSTATE_HDR_SPLIT_bf       1, 10, 10
+#define LM_QSTATE_HDR_SPLIT_wrd      1
+#define LM_QSTATE_HDR_SPLIT_shf      10
+#define LM_QSTATE_HDR_SPLIT_msk      0x1
+#define LM_QSTATE_HDR_SPLIT_bit      10
+#define LM_QSTATE_SC_EN_bf           1, 11, 11
+#define LM_QSTATE_SC_EN_wrd          1
+#define LM_QSTATE_SC_EN_shf          11
+#define LM_QSTATE_SC_EN_msk          0x1
+#define LM_QSTATE_SC_EN_bit          11
+#define LM_QSTATE_SPARE_bf           1, 12, 12
+#define LM_QSTATE_SPARE_wrd          1
+#define LM_QSTATE_SPARE_shf          12
+#define LM_QSTATE_SPARE_msk          0x1
+#define LM_QSTATE_SPARE_bit          12
+#define LM_QSTATE_SPARE_LARGE_bf     1, 13, 13
+#define LM_QSTATE_SPARE_LARGE_wrd    1
+#define LM_QSTATE_SPARE_LARGE_shf    13
+#define LM_QSTATE_SPARE_LARGE_msk    0x1
+#define LM_QSTATE_SPARE_LARGE_bit    13
+#define LM_QSTATE_STRIDE_T_bf        1, 14, 14
+#define LM_QSTATE_STRIDE_T_wrd       1
+#define LM_QSTATE_STRIDE_T_shf       14
+#define LM_QSTATE_STRIDE_T_msk       0x1
+#define LM_QSTATE_STRIDE_T_bit       14
+#define LM_QSTATE_STRIDE_IDX_bf      1, 19, 16
+#define LM_QSTATE_STRIDE_IDX_wrd     1
+#define LM_QSTATE_STRIDE_IDX_shf     16
+#define LM_QSTATE_STRIDE_IDX_msk     0xF
+#define LM_QSTATE_RL_EN_bf           1, 20, 20
+#define LM_QSTATE_RL_EN_wrd          1
+#define LM_QSTATE_RL_EN_shf          20
+#define LM_QSTATE_RL_EN_msk          0x1
+#define LM_QSTATE_RL_EN_bit          20
+#define LM_QSTATE_RL_HOLD_bf         1, 21, 21
+#define LM_QSTATE_RL_HOLD_wrd        1
+#define LM_QSTATE_RL_HOLD_shf        21
+#define LM_QSTATE_RL_HOLD_msk        0x1
+#define LM_QSTATE_RL_HOLD_bit        21
+#define LM_QSTATE_RL_PKTS_bf         1, 22, 22
+#define LM_QSTATE_RL_PKTS_wrd        1
+#define LM_QSTATE_RL_PKTS_shf        22
+#define LM_QSTATE_RL_PKTS_msk        0x1
+#define LM_QSTATE_RL_PKTS_bit        22
+#define LM_QSTATE_STRIDE_HI_bf       1, 31, 24
+#define LM_QSTATE_STRIDE_HI_wrd      1
+#define LM_QSTATE_STRIDE_HI_shf      24
+#define LM_QSTATE_STRIDE_HI_msk      0xFF
+#define LM_QSTATE_STRIDE_LO_bf       3, 31, 0
+#define LM_QSTATE_STRIDE_LO_wrd      3
+#define LM_QSTATE_STRIDE_LO_shf      0
+#define LM_QSTATE_STRIDE_LO_msk      0xFFFFFFFF
+#define LM_QSTATE_SPARE_HI_bf        LM_QSTATE_STRIDE_HI_bf
+#define LM_QSTATE_SPARE_HI_wrd       LM_QSTATE_STRIDE_HI_wrd
+#define LM_QSTATE_SPARE_HI_shf       LM_QSTATE_STRIDE_HI_shf
+#define LM_QSTATE_SPARE_HI_msk       LM_QSTATE_STRIDE_HI_msk
 
 #define LM_QSTATE_SIZE          16
 #define LM_QSTATE_SIZE_LW       (LM_QSTATE_SIZE / 4)
@@ -151,6 +237,39 @@
 #define LM_SEQ                  LM_QSTATE_PTR[LM_SEQ_wrd]
 #define LM_STATUS               LM_QSTATE_PTR[LM_STATUS_wrd]
 #define LM_CACHE_ADDR_RS8       LM_QSTATE_PTR[LM_CACHE_ADDR_RS8_wrd]
+#define LM_STRIDE_LO_wrd        3
+#define LM_STRIDE_LO            LM_QSTATE_PTR[LM_STRIDE_LO_wrd]
+#define LM_SPARE_LO             LM_STRIDE_LO
+#define LM_SCATTER_OFF          LM_STRIDE_LO
+
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_FL_SIZE_CLASS))
+#ifndef NFD_OUT_RX_OFFSET
+#warning "NFD_OUT_RX_OFFSET not defined: defaulting to NFP_NET_RX_OFFSET which is sub-optimal"
+#define NFD_OUT_RX_OFFSET NFP_NET_RX_OFFSET
+#endif /* NFD_OUT_RX_OFFSET */
+#endif
+
+#ifdef NFD_OUT_FL_SIZE_CLASS
+#if (NFD_OUT_RX_OFFSET >= NFD_OUT_FL_SMALL_SZ)
+#error "NFD_OUT_FL_SMALL_SZ must be larger than NFD_OUT_RX_OFFSET"
+#endif
+
+#if (PCIE_DESC_RX_SC_LARGE != 1)
+#error "PCIE_DESC_RX_SC_LARGE must be bit 0 for the class computation"
+#endif
+#endif /* NFD_OUT_FL_SIZE_CLASS */
+
+#ifdef NFD_OUT_STRIDE_RX
+#if ((NFD_OUT_RX_OFFSET + NFD_OUT_STRIDE_HDR_SZ) >= NFD_OUT_STRIDE_SZ)
+#error "NFD_OUT_STRIDE_SZ must be larger than NFD_OUT_RX_OFFSET plus the stride header"
+#endif
+
+#if (NFD_OUT_STRIDE_CNT > (LM_QSTATE_STRIDE_IDX_msk + 1))
+#error "NFD_OUT_STRIDE_CNT too large for the LM queue state"
+#endif
+
+#define NFD_OUT_STRIDE_SZ_lg2           (log2(NFD_OUT_STRIDE_SZ))
+#endif /* NFD_OUT_STRIDE_RX */
 
 #define LM_WQ_CREDIT_CSR        ACTIVE_LM_ADDR_1
 #define LM_WQ_CREDIT_PTR        *l$index1
@@ -159,11 +278,100 @@
 #define LM_DEBUG_CSR            ACTIVE_LM_ADDR_2
 #define LM_DEBUG_PTR            *l$index2
 
+#ifdef NFD_OUT_RX_RATE_LIMIT
+/*
+ * Token bucket per queue, see _rl_cfg() and _rl_refill().  The bucket may
+ * go into debt with hold, so the tokens are signed.  The burst is at most
+ * NFP_NET_CFG_RXR_RL_BURST_MASK, and for queues that hold the top byte of
+ * its word is the NFD_OUT_ATOMICS_GEN of the withheld credits.  The last
+ * word is the drop counter address in the CFG BAR for queues that drop,
+ * or the FL credits withheld from the app for queues that hold.
+ * LM_RL_CSR shares ACTIVE_LM_ADDR_2 with LM_DEBUG_CSR, which only
+ * dump_state() uses.
+ */
+#define LM_RL_SIZE              16
+#define LM_RL_CSR               ACTIVE_LM_ADDR_2
+#define LM_RL_PTR               *l$index2
+#define LM_RL_TOKENS            LM_RL_PTR[0]
+#define LM_RL_RATE              LM_RL_PTR[1]
+#define LM_RL_BURST             LM_RL_PTR[2]
+#define LM_RL_AUX               LM_RL_PTR[3]
+#define LM_RL_GEN_shf           24
+
+#if (NFP_NET_CFG_RXR_RL_BURST_MASK >> LM_RL_GEN_shf)
+#error "LM_RL_GEN_shf must be above NFP_NET_CFG_RXR_RL_BURST_MASK"
+#endif
+
+#if (LM_RL_SIZE != LM_QSTATE_SIZE)
+#error "LM_RL_SIZE must match LM_QSTATE_SIZE, workers index both with lma"
+#endif
+#endif
+
+#ifdef NFD_OUT_FL_SIZE_CLASS
+/*
+ * CFG BAR address of the NFP_NET_CFG_RXR_SC_DROPS counter per queue, see
+ * _sc_cfg().  LM_SC_CSR shares ACTIVE_LM_ADDR_2 with LM_DEBUG_CSR, which
+ * only dump_state() uses.
+ */
+#define LM_SC_CSR               ACTIVE_LM_ADDR_2
+#define LM_SC_DROPS             *l$index2
+#endif
+
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+/*
+ * Requests parked while the FL fetch for their slot is in flight, see
+ * process_request() and service_parked().  @sb_park_busy has a bit per
+ * entry in use.  Each entry holds:
+ *   word 0:    FL cache slot address, low bits
+ *   word 1:    FL cache slot address, high bits (LM_CACHE_ADDR_RS8)
+ *   word 2:    PD work queue word 0, without the FL descriptor
+ *   words 3-6: the request as read from the PCI.OUT input ring
+ *   word 7:    LM address of the queue state
+ */
+#ifndef NFD_OUT_SB_PARK_SLOTS
+#define NFD_OUT_SB_PARK_SLOTS   16
+#endif
+
+#if (NFD_OUT_SB_PARK_SLOTS < 1 || NFD_OUT_SB_PARK_SLOTS > 31)
+#error "NFD_OUT_SB_PARK_SLOTS must be from 1 to 31"
+#endif
+
+#define LM_PARK_SIZE            32
+#define LM_PARK_SIZE_lg2        (log2(LM_PARK_SIZE))
+#define LM_PARK_CSR             ACTIVE_LM_ADDR_3
+#define LM_PARK_PTR             *l$index3
+#define LM_PARK_ADDR_LO_wrd     0
+#define LM_PARK_ADDR_HI_wrd     1
+#define LM_PARK_WORD0_wrd       2
+#define LM_PARK_REQ_wrd         3
+#define LM_PARK_QSTATE_wrd      7
+
+#if ((LM_PARK_SIZE & (LM_PARK_SIZE - 1)) != 0 || \
+     (LM_PARK_QSTATE_wrd * 4) >= LM_PARK_SIZE || \
+     (LM_PARK_REQ_wrd + 4) > LM_PARK_QSTATE_wrd)
+#error "LM_PARK_SIZE does not hold a park entry"
+#endif
+
+// SB tells an unfetched slot by the DD bit, which FL descriptors leave clear
+#if (NFD_OUT_DD_shf != 31)
+#error "NFD_OUT_DD_shf must match the slot mark of _fl_cache_mark()"
+#endif
+#endif
+
 
 // LMEM data structures
 .alloc_mem sb_ctx_base lmem+0 me (LM_QSTATE_SIZE * NFD_OUT_MAX_QUEUES)
 .alloc_mem sb_wq_credits lmem me 4
 .alloc_mem sb_debug_snapshot lmem me (LM_QSTATE_SIZE * NFD_OUT_MAX_QUEUES)
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+.alloc_mem sb_park_base lmem me (LM_PARK_SIZE * NFD_OUT_SB_PARK_SLOTS)
+#endif
+#ifdef NFD_OUT_RX_RATE_LIMIT
+.alloc_mem sb_rl_base lmem me (LM_RL_SIZE * NFD_OUT_MAX_QUEUES)
+#endif
+#ifdef NFD_OUT_FL_SIZE_CLASS
+.alloc_mem sb_sc_base lmem me (4 * NFD_OUT_MAX_QUEUES)
+#endif
 
 #define_eval __LOOP 0
 #while (__LOOP < (LM_QSTATE_SIZE * NFD_OUT_MAX_QUEUES))
@@ -172,17 +380,59 @@
 #endloop
 
 
-// Input ring
+/*
+ * Input rings
+ *
+ * With NFD_OUT_RINGS > 1 each app ME sends on one of several input rings,
+ * see nfd_out_send_init().  Workers are dealt out to the rings in turn, so
+ * worker ctx serves ring (ctx - STAGE_BATCH_FIRST_WORKER) % NFD_OUT_RINGS,
+ * and the workers of each ring form their own ordering chain.  The order
+ * of requests on each ring is kept, and so is the RX descriptor order of
+ * the packets that an app ME sends to a queue.  Queue state that a worker
+ * updates across a swap is only safe within one chain, hence the options
+ * excluded below.
+ */
+#if (NFD_OUT_RINGS > STAGE_BATCH_NUM_WORKERS)
+#error "NFD_OUT_RINGS exceeds the number of stage batch workers"
+#endif
+
+#if (NFD_OUT_RINGS > 1)
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_FL_SIZE_CLASS) || \
+     defined(NFD_OUT_RX_SCATTER))
+#error "NFD_OUT_RINGS > 1 is incompatible with the selected FL options"
+#endif
+#endif
+
 #define_eval __EMEM 'NFD_PCIE/**/PCIE_ISL/**/_EMEM'
 .alloc_resource nfd_out_ring_num/**/PCIE_ISL/**/0 __EMEM/**/_queues global 1 1
 .alloc_mem nfd_out_ring_mem/**/PCIE_ISL __EMEM global NFD_OUT_RING_SZ NFD_OUT_RING_SZ
 .init_mu_ring nfd_out_ring_num/**/PCIE_ISL/**/0 nfd_out_ring_mem/**/PCIE_ISL
 
+// All input rings share the EMEM, so g_in_wq_hi is the same for each
+#define_eval __LOOP 1
+#while (__LOOP < NFD_OUT_RINGS)
+    .alloc_resource nfd_out_ring_num/**/PCIE_ISL/**/__LOOP __EMEM/**/_queues global 1 1
+    .alloc_mem nfd_out_ring_mem/**/PCIE_ISL/**/__LOOP __EMEM global \
+        NFD_OUT_RING_SZ NFD_OUT_RING_SZ
+    .init_mu_ring nfd_out_ring_num/**/PCIE_ISL/**/__LOOP \
+        nfd_out_ring_mem/**/PCIE_ISL/**/__LOOP
+    #define_eval __LOOP (__LOOP + 1)
+#endloop
+
 // Cache memory
-#define_eval NFD_OUT_CACHE_SIZE (NFD_OUT_FL_CACHE_SIZE_PER_QUEUE * NFD_OUT_MAX_QUEUES)
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+    #define_eval NFD_OUT_CACHE_SIZE (NFD_OUT_FL_CACHE_POOL_BUFS * NFD_OUT_FL_DESC_SIZE)
+#else
+    #define_eval NFD_OUT_CACHE_SIZE (NFD_OUT_FL_CACHE_SIZE_PER_QUEUE * NFD_OUT_MAX_QUEUES)
+#endif
 #define_eval NFD_OUT_CACHE_LOC 'NFD_PCIE/**/PCIE_ISL/**/_FL_CACHE_MEM'
 .alloc_mem fl_cache_mem/**/PCIE_ISL NFD_OUT_CACHE_LOC global NFD_OUT_CACHE_SIZE NFD_OUT_CACHE_SIZE
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+// Per queue FL cache regions, written by cache_desc
+.alloc_mem nfd_out_fl_cache_cfg/**/PCIE_ISL __EMEM global NFD_OUT_FL_CACHE_CFG_SZ 256
+#endif
+
 // Config rings
 .alloc_resource nfd_cfg_ring_nums NFD_CFG_RING_EMEM/**/_queues global 32
 .declare_resource nfd_cfg_ring_nums/**/PCIE_ISL global 8 nfd_cfg_ring_nums
@@ -223,7 +473,461 @@
 #endm
 
 
-#macro _set_queue_state(in_vid, in_q, in_up, in_rid)
+#ifdef NFD_OUT_STRIDE_RX
+
+// See NFP Databook Section 9.2.2.1.2.10 "TicketRelease Command"
+#define TICKET_ERROR                    255
+
+/**
+ * Close the open stride buffer of a queue.  LM_QSTATE_CSR must point at
+ * the queue state, and StrIdx must already be cleared.
+ *
+ * @param in_qid        Queue of the buffer
+ * @param in_seq        LM_SEQ of the slot that holds the buffer
+ * @param in_cnt        Number of packets in the buffer
+ *
+ * The RX descriptor of the slot reports the packet count to the host.
+ * The slot is released by whichever of this macro and PD finishes with
+ * the buffer last.  PD adds one to the completion counter of the slot
+ * for each packet it has DMAed and this macro adds minus the count, so
+ * the counter is back at zero for the next use of the slot.
+ */
+#macro _stride_close(in_qid, in_seq, in_cnt)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg tmp
+
+    .reg write $rxd[2]
+    .xfer_order $rxd
+    .reg $cnt
+    .reg $ticket
+
+    .sig close_sig
+
+    move(tmp, (NFD_OUT_DD_msk << NFD_OUT_DD_shf))
+    alu[$rxd[0], tmp, OR, in_cnt, <<PCIE_DESC_RX_STRIDE_shf]
+    immed[$rxd[1], 0]
+
+    move(tmp, ((NFD_OUT_FL_BUFS_PER_QUEUE - 1) << NFD_OUT_FL_DESC_SIZE_lg2))
+    #ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+        alu[--, in_seq, OR, 0]
+        alu[tmp, --, B, tmp, >>indirect]
+    #endif
+    alu[addr_lo, tmp, AND, in_seq, >>(SB_WQ_SEQ_shf - NFD_OUT_FL_DESC_SIZE_lg2)]
+    mem[write, $rxd[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], ctx_swap[close_sig]
+
+    move(tmp, (NFD_OUT_FL_BUFS_PER_QUEUE - 1))
+    alu[addr_lo, tmp, AND, in_seq, >>SB_WQ_SEQ_shf]
+    alu[addr_lo, addr_lo, OR, in_qid, <<(log2(NFD_OUT_FL_BUFS_PER_QUEUE))]
+    move(tmp, (nfd_out_stride_cnt/**/PCIE_ISL & 0xFFFFFFFF))
+    alu[addr_lo, tmp, +, addr_lo, <<2]
+    move(addr_hi, ((nfd_out_stride_cnt/**/PCIE_ISL >> 8) & 0xFF000000))
+    alu[$cnt, 0, -, in_cnt]
+    mem[test_add, $cnt, addr_hi, <<8, addr_lo, 1], ctx_swap[close_sig]
+    alu[--, $cnt, -, in_cnt]
+    bne[close_done#]
+
+    // All packets are DMAed, release the slot as PD does
+    move(addr_hi, (nfd_out_sb_release/**/PCIE_ISL >> 8))
+    alu[addr_lo, --, B, in_qid, <<4]
+    move(tmp, SB_WQ_SEQ_msk)
+    alu[$ticket, tmp, AND, in_seq, >>SB_WQ_SEQ_shf]
+    mem[release_ticket, $ticket, addr_hi, <<8, addr_lo, 1], ctx_swap[close_sig]
+    br=byte[$ticket, 0, 0, close_done#]
+    br=byte[$ticket, 0, TICKET_ERROR, close_done#]
+
+    move(addr_hi, (((PCIE_ISL + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+    alu[addr_lo, NFD_OUT_ATOMICS_DMA_DONE, OR, in_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+    alu[$cnt, --, B, $ticket]
+    mem[add, $cnt, addr_hi, <<8, addr_lo, 1], ctx_swap[close_sig]
+
+close_done#:
+
+.end
+#endm
+
+
+/**
+ * Close the stride buffers that got no packet since the last call, so
+ * that the packets in them reach the host once the queue goes quiet.
+ */
+#macro _stride_flush()
+.begin
+
+    .reg qid
+    .reg lma
+    .reg cnt
+    .reg seq
+
+    immed[qid, 0]
+    .while (qid < NFD_OUT_MAX_QUEUES)
+
+        alu[lma, --, B, qid, <<LM_QSTATE_SIZE_lg2]
+        local_csr_wr[LM_QSTATE_CSR, lma]
+        nop
+        nop
+        nop
+
+        alu[cnt, LM_QSTATE_STRIDE_IDX_msk, AND, LM_STATUS, >>LM_QSTATE_STRIDE_IDX_shf]
+        .if (cnt != 0)
+
+            .if (BIT(LM_STATUS, LM_QSTATE_STRIDE_T_bit))
+                alu[LM_STATUS, LM_STATUS, AND~, 1, <<LM_QSTATE_STRIDE_T_shf]
+            .else
+                alu[LM_STATUS, LM_STATUS, AND~, LM_QSTATE_STRIDE_IDX_msk, <<LM_QSTATE_STRIDE_IDX_shf]
+                move(seq, (1 << SB_WQ_SEQ_shf))
+                alu[seq, LM_SEQ, -, seq]
+                _stride_close(qid, seq, cnt)
+            .endif
+
+        .endif
+
+        alu[qid, qid, +, 1]
+
+    .endw
+
+.end
+#endm
+
+#endif /* NFD_OUT_STRIDE_RX */
+
+
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+/**
+ * Load the FL cache region of a queue from nfd_out_fl_cache_cfg.  The
+ * region offset is added into the cache address, and the depth shift
+ * goes in the low bits of the sequence number word, see process_request.
+ * LM_QSTATE_CSR must point at the queue state.
+ */
+#macro _load_cache_region(in_qid)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg base_addr
+    .reg tmp
+
+    .reg read $region
+
+    .sig region_sig
+
+    move(addr_hi, (nfd_out_fl_cache_cfg/**/PCIE_ISL >> 8))
+    alu[addr_lo, --, B, in_qid, <<2]
+    mem[read32, $region, addr_hi, <<8, addr_lo, 1], ctx_swap[region_sig]
+
+    move(base_addr, (fl_cache_mem/**/PCIE_ISL >> 8))
+    alu[tmp, --, B, $region, >>8]
+    alu[LM_CACHE_ADDR_RS8, base_addr, +, tmp]
+    alu[tmp, $region, AND, NFD_OUT_FL_CACHE_CFG_SHF_msk]
+    alu[LM_SEQ, LM_SEQ, AND~, 0xFF]
+    alu[LM_SEQ, LM_SEQ, OR, tmp]
+
+.end
+#endm
+
+
+/**
+ * Load the region of a resized queue posted to the nfd_out_fl_cache_cfg
+ * mailbox, then clear the mailbox to let cache_desc resume fetching for
+ * the queue.  The queue has nothing cached while the mailbox is set, so
+ * no worker can be using its state.
+ */
+#macro _check_cache_resize()
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg qid
+    .reg lma
+
+    .reg read $mbox
+    .reg write $clear
+
+    .sig mbox_sig
+
+    move(addr_hi, (nfd_out_fl_cache_cfg/**/PCIE_ISL >> 8))
+    move(addr_lo, NFD_OUT_FL_CACHE_CFG_MBOX_OFF)
+    mem[read32, $mbox, addr_hi, <<8, addr_lo, 1], ctx_swap[mbox_sig]
+
+    alu[qid, --, B, $mbox]
+    .if (qid != 0)
+
+        alu[qid, qid, -, 1]
+        alu[lma, --, B, qid, <<LM_QSTATE_SIZE_lg2]
+        local_csr_wr[LM_QSTATE_CSR, lma]
+        nop
+        nop
+        nop
+        _load_cache_region(qid)
+
+        move($clear, 0)
+        mem[write32, $clear, addr_hi, <<8, addr_lo, 1], ctx_swap[mbox_sig]
+
+    .endif
+
+.end
+#endm
+#endif
+
+
+#ifdef NFD_OUT_RX_RATE_LIMIT
+/**
+ * Compare the low byte of the queue's NFD_OUT_ATOMICS_GEN with the
+ * generation of the withheld credits.  Returns zero if they match.
+ * LM_RL_CSR must point at the token bucket of the queue.
+ */
+#macro _rl_gen_cmp(out_diff, out_gen, in_addr_hi, in_qid)
+.begin
+
+    .reg addr_lo
+    .reg $gen
+    .sig gen_sig
+
+    alu[addr_lo, NFD_OUT_ATOMICS_GEN, OR, in_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+    mem[read32, $gen, in_addr_hi, <<8, addr_lo, 1], ctx_swap[gen_sig]
+    alu[out_gen, --, B, $gen, <<LM_RL_GEN_shf]
+    alu[out_diff, out_gen, XOR, LM_RL_BURST]
+    alu[out_diff, --, B, out_diff, >>LM_RL_GEN_shf]
+
+.end
+#endm
+
+
+/**
+ * Give the FL credits withheld from the app back to the queue, unless the
+ * queue was reset since they were withheld.  LM_RL_CSR must point at the
+ * token bucket of the queue.
+ */
+#macro _rl_release(in_qid)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg diff
+    .reg gen
+    .reg $credits
+    .sig credit_sig
+
+    move(addr_hi, (((PCIE_ISL + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+    _rl_gen_cmp(diff, gen, addr_hi, in_qid)
+    alu[$credits, --, B, LM_RL_AUX]
+    move(LM_RL_AUX, 0)
+    .if (diff == 0)
+        alu[addr_lo, NFD_OUT_ATOMICS_CREDIT, OR, in_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+        mem[add, $credits, addr_hi, <<8, addr_lo, 1], ctx_swap[credit_sig]
+    .endif
+
+.end
+#endm
+
+
+/**
+ * Take all FL credits of a queue away from the app, so that it holds its
+ * packets back.  Credits withheld before a reset of the queue are
+ * dropped.  NFD_OUT_ATOMICS_GEN is read before the credits are taken, so
+ * a reset in between can only make _rl_release() drop credits, never
+ * return stale ones.  LM_RL_CSR must point at the token bucket of the
+ * queue.
+ */
+#macro _rl_withhold(in_qid)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg diff
+    .reg gen
+    .reg $credits
+    .sig credit_sig
+
+    move(addr_hi, (((PCIE_ISL + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+    _rl_gen_cmp(diff, gen, addr_hi, in_qid)
+    alu[addr_lo, NFD_OUT_ATOMICS_CREDIT, OR, in_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+    move($credits, 0xFFFFFFFF)
+    mem[test_and_clr, $credits, addr_hi, <<8, addr_lo, 1], ctx_swap[credit_sig]
+    .if (diff != 0)
+        move(LM_RL_AUX, 0)
+        move(diff, NFP_NET_CFG_RXR_RL_BURST_MASK)
+        alu[diff, diff, AND, LM_RL_BURST]
+        alu[LM_RL_BURST, diff, OR, gen]
+    .endif
+    alu[LM_RL_AUX, LM_RL_AUX, +, $credits]
+
+.end
+#endm
+
+
+/**
+ * Load the rate limit of a queue from the CFG BAR.  Queues that stay up
+ * keep their tokens, queues that come up start with a full bucket.
+ * Queues of vNICs without NFP_NET_CFG_CTRL_RXRLDROP set in "in_ctrl"
+ * hold rather than drop.  LM_QSTATE_CSR must point at the queue state.
+ */
+#macro _rl_cfg(in_vid, in_q, in_qid, in_up, in_was_up, in_ctrl)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg drop
+    .reg lma
+    .reg tmp
+
+    .reg read $rl[2]
+    .xfer_order $rl
+
+    .sig rl_sig
+
+    immed[lma, sb_rl_base]
+    alu[lma, lma, +, in_qid, <<(log2(LM_RL_SIZE))]
+    local_csr_wr[LM_RL_CSR, lma]
+    nop
+    nop
+    nop
+
+    // Credits held from the app are stale once the queue went down
+    .if (BIT(LM_STATUS, LM_QSTATE_RL_HOLD_bit))
+        .if (in_up != 0)
+            _rl_release(in_qid)
+        .endif
+    .endif
+    move(LM_RL_AUX, 0)
+    alu[LM_STATUS, LM_STATUS, AND~, 7, <<LM_QSTATE_RL_EN_shf]
+
+    .if (in_up != 0)
+
+        nfd_cfg_get_bar_addr(addr_hi, addr_lo, in_vid, PCIE_ISL)
+        alu[tmp, --, B, in_q, <<3]
+        alu[addr_lo, addr_lo, +, tmp]
+        move(tmp, NFP_NET_CFG_RXR_RL_BASE)
+        alu[addr_lo, addr_lo, +, tmp]
+        mem[read32, $rl[0], addr_hi, <<8, addr_lo, 2], ctx_swap[rl_sig]
+
+        .if ($rl[0] != 0)
+
+            alu[LM_RL_RATE, --, B, $rl[0]]
+            move(tmp, NFP_NET_CFG_RXR_RL_BURST_MASK)
+            alu[tmp, tmp, AND, $rl[1]]
+            alu[LM_RL_BURST, --, B, tmp]
+            .if (in_was_up == 0)
+                alu[LM_RL_TOKENS, --, B, tmp]
+            .endif
+
+            // Flags go to R, B and K, in that order
+            #if ((NFP_NET_CFG_RXR_RL_HOLD != (1 << 30)) || \
+                 (NFP_NET_CFG_RXR_RL_PKTS != (1 << 31)))
+                #error "Unexpected NFP_NET_CFG_RXR_RL flags"
+            #endif
+            alu[tmp, --, B, $rl[1], >>30]
+            alu[drop, 1, AND, in_ctrl, >>(log2(NFP_NET_CFG_CTRL_RXRLDROP))]
+            .if (drop == 0)
+                alu[tmp, tmp, OR, 1]
+            .endif
+            .if (BIT(tmp, 0) == 0)
+                move(tmp, (NFP_NET_CFG_RXR_RL_DROPS(0) - NFP_NET_CFG_RXR_RL_BASE))
+                alu[LM_RL_AUX, addr_lo, +, tmp]
+                alu[tmp, --, B, $rl[1], >>30]
+            .endif
+            alu[tmp, 1, OR, tmp, <<1]
+            alu[LM_STATUS, LM_STATUS, OR, tmp, <<LM_QSTATE_RL_EN_shf]
+
+        .endif
+
+    .endif
+
+.end
+#endm
+
+
+/**
+ * Add a period worth of tokens to the bucket of each rate limited queue,
+ * up to its burst.  Queues that hold get their FL credits taken away while
+ * their bucket is in debt and given back once it is not.
+ */
+#macro _rl_refill()
+.begin
+
+    .reg qid
+    .reg lma
+    .reg tokens
+    .reg burst
+
+    move(qid, 0)
+    .while (qid < NFD_OUT_MAX_QUEUES)
+
+        alu[lma, --, B, qid, <<LM_QSTATE_SIZE_lg2]
+        local_csr_wr[LM_QSTATE_CSR, lma]
+        immed[tokens, sb_rl_base]
+        alu[lma, tokens, +, lma]
+        local_csr_wr[LM_RL_CSR, lma]
+        nop
+        nop
+        nop
+
+        .if (BIT(LM_STATUS, LM_QSTATE_RL_EN_bit))
+
+            // Tokens are signed, compare with the burst by subtraction
+            alu[tokens, --, B, LM_RL_RATE]
+            alu[tokens, tokens, +, LM_RL_TOKENS]
+            move(burst, NFP_NET_CFG_RXR_RL_BURST_MASK)
+            alu[burst, burst, AND, LM_RL_BURST]
+            alu[--, burst, -, tokens]
+            bge[rl_capped#]
+            alu[tokens, --, B, burst]
+        rl_capped#:
+            alu[LM_RL_TOKENS, --, B, tokens]
+
+            .if (BIT(LM_STATUS, LM_QSTATE_RL_HOLD_bit))
+                .if (BIT(tokens, 31))
+                    _rl_withhold(qid)
+                .elif (LM_RL_AUX != 0)
+                    _rl_release(qid)
+                .endif
+            .endif
+
+        .endif
+
+        alu[qid, qid, +, 1]
+
+    .endw
+
+.end
+#endm
+#endif /* NFD_OUT_RX_RATE_LIMIT */
+
+
+#ifdef NFD_OUT_FL_SIZE_CLASS
+/**
+ * Record where the size class drops of a queue are counted
+ *
+ * @param in_vid        vNIC of the queue
+ * @param in_q          Queue number within the vNIC
+ * @param in_qid        Queue number
+ */
+#macro _sc_cfg(in_vid, in_q, in_qid)
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg lma
+    .reg tmp
+
+    immed[lma, sb_sc_base]
+    alu[lma, lma, +, in_qid, <<2]
+    local_csr_wr[LM_SC_CSR, lma]
+
+    nfd_cfg_get_bar_addr(addr_hi, addr_lo, in_vid, PCIE_ISL)
+    alu[tmp, --, B, in_q, <<3]
+    alu[addr_lo, addr_lo, +, tmp]
+    move(tmp, NFP_NET_CFG_RXR_SC_DROPS(0))
+    alu[LM_SC_DROPS, addr_lo, +, tmp]
+
+.end
+#endm
+#endif
+
+
+#macro _set_queue_state(in_vid, in_q, in_up, in_rid, in_ctrl)
 .begin
 
     .reg qid
@@ -252,20 +956,67 @@
             wsm_set(LM_QSTATE, LM_QSTATE_ENABLED, 1)
             move(LM_SEQ, 0)
             // Precomputation to save cycles later
-            move(base_addr, (fl_cache_mem/**/PCIE_ISL >> 8))
-            alu[LM_CACHE_ADDR_RS8, base_addr, OR, qid, <<(NFD_OUT_FL_CACHE_SIZE_PER_QUEUE_lg2 - 8)]
+            #ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+                _load_cache_region(qid)
+            #else
+                move(base_addr, (fl_cache_mem/**/PCIE_ISL >> 8))
+                alu[LM_CACHE_ADDR_RS8, base_addr, OR, qid, <<(NFD_OUT_FL_CACHE_SIZE_PER_QUEUE_lg2 - 8)]
+            #endif
+            #ifdef NFD_OUT_STRIDE_RX
+                // Start without an open stride buffer
+                alu[tmp, 1, AND, in_ctrl, >>(log2(NFP_NET_CFG_CTRL_RXSTRIDE))]
+                wsm_clear(LM_QSTATE, LM_QSTATE_STRIDE_IDX)
+                wsm_clear(LM_QSTATE, LM_QSTATE_STRIDE_T)
+                wsm_set(LM_QSTATE, LM_QSTATE_STRIDE_EN, tmp)
+            #endif
+            #ifdef NFD_OUT_HDR_SPLIT
+                alu[tmp, 1, AND, in_ctrl, >>(log2(NFP_NET_CFG_CTRL_RXPAYALIGN))]
+                wsm_set(LM_QSTATE, LM_QSTATE_HDR_SPLIT, tmp)
+            #endif
+            #ifdef NFD_OUT_FL_SIZE_CLASS
+                // Start without a spare buffer
+                alu[tmp, 1, AND, in_ctrl, >>(log2(NFP_NET_CFG_CTRL_RXSIZECLASS))]
+                wsm_clear(LM_QSTATE, LM_QSTATE_SPARE)
+                wsm_set(LM_QSTATE, LM_QSTATE_SC_EN, tmp)
+                _sc_cfg(in_vid, in_q, qid)
+            #endif
+            #ifdef NFD_OUT_RX_SCATTER
+                move(LM_SCATTER_OFF, 0)
+            #endif
             _reset_ticket_bitmap(qid)
 
         .else
 
+            #ifdef NFD_OUT_STRIDE_RX
+                // Close the open buffer so that its slot counter settles
+                wsm_clear(LM_QSTATE, LM_QSTATE_STRIDE_EN)
+                alu[tmp, LM_QSTATE_STRIDE_IDX_msk, AND, LM_STATUS, >>LM_QSTATE_STRIDE_IDX_shf]
+                .if (tmp != 0)
+                    wsm_clear(LM_QSTATE, LM_QSTATE_STRIDE_IDX)
+                    move(base_addr, (1 << SB_WQ_SEQ_shf))
+                    alu[base_addr, LM_SEQ, -, base_addr]
+                    _stride_close(qid, base_addr, tmp)
+                .endif
+            #endif
             wsm_clear(LM_QSTATE, LM_QSTATE_RID)
             wsm_clear(LM_QSTATE, LM_QSTATE_ENABLED)
+            #ifdef NFD_OUT_HDR_SPLIT
+                wsm_clear(LM_QSTATE, LM_QSTATE_HDR_SPLIT)
+            #endif
+            #ifdef NFD_OUT_FL_SIZE_CLASS
+                wsm_clear(LM_QSTATE, LM_QSTATE_SC_EN)
+            #endif
 
         .endif
 
 
     .endif
 
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        // Rates may change on any ring update
+        _rl_cfg(in_vid, in_q, qid, in_up, currently_up, in_ctrl)
+    #endif
+
 .end
 #endm
 
@@ -279,9 +1030,11 @@
     .reg up
     .reg maxqs
     .reg rid
+    .reg ctrl
 
     .reg read $bar[6]
     .xfer_order $bar
+    .reg read $ctrl1
 
     .sig read_sig
 
@@ -313,16 +1066,22 @@
     .if (($bar[NFP_NET_CFG_CTRL] & NFP_NET_CFG_CTRL_ENABLE) == 0)
 
         move(up, 0)
+        move(ctrl, 0)
         move(q, 0)
         .while (q < maxqs)
 
-            _set_queue_state(in_vid, q, up, rid)
+            _set_queue_state(in_vid, q, up, rid, ctrl)
             alu[q, q, +, 1]
 
         .endw
 
     .else
 
+        // RX features enabled per vNIC
+        alu[ctrl, bar_addr_lo, +, NFP_NET_CFG_CTRL_WORD1]
+        mem[read32, $ctrl1, bar_addr_hi, <<8, ctrl, 1], ctx_swap[read_sig]
+        alu[ctrl, --, B, $ctrl1]
+
         move(q, 0)
         .while (q < maxqs)
 
@@ -338,7 +1097,7 @@
 
             .endif
 
-            _set_queue_state(in_vid, q, up, rid)
+            _set_queue_state(in_vid, q, up, rid, ctrl)
             alu[q, q, +, 1]
 
         .endw
@@ -540,6 +1299,95 @@ copy_loop#:
 #endm
 
 
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+/**
+ * Complete the requests that workers parked while the FL fetch for their
+ * slot was in flight, see process_request.  Entries whose slot is still
+ * not fetched are left parked unless their queue went down, in which case
+ * the request is passed to PD with the enabled bit clear so that the
+ * packet is dropped.  The SB to PD work queue credit was taken by the
+ * worker that parked the request.
+ */
+#macro service_parked()
+.begin
+
+    .reg addr_hi
+    .reg addr_lo
+    .reg busy
+    .reg idx
+    .reg lma
+    .reg word0
+
+    .reg read $fl[2]
+    .xfer_order $fl
+    .reg write $rx[2]
+    .xfer_order $rx
+    .reg write $wq[SB_WQ_SIZE_LW]
+    .xfer_order $wq
+
+    .sig fl_sig
+    .sig rx_sig
+    .sig wq_sig
+
+    // Workers may park more while this context swaps, take a snapshot
+    alu[busy, --, B, @sb_park_busy]
+
+    .while (busy != 0)
+
+        ffs[idx, busy]
+        alu[--, idx, OR, 0]
+        alu[busy, busy, AND~, 1, <<indirect]
+        immed[lma, sb_park_base]
+        alu[lma, lma, +, idx, <<LM_PARK_SIZE_lg2]
+        local_csr_wr[LM_PARK_CSR, lma]
+        nop
+        nop
+        nop
+
+        alu[addr_lo, --, B, LM_PARK_PTR[LM_PARK_ADDR_LO_wrd]]
+        alu[addr_hi, --, B, LM_PARK_PTR[LM_PARK_ADDR_HI_wrd]]
+        alu[word0, --, B, LM_PARK_PTR[LM_PARK_WORD0_wrd]]
+        mem[read, $fl[0], addr_hi, <<8, addr_lo, 1], ctx_swap[fl_sig]
+
+        .if (BIT($fl[0], NFD_OUT_DD_shf))
+
+            alu[lma, --, B, LM_PARK_PTR[LM_PARK_QSTATE_wrd]]
+            local_csr_wr[LM_QSTATE_CSR, lma]
+            nop
+            nop
+            nop
+            .if (BIT(LM_STATUS, LM_QSTATE_ENABLED_bit))
+                .continue
+            .endif
+
+            // A queue that went down is never fetched, PD drops the packet
+            alu[word0, word0, AND~, 1, <<SB_WQ_ENABLED_shf]
+
+        .endif
+
+        // Same work queue entry and RX descriptor as process_request
+        alu[$rx[0], --, B, LM_PARK_PTR[(LM_PARK_REQ_wrd + 2)]]
+        alu[$rx[1], --, B, LM_PARK_PTR[(LM_PARK_REQ_wrd + 3)]]
+        mem[write, $rx[0], addr_hi, <<8, addr_lo, 1], sig_done[rx_sig]
+
+        alu[$wq[0], word0, +8, $fl[0]]
+        alu[$wq[1], --, B, $fl[1]]
+        alu[$wq[2], --, B, LM_PARK_PTR[LM_PARK_REQ_wrd]]
+        alu[$wq[3], --, B, LM_PARK_PTR[(LM_PARK_REQ_wrd + 1)]]
+        alu[$wq[4], --, B, LM_PARK_PTR[(LM_PARK_REQ_wrd + 2)]]
+        pci_out_sb_add_work($wq[0], wq_sig)
+        ctx_arb[rx_sig, wq_sig]
+
+        alu[--, idx, OR, 0]
+        alu[@sb_park_busy, @sb_park_busy, AND~, 1, <<indirect]
+
+    .endw
+
+.end
+#endm
+#endif /* NFD_OUT_CREDITS_HOST_ISSUED */
+
+
 /**
  * Main processing loop for the manager context.  This context is responsible
  * for updating work queue credits and for processing configuration messages.
@@ -560,6 +1408,17 @@ copy_loop#:
     .addr _nfd_cfg_sig_sb PCI_OUT_SB_CFG_SIG_NUM
 
     .sig volatile state_alarm_sig
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        .reg state_alarms
+    #endif
+
+    #ifdef NFD_OUT_CREDITS_HOST_ISSUED
+        .sig volatile park_sig
+        .addr park_sig PCI_OUT_SB_PARK_SIG_NUM
+
+        // Parked requests are added to the PD work queue from here
+        pci_out_sb_iface_init()
+    #endif
 
 
     // Shared ME initialization
@@ -571,10 +1430,21 @@ copy_loop#:
     nop
     move(LM_WQ_CREDITS, (NFD_OUT_SB_WQ_SIZE_LW / SB_WQ_SIZE_LW))
 
-    // Shared ME initialization finished: kickstart workers
-    signal_ctx(STAGE_BATCH_FIRST_WORKER, ORDER_SIG_NUM)
+    // Shared ME initialization finished: kickstart the workers of each ring
+    #define_eval __RING 0
+    #while (__RING < NFD_OUT_RINGS)
+        signal_ctx((STAGE_BATCH_FIRST_WORKER + __RING), ORDER_SIG_NUM)
+        #define_eval __RING (__RING + 1)
+    #endloop
+    #undef __RING
 
-    set_alarm(state_alarm_sig, 16384)
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        // The alarm refills the token buckets, state is dumped less often
+        move(state_alarms, (16384 / NFD_OUT_RX_RL_PERIOD))
+        set_alarm(state_alarm_sig, NFD_OUT_RX_RL_PERIOD)
+    #else
+        set_alarm(state_alarm_sig, 16384)
+    #endif
 
     prep_reconfig($cmsg, _nfd_cfg_sig_sb)
 
@@ -583,8 +1453,31 @@ copy_loop#:
         .set_sig _nfd_credit_sig_sb
         .set_sig _nfd_cfg_sig_sb
 
+        #ifdef NFD_OUT_CREDITS_HOST_ISSUED
+
+            /*
+             * Keep retrying parked requests while there are any, but let
+             * the workers run in between
+             */
+            .if (@sb_park_busy != 0)
+                service_parked()
+                ctx_arb[voluntary]
+            .else
+                ctx_arb[_nfd_credit_sig_sb, _nfd_cfg_sig_sb, state_alarm_sig,
+                        park_sig], ANY
+            .endif
+
+            // The work is picked up by service_parked() above
+            .if (SIGNAL(park_sig))
+                .continue
+            .endif
+
+        #else /* NFD_OUT_CREDITS_HOST_ISSUED */
+
         ctx_arb[_nfd_credit_sig_sb, _nfd_cfg_sig_sb, state_alarm_sig], ANY
 
+        #endif /* NFD_OUT_CREDITS_HOST_ISSUED */
+
         .if (SIGNAL(_nfd_credit_sig_sb))
 
             update_wq_credits()
@@ -604,8 +1497,28 @@ copy_loop#:
 
         .if (SIGNAL(state_alarm_sig))
 
+            #ifdef NFD_OUT_RX_RATE_LIMIT
+                _rl_refill()
+                alu[state_alarms, state_alarms, -, 1]
+                .if (state_alarms != 0)
+                    set_alarm(state_alarm_sig, NFD_OUT_RX_RL_PERIOD)
+                    .continue
+                .endif
+                move(state_alarms, (16384 / NFD_OUT_RX_RL_PERIOD))
+            #endif
+
             dump_state(state_version)
-            set_alarm(state_alarm_sig, 16384)
+            #ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+                _check_cache_resize()
+            #endif
+            #ifdef NFD_OUT_RX_RATE_LIMIT
+                set_alarm(state_alarm_sig, NFD_OUT_RX_RL_PERIOD)
+            #else
+                set_alarm(state_alarm_sig, 16384)
+            #endif
+            #ifdef NFD_OUT_STRIDE_RX
+                _stride_flush()
+            #endif
             .continue
 
         .endif
@@ -659,6 +1572,20 @@ copy_loop#:
  * 1+ of these together so that each invocation goes directly to the
  * next when done, then the worker threads will cosume exactly that many
  * cycles per packet plus some small delta for updating credits.
+ *
+ * NFD_OUT_STRIDE_RX, NFD_OUT_HDR_SPLIT and NFD_OUT_FL_SIZE_CLASS add
+ * cycles to rewrite the RX descriptor.  With NFD_OUT_STRIDE_RX workers are
+ * serialised over the FL descriptor read whenever a stride buffer is
+ * opened, and the worker that closes a buffer spends a few memory round
+ * trips on it after signalling the next worker.  With
+ * NFD_OUT_FL_SIZE_CLASS workers are serialised over every FL descriptor
+ * read on queues that use size classes.  NFD_OUT_FL_CACHE_ADAPTIVE adds
+ * 2 cycles to mask the sequence number to the queue's FL cache depth.
+ * NFD_OUT_CREDITS_HOST_ISSUED serialises the FL descriptor read and the RX
+ * descriptor write.  Requests whose FL fetch is still pending are parked
+ * for the manager context, or polled for if no park entry is free.
+ * NFD_OUT_RX_RATE_LIMIT adds 2 cycles, and about 10 more on queues with
+ * a rate limit.
  */
 #macro process_request(in_xfer, out_xfer, cur_insig, cur_outsig, \
                        nxt_insig, nxt_outsig, ordersig, DONE_LABEL)
@@ -668,6 +1595,45 @@ copy_loop#:
     .reg credits
     .reg addr_lo
     .reg out_word0
+    #if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_HDR_SPLIT) || \
+         defined(NFD_OUT_FL_SIZE_CLASS))
+        .reg desc_w2
+        .reg tmp
+    #endif
+    #ifdef NFD_OUT_STRIDE_RX
+        .reg stride
+        .reg stride_cnt
+        .reg stride_seq
+        .reg stride_qid
+        .reg stride_hi
+        .reg stride_lo
+    #endif
+    #ifdef NFD_OUT_HDR_SPLIT
+        .reg hdr_len
+    #endif
+    #ifdef NFD_OUT_FL_SIZE_CLASS
+        .reg sc_flags
+        .reg sc_hi
+        .reg sc_lo
+        .reg len
+    #endif
+    #ifdef NFD_OUT_RX_SCATTER
+        .reg seg_off
+        .reg seg_tmp
+    #endif
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        .reg rl_drop
+        .reg rl_cost
+        .reg rl_tmp
+    #endif
+    #ifdef NFD_OUT_CREDITS_HOST_ISSUED
+        .reg park_w0
+        .reg park_w1
+        .reg park_w2
+        .reg park_w3
+        .reg park_idx
+        .reg tmp_park
+    #endif
 
     .reg read $buf_desc[2]
     .xfer_order $buf_desc
@@ -679,8 +1645,10 @@ test_ready_to_send#:
     alu[LM_WQ_CREDITS, LM_WQ_CREDITS, -, 1]
     blt[flow_controlled#]
 
-    // Burn per-CTX GPR to make 1 cycle
-    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    #if (!defined(NFD_OUT_STRIDE_RX) && !defined(NFD_OUT_FL_SIZE_CLASS))
+        // Burn per-CTX GPR to make 1 cycle
+        local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    #endif
 
     // XXX Assumes that the queue state starts at address 0
     alu[lma, g_lm_qstate_mask, AND, in_xfer[NFD_OUT_QID_wrd],
@@ -690,9 +1658,21 @@ test_ready_to_send#:
     // Copy descriptor. Put at the end so last word can be ommitted in WQ
     move(out_xfer[2], in_xfer[0])       // lm addr cycle 0
     move(out_xfer[3], in_xfer[1])       // lm addr cycle 1
-    move(out_xfer[4], in_xfer[2])       // lm addr cycle 2
+    #if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_HDR_SPLIT) || \
+         defined(NFD_OUT_FL_SIZE_CLASS))
+        move(desc_w2, in_xfer[2])       // lm addr cycle 2
+    #else
+        move(out_xfer[4], in_xfer[2])   // lm addr cycle 2
+    #endif
     move(out_xfer[5], in_xfer[3])
 
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+    // Charge the token bucket of rate limited queues, see rl_check#
+    br_bset[LM_STATUS, LM_QSTATE_RL_EN_bit, rl_check#], defer[1]
+    immed[rl_drop, 0]
+rl_done#:
+    #endif
+
     /*
      * Swap freelist descriptor for RX descriptor.
      * - get next addr_lo from the (shifted) sequence number
@@ -702,7 +1682,358 @@ test_ready_to_send#:
         #error "SB_WQ_SEQ_shf < NFD_OUT_FL_DESC_SIZE_lg2: cache address computation incorrect"
     #endif
     alu[out_word0, g_seq_mask, AND, LM_SEQ]
-    alu[addr_lo, g_cache_addr_lo_mask, AND, LM_SEQ, >>(SB_WQ_SEQ_shf - NFD_OUT_FL_DESC_SIZE_lg2)]
+
+    #ifdef NFD_OUT_RX_SCATTER
+    /*
+     * RX scatter: the application sends a descriptor per FL buffer of a
+     * packet, each with the CPP details of the whole packet and with
+     * PCIE_DESC_RX_EOP set on the last only.  LM_SCATTER_OFF tracks where
+     * the next segment starts in the packet buffers.  PD gets the offset
+     * of each segment split into the starting offset and the MU page,
+     * and frees the buffers with the last segment.
+     */
+    #if (PCIE_DESC_RX_EOP != (1 << 7))
+        #error "PCIE_DESC_RX_EOP expected at bit 7"
+    #endif
+    alu[seg_off, --, B, LM_SCATTER_OFF]
+    bne[scatter_seg#]
+    // Plain packets go through untouched
+    br_bset[in_xfer[3], 7, scatter_done#]
+    // First segment, starts at the 13 bit offset of the packet
+    alu[seg_off, --, B, in_xfer[0], <<19]
+    alu[seg_off, --, B, seg_off, >>19]
+
+scatter_seg#:
+    ld_field_w_clr[seg_tmp, 0011, in_xfer[2]]
+    br_bset[in_xfer[3], 7, scatter_last#], defer[1]
+    alu[LM_SCATTER_OFF, seg_off, +, seg_tmp]
+    br[scatter_word2#]
+
+scatter_last#:
+    alu[out_word0, out_word0, OR, 1, <<SB_WQ_EOP_shf]
+    move(LM_SCATTER_OFF, 0)
+
+scatter_word2#:
+    alu[seg_tmp, SB_WQ_MU_PAGE_msk, AND, seg_off, >>13]
+    alu[out_word0, out_word0, OR, seg_tmp, <<SB_WQ_MU_PAGE_shf]
+    // Replace the offset in word 2 and set S
+    alu[seg_tmp, 1, OR, in_xfer[0], >>SB_WQ_SCATTER_shf]
+    alu[seg_tmp, --, B, seg_tmp, <<SB_WQ_SCATTER_shf]
+    alu[seg_off, --, B, seg_off, <<19]
+    alu[out_xfer[2], seg_tmp, OR, seg_off, >>19]
+
+scatter_done#:
+    #endif /* NFD_OUT_RX_SCATTER */
+
+    #ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+        // Narrow the mask to the queue's cache depth by the shift in the
+        // low bits of LM_SEQ.  Bits of the mask shifted below
+        // NFD_OUT_FL_DESC_SIZE_lg2 meet zero bits of the sequence word.
+        alu[--, LM_SEQ, OR, 0]
+        alu[addr_lo, --, B, g_cache_addr_lo_mask, >>indirect]
+        alu[addr_lo, addr_lo, AND, LM_SEQ, >>(SB_WQ_SEQ_shf - NFD_OUT_FL_DESC_SIZE_lg2)]
+    #else
+        alu[addr_lo, g_cache_addr_lo_mask, AND, LM_SEQ, >>(SB_WQ_SEQ_shf - NFD_OUT_FL_DESC_SIZE_lg2)]
+    #endif
+
+    #ifdef NFD_OUT_STRIDE_RX
+    /*
+     * Striding RX: packets that fit in a stride are packed into the FL
+     * buffer of the slot that opened it, one stride each, after an 8B
+     * copy of their RX descriptor.  Only the packet that opens the buffer
+     * takes a slot.  The others neither read an FL descriptor nor advance
+     * the sequence number, and give back the credit the app took for
+     * them.  Their work queue entries carry the sequence number of the
+     * buffer's slot.  The buffer is closed once full, before a packet that
+     * needs a whole buffer, or by the manager once idle, see
+     * _stride_close().  The ordering signal is held back while a buffer is
+     * opened so that the next worker finds its address in the queue state.
+     */
+    immed[stride_cnt, 0]
+    br_bclr[LM_STATUS, LM_QSTATE_STRIDE_EN_bit, stride_off#]
+
+    ld_field_w_clr[tmp, 0011, desc_w2]
+    immed[stride_lo, (NFD_OUT_STRIDE_SZ - NFD_OUT_STRIDE_HDR_SZ - NFD_OUT_RX_OFFSET)]
+    alu[--, stride_lo, -, tmp]
+    blo[stride_whole#]
+
+    alu[stride, LM_QSTATE_STRIDE_IDX_msk, AND, LM_STATUS, >>LM_QSTATE_STRIDE_IDX_shf]
+    beq[stride_open#]
+
+    // Next stride of the open buffer, carrying into the high address byte
+    alu[stride_seq, LM_SEQ, -, g_seq_incr]
+    alu[out_word0, g_seq_mask, AND, stride_seq]
+    alu[out_word0, out_word0, OR, 1, <<SB_WQ_STRIDE_shf]
+    alu[stride_hi, --, B, LM_STATUS, >>LM_QSTATE_STRIDE_HI_shf]
+    alu[tmp, NFD_OUT_STRIDE_HDR_SZ, +, stride, <<NFD_OUT_STRIDE_SZ_lg2]
+    alu[stride_lo, LM_STRIDE_LO, +, tmp]
+    alu[stride_hi, stride_hi, +carry, 0]
+
+    alu[stride, stride, +, 1]
+    alu[LM_STATUS, LM_STATUS, AND~, LM_QSTATE_STRIDE_IDX_msk, <<LM_QSTATE_STRIDE_IDX_shf]
+    alu[LM_STATUS, LM_STATUS, OR, 1, <<LM_QSTATE_STRIDE_T_shf]
+    alu[--, stride, -, NFD_OUT_STRIDE_CNT]
+    bne[stride_more#], defer[1]
+    alu[out_word0, out_word0, OR, LM_STATUS, <<SB_WQ_RID_shf]
+
+    // Last stride, close the buffer once the packet is sent
+    br[stride_packed#], defer[1]
+    alu[stride_cnt, --, B, stride]
+
+stride_more#:
+    alu[LM_STATUS, LM_STATUS, OR, stride, <<LM_QSTATE_STRIDE_IDX_shf]
+
+stride_packed#:
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    mem[qadd_thread, in_xfer[0], g_in_wq_hi, <<8, g_in_wq_lo, 4], sig_done[cur_insig]
+
+    // Give back the credit of the slot the packet does not use
+    alu[stride_qid, --, B, lma, >>LM_QSTATE_SIZE_lg2]
+    move(tmp, (((PCIE_ISL + NFD_PCIE_ISL_BASE) | 0x80) << 24))
+    alu[addr_lo, NFD_OUT_ATOMICS_CREDIT, OR, stride_qid, <<NFD_OUT_ATOMICS_SZ_LG2]
+    br[stride_send#], defer[1]
+    mem[incr, --, tmp, <<8, addr_lo]
+
+stride_open#:
+    // First packet of a buffer, which is recorded once the FL read lands
+    alu[out_word0, out_word0, OR, 1, <<SB_WQ_STRIDE_shf]
+    alu[LM_STATUS, LM_STATUS, OR, 1, <<LM_QSTATE_STRIDE_IDX_shf]
+    alu[LM_STATUS, LM_STATUS, OR, 1, <<LM_QSTATE_STRIDE_T_shf]
+    mem[read, $buf_desc[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], sig_done[fl_read_sig]
+    mem[qadd_thread, in_xfer[0], g_in_wq_hi, <<8, g_in_wq_lo, 4], sig_done[cur_insig]
+    ctx_arb[fl_read_sig], defer[2]
+    alu[LM_SEQ, LM_SEQ, +, g_seq_incr]
+    alu[out_word0, out_word0, OR, LM_STATUS, <<SB_WQ_RID_shf]
+
+    alu[stride_hi, --, B, $buf_desc[0]]
+    alu[stride_lo, --, B, $buf_desc[1]]
+    alu[tmp, LM_STATUS, AND~, LM_QSTATE_STRIDE_HI_msk, <<LM_QSTATE_STRIDE_HI_shf]
+    alu[LM_STATUS, tmp, OR, stride_hi, <<LM_QSTATE_STRIDE_HI_shf]
+    alu[LM_STRIDE_LO, --, B, stride_lo]
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    alu[stride_lo, stride_lo, +, NFD_OUT_STRIDE_HDR_SZ]
+    br[stride_send#], defer[1]
+    alu[stride_hi, stride_hi, +carry, 0]
+
+stride_whole#:
+    // The packet needs a whole buffer, close the open one after it
+    alu[stride_cnt, LM_QSTATE_STRIDE_IDX_msk, AND, LM_STATUS, >>LM_QSTATE_STRIDE_IDX_shf]
+    alu[stride_seq, LM_SEQ, -, g_seq_incr]
+    alu[LM_STATUS, LM_STATUS, AND~, LM_QSTATE_STRIDE_IDX_msk, <<LM_QSTATE_STRIDE_IDX_shf]
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    // A zero stride count tells the host the buffer holds one packet
+    br[stride_done#], defer[1]
+    alu[out_xfer[4], desc_w2, AND~, SB_WQ_QNUM_msk, <<SB_WQ_QNUM_shf]
+
+stride_off#:
+    // Striding not enabled by the host, the RX descriptor is unchanged
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    alu[out_xfer[4], --, B, desc_w2]
+
+stride_done#:
+    #endif /* NFD_OUT_STRIDE_RX */
+
+    #ifdef NFD_OUT_HDR_SPLIT
+    /*
+     * Header split: PD places the packet so that its first
+     * NFD_OUT_HDR_SPLIT_LEN bytes, metadata included, end at
+     * NFD_OUT_HDR_SPLIT_DATA_OFF in the host buffer and the payload
+     * starts there.  The header length is reported to the host in the
+     * queue field of the RX descriptor.
+     */
+    br_bclr[LM_STATUS, LM_QSTATE_HDR_SPLIT_bit, split_off#]
+    ld_field_w_clr[hdr_len, 0011, desc_w2]
+    .if (hdr_len > NFD_OUT_HDR_SPLIT_LEN)
+        immed[hdr_len, NFD_OUT_HDR_SPLIT_LEN]
+    .endif
+    alu[out_word0, out_word0, OR, 1, <<SB_WQ_HDR_SPLIT_shf]
+    alu[tmp, desc_w2, AND~, SB_WQ_QNUM_msk, <<SB_WQ_QNUM_shf]
+    br[split_done#], defer[1]
+    alu[out_xfer[4], tmp, OR, hdr_len, <<SB_WQ_QNUM_shf]
+
+split_off#:
+    alu[out_xfer[4], --, B, desc_w2]
+
+split_done#:
+    #endif /* NFD_OUT_HDR_SPLIT */
+
+    #ifdef NFD_OUT_FL_SIZE_CLASS
+    /*
+     * Size class freelists: the host flags large FL buffers with
+     * PCIE_DESC_FL_LARGE and SB holds one spare buffer per queue.  A
+     * packet that does not fit the buffer of its slot, or a small packet
+     * whose slot has a large buffer, takes the spare if the spare is of
+     * the other class.  The slot buffer then becomes the spare.  A large
+     * packet with no large buffer to hand is dropped, and its slot buffer
+     * becomes the spare if there is none.  Drops are counted in the CFG
+     * BAR.  The outcome is reported to the host in the queue field of the
+     * RX descriptor.  The FL descriptor is read before the RX descriptor
+     * is built, and the ordering signal is held back until the spare is
+     * updated.
+     */
+    immed[sc_flags, 0]
+    br_bset[LM_STATUS, LM_QSTATE_SC_EN_bit, sc_on#]
+
+    // Size classes not enabled by the host, the RX descriptor is unchanged
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    br[sc_off#], defer[1]
+    alu[out_xfer[4], --, B, desc_w2]
+
+sc_on#:
+    mem[read, $buf_desc[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], ctx_swap[fl_read_sig]
+    alu[sc_hi, --, B, $buf_desc[0]]
+    alu[sc_lo, --, B, $buf_desc[1]]
+    alu[sc_flags, 1, AND, sc_hi, >>(log2(PCIE_DESC_FL_LARGE))]
+    ld_field_w_clr[len, 0011, desc_w2]
+    immed[tmp, (NFD_OUT_FL_SMALL_SZ - NFD_OUT_RX_OFFSET)]
+    alu[--, tmp, -, len]
+    blo[sc_large#]
+
+    // Small packet, swap a large slot buffer for a small spare
+    br_bclr[sc_flags, log2(PCIE_DESC_RX_SC_LARGE), sc_slot#]
+    br_bclr[LM_STATUS, LM_QSTATE_SPARE_bit, sc_slot#]
+    br_bclr[LM_STATUS, LM_QSTATE_SPARE_LARGE_bit, sc_swap#]
+    br[sc_slot#]
+
+sc_large#:
+    // Large packet, swap a small slot buffer for a large spare
+    br_bset[sc_flags, log2(PCIE_DESC_RX_SC_LARGE), sc_slot#]
+    br_bclr[LM_STATUS, LM_QSTATE_SPARE_bit, sc_park#]
+    br_bset[LM_STATUS, LM_QSTATE_SPARE_LARGE_bit, sc_swap#]
+
+    // The spare is small too, drop and leave the slot buffer to the host
+    br[sc_drop#], defer[1]
+    alu[sc_flags, sc_flags, OR, PCIE_DESC_RX_SC_DROP]
+
+sc_park#:
+    // Drop and keep the small slot buffer as the spare
+    alu[LM_SPARE_LO, --, B, sc_lo]
+    alu[LM_STATUS, LM_STATUS, AND~, LM_QSTATE_SPARE_HI_msk, <<LM_QSTATE_SPARE_HI_shf]
+    alu[LM_STATUS, LM_STATUS, OR, sc_hi, <<LM_QSTATE_SPARE_HI_shf]
+    alu[LM_STATUS, LM_STATUS, AND~, 1, <<LM_QSTATE_SPARE_LARGE_shf]
+    alu[LM_STATUS, LM_STATUS, OR, 1, <<LM_QSTATE_SPARE_shf]
+    alu[sc_flags, sc_flags, OR, (PCIE_DESC_RX_SC_DROP | PCIE_DESC_RX_SC_SPARE)]
+
+sc_drop#:
+    // Count the drop for NFP_NET_CFG_RXR_SC_DROPS.  The host reads the 8B
+    // counter little endian, so only its low word is incremented.
+    immed[tmp, sb_sc_base]
+    alu[tmp, tmp, +, lma, >>(LM_QSTATE_SIZE_lg2 - 2)]
+    local_csr_wr[LM_SC_CSR, tmp]
+    move(len, ((nfd_cfg_base/**/PCIE_ISL >> 8) & 0xFF000000))
+    nop
+    nop
+    alu[tmp, --, B, LM_SC_DROPS]
+    br[sc_slot#], defer[1]
+    mem[incr, --, len, <<8, tmp]
+
+sc_swap#:
+    // The packet takes the spare, which is of the other class
+    alu[sc_flags, sc_flags, XOR, (PCIE_DESC_RX_SC_LARGE | PCIE_DESC_RX_SC_SPARE)]
+    alu[tmp, --, B, LM_STATUS, >>LM_QSTATE_SPARE_HI_shf]
+    alu[len, --, B, LM_SPARE_LO]
+    alu[LM_SPARE_LO, --, B, sc_lo]
+    alu[sc_lo, --, B, len]
+    alu[LM_STATUS, LM_STATUS, AND~, LM_QSTATE_SPARE_HI_msk, <<LM_QSTATE_SPARE_HI_shf]
+    alu[LM_STATUS, LM_STATUS, OR, sc_hi, <<LM_QSTATE_SPARE_HI_shf]
+    alu[LM_STATUS, LM_STATUS, XOR, 1, <<LM_QSTATE_SPARE_LARGE_shf]
+    alu[sc_hi, --, B, tmp]
+
+sc_slot#:
+    // Spare updated, signal the next worker and report the outcome
+    local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    alu[tmp, desc_w2, AND~, SB_WQ_QNUM_msk, <<SB_WQ_QNUM_shf]
+    alu[out_xfer[4], tmp, OR, sc_flags, <<SB_WQ_QNUM_shf]
+    mem[write, out_xfer[4], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], sig_done[cur_outsig]
+    mem[qadd_thread, in_xfer[0], g_in_wq_hi, <<8, g_in_wq_lo, 4], sig_done[cur_insig]
+
+    ctx_arb[cur_outsig], defer[2], br[sc_work#]
+    alu[LM_SEQ, LM_SEQ, +, g_seq_incr]
+    alu[out_word0, out_word0, OR, LM_STATUS, <<SB_WQ_RID_shf]
+
+sc_off#:
+    #endif /* NFD_OUT_FL_SIZE_CLASS */
+
+    #ifdef NFD_OUT_CREDITS_HOST_ISSUED
+    /*
+     * Host issued credits: cache_desc issues credits with the FL fetch, so
+     * the fetch for this slot may still be in flight.  Until it lands the
+     * slot holds the RX descriptor of its last use or the mark written
+     * when the queue came up, both with DD set.  Read the slot before
+     * overwriting it.  The next worker was already signalled, so the next
+     * work queue dequeue is started before the first swap to keep the
+     * input ring order, and the request is copied out of in_xfer first.
+     */
+    mem[read, $buf_desc[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], sig_done[fl_read_sig]
+    alu[park_w0, --, B, in_xfer[0]]
+    alu[park_w1, --, B, in_xfer[1]]
+    alu[park_w2, --, B, in_xfer[2]]
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        // out_xfer[4] can't be read back, redo the rl_check# mask of a drop
+        br_bclr[rl_drop, SB_WQ_ENABLED_shf, park_rl#]
+        move(rl_tmp, ((NFD_OUT_DD_msk << NFD_OUT_DD_shf) | (0xFF << 16)))
+        alu[park_w2, park_w2, AND, rl_tmp]
+park_rl#:
+    #endif
+    alu[park_w3, --, B, in_xfer[3]]
+    mem[qadd_thread, in_xfer[0], g_in_wq_hi, <<8, g_in_wq_lo, 4], sig_done[cur_insig]
+    ctx_arb[fl_read_sig], defer[2]
+    alu[LM_SEQ, LM_SEQ, +, g_seq_incr]
+    alu[out_word0, out_word0, OR, LM_STATUS, <<SB_WQ_RID_shf]
+
+    br_bclr[$buf_desc[0], NFD_OUT_DD_shf, fl_cached#]
+
+    /*
+     * Waiting here would hold up the ordering signal, and so every other
+     * queue, once it comes round again.  Park the request for the manager
+     * context instead, which completes it once the slot is fetched.  Poll
+     * only if all park entries are in use.
+     */
+    alu[park_idx, --, ~B, @sb_park_busy]
+    ffs[park_idx, park_idx]
+    alu[--, park_idx, -, NFD_OUT_SB_PARK_SLOTS]
+    bge[fl_poll#]
+    alu[--, park_idx, OR, 0]
+    alu[@sb_park_busy, @sb_park_busy, OR, 1, <<indirect]
+    immed[tmp_park, sb_park_base]
+    alu[tmp_park, tmp_park, +, park_idx, <<LM_PARK_SIZE_lg2]
+    local_csr_wr[LM_PARK_CSR, tmp_park]
+    local_csr_wr[SAME_ME_SIGNAL, (STAGE_BATCH_MANAGER_CTX | \
+                                  (PCI_OUT_SB_PARK_SIG_NUM << 3))]
+    signal_ctx(ctx, (&cur_outsig))
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        alu[out_word0, out_word0, AND~, rl_drop]
+    #endif
+    alu[tmp_park, --, B, LM_CACHE_ADDR_RS8]
+    alu[LM_PARK_PTR[LM_PARK_ADDR_LO_wrd], --, B, addr_lo]
+    alu[LM_PARK_PTR[LM_PARK_ADDR_HI_wrd], --, B, tmp_park]
+    alu[LM_PARK_PTR[LM_PARK_WORD0_wrd], --, B, out_word0]
+    alu[LM_PARK_PTR[LM_PARK_REQ_wrd], --, B, park_w0]
+    alu[LM_PARK_PTR[(LM_PARK_REQ_wrd + 1)], --, B, park_w1]
+    alu[LM_PARK_PTR[(LM_PARK_REQ_wrd + 2)], --, B, park_w2]
+    alu[LM_PARK_PTR[(LM_PARK_REQ_wrd + 3)], --, B, park_w3]
+    alu[LM_PARK_PTR[LM_PARK_QSTATE_wrd], --, B, lma]
+
+    // No work was added on cur_outsig, so it was signalled above
+    .set_sig ordersig
+    ctx_arb[nxt_insig, nxt_outsig, ordersig], br[DONE_LABEL]
+
+fl_poll#:
+    // A queue that went down is never fetched, PD drops the packet
+    br_bclr[LM_STATUS, LM_QSTATE_ENABLED_bit, fl_down#]
+    cycle32_sleep(64)
+    mem[read, $buf_desc[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], ctx_swap[fl_read_sig]
+    br_bset[$buf_desc[0], NFD_OUT_DD_shf, fl_poll#]
+    br[fl_cached#]
+
+fl_down#:
+    alu[out_word0, out_word0, AND~, 1, <<SB_WQ_ENABLED_shf]
+
+fl_cached#:
+    mem[write, out_xfer[4], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], ctx_swap[cur_outsig]
+
+    #else /* NFD_OUT_CREDITS_HOST_ISSUED */
+
     mem[read, $buf_desc[0], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], sig_done[fl_read_sig]
     mem[write, out_xfer[4], LM_CACHE_ADDR_RS8, <<8, addr_lo, 1], sig_done[cur_outsig]
 
@@ -719,6 +2050,60 @@ test_ready_to_send#:
     alu[LM_SEQ, LM_SEQ, +, g_seq_incr]
     alu[out_word0, out_word0, OR, LM_STATUS, <<SB_WQ_RID_shf]
 
+    #endif /* NFD_OUT_CREDITS_HOST_ISSUED */
+
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+        // Packets over the rate go to PD as for a disabled queue
+        alu[out_word0, out_word0, AND~, rl_drop]
+    #endif
+
+    #ifdef NFD_OUT_STRIDE_RX
+
+    alu[stride_hi, --, B, $buf_desc[0]]
+    alu[stride_lo, --, B, $buf_desc[1]]
+
+stride_send#:
+    // PD needs the queue number back in word 4
+    alu[out_xfer[0], out_word0, +8, stride_hi]
+    alu[out_xfer[1], --, B, stride_lo]
+    alu[out_xfer[4], --, B, desc_w2]
+    pci_out_sb_add_work(out_xfer[0], cur_outsig)
+
+    .if (stride_cnt != 0)
+        alu[stride_qid, --, B, lma, >>LM_QSTATE_SIZE_lg2]
+        _stride_close(stride_qid, stride_seq, stride_cnt)
+    .endif
+
+    .set_sig ordersig
+    ctx_arb[nxt_insig, nxt_outsig, ordersig], br[DONE_LABEL]
+
+    #elif defined(NFD_OUT_FL_SIZE_CLASS)
+
+    alu[sc_hi, --, B, $buf_desc[0]]
+    alu[sc_lo, --, B, $buf_desc[1]]
+
+sc_work#:
+    // Dropped packets go to PD as for a disabled queue, without DMAs
+    br_bclr[sc_flags, log2(PCIE_DESC_RX_SC_DROP), sc_add#]
+    alu[out_word0, out_word0, AND~, 1, <<SB_WQ_ENABLED_shf]
+
+sc_add#:
+    // PD needs the queue number back in word 4
+    alu[out_xfer[0], out_word0, +8, sc_hi]
+    alu[out_xfer[1], --, B, sc_lo]
+    alu[out_xfer[4], --, B, desc_w2]
+    pci_out_sb_add_work(out_xfer[0], cur_outsig)
+
+    .set_sig ordersig
+    ctx_arb[nxt_insig, nxt_outsig, ordersig], br[DONE_LABEL]
+
+    #else /* NFD_OUT_STRIDE_RX */
+
+    #ifdef NFD_OUT_HDR_SPLIT
+        // PD needs the queue number back in word 4
+        alu[out_xfer[4], --, B, desc_w2]
+    #endif
+
     // Start sending the work to issue DMA, but see below: we're not quite done
     pci_out_sb_add_work(out_xfer[0], cur_outsig)
 
@@ -741,12 +2126,53 @@ test_ready_to_send#:
     move(out_xfer[1], $buf_desc[1])
     #pragma warning(default:5009)
 
+    #endif /* NFD_OUT_STRIDE_RX */
+
     // No credits, yield and then branch back to the test
 flow_controlled#:
     ctx_arb[voluntary], defer[2], br[test_ready_to_send#]
     alu[LM_WQ_CREDITS, LM_WQ_CREDITS, +, 1]
     nop
 
+    #ifdef NFD_OUT_RX_RATE_LIMIT
+    /*
+     * Rate limiting: take the packet's tokens from the bucket, which the
+     * manager refills.  With hold the bucket may go into debt, and the
+     * manager withholds FL credits from the app until it is repaid.
+     * Otherwise, on vNICs that set NFP_NET_CFG_CTRL_RXRLDROP, a packet
+     * that finds too few tokens is dropped and counted.  It still takes
+     * its FL slot, and the host gets an RX descriptor with zero data and
+     * metadata length for it.  No swaps here, the next worker may already
+     * be running.  The host reads the 8B drop counter little endian, so
+     * only its low word, at the lower address, is incremented.
+     */
+rl_check#:
+    immed[rl_tmp, sb_rl_base]
+    alu[rl_tmp, rl_tmp, +, lma]
+    local_csr_wr[LM_RL_CSR, rl_tmp]
+    ld_field_w_clr[rl_cost, 0011, in_xfer[NFD_OUT_LEN_wrd]]
+    br_bclr[LM_STATUS, LM_QSTATE_RL_PKTS_bit, rl_charge#]
+    immed[rl_cost, 1]
+    nop
+rl_charge#:
+    alu[LM_RL_TOKENS, LM_RL_TOKENS, -, rl_cost]
+    bge[rl_done#]
+    br_bset[LM_STATUS, LM_QSTATE_RL_HOLD_bit, rl_done#]
+
+    alu[LM_RL_TOKENS, LM_RL_TOKENS, +, rl_cost]
+    move(rl_cost, ((nfd_cfg_base/**/PCIE_ISL >> 8) & 0xFF000000))
+    alu[rl_tmp, --, B, LM_RL_AUX]
+    mem[incr, --, rl_cost, <<8, rl_tmp]
+    move(rl_tmp, ((NFD_OUT_DD_msk << NFD_OUT_DD_shf) | (0xFF << 16)))
+    #ifdef NFD_OUT_HDR_SPLIT
+        alu[desc_w2, desc_w2, AND, rl_tmp]
+    #else
+        alu[out_xfer[4], rl_tmp, AND, in_xfer[2]]
+    #endif
+    br[rl_done#], defer[1]
+    alu[rl_drop, --, B, 1, <<SB_WQ_ENABLED_shf]
+    #endif /* NFD_OUT_RX_RATE_LIMIT */
+
 .end
 #endm
 
@@ -786,6 +2212,7 @@ flow_controlled#:
     .reg ctx
     .reg next_ctx
     .reg lma
+    .reg ring
 
     // We must receive this signal to start pulling from the work queue
     .sig volatile ordersig
@@ -808,10 +2235,16 @@ flow_controlled#:
         ctx_arb[kill]
     .endif
 
-    // Initialize g_sig_next_worker
-    alu[next_ctx, ctx, +, 1]
+    // Find the input ring of this worker
+    alu[ring, ctx, -, STAGE_BATCH_FIRST_WORKER]
+    .while (ring >= NFD_OUT_RINGS)
+        alu[ring, ring, -, NFD_OUT_RINGS]
+    .endw
+
+    // Initialize g_sig_next_worker, the next worker on the same ring
+    alu[next_ctx, ctx, +, NFD_OUT_RINGS]
     .if (next_ctx > STAGE_BATCH_LAST_WORKER)
-        move(next_ctx, STAGE_BATCH_FIRST_WORKER)
+        alu[next_ctx, ring, +, STAGE_BATCH_FIRST_WORKER]
     .endif
     alu[g_sig_next_worker, next_ctx, OR, (&ordersig), <<3]
 
@@ -826,6 +2259,14 @@ flow_controlled#:
 
     move(g_in_wq_hi, ((nfd_out_ring_mem/**/PCIE_ISL >> 8) & 0xFF000000))
     move(g_in_wq_lo, nfd_out_ring_num/**/PCIE_ISL/**/0)
+    #define_eval __RING 1
+    #while (__RING < NFD_OUT_RINGS)
+        .if (ring == __RING)
+            move(g_in_wq_lo, nfd_out_ring_num/**/PCIE_ISL/**/__RING)
+        .endif
+        #define_eval __RING (__RING + 1)
+    #endloop
+    #undef __RING
     move(lma, sb_wq_credits)
     local_csr_wr[LM_WQ_CREDIT_CSR, lma]
 
@@ -910,6 +2351,10 @@ worker_loop#:
 main#:
     .reg @nconfigs
     .init @nconfigs 0
+    #ifdef NFD_OUT_CREDITS_HOST_ISSUED
+        .reg @sb_park_busy
+        .init @sb_park_busy 0
+    #endif
 
     pci_out_sb_iface_declare()
 
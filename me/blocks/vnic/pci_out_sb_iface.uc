@@ -22,9 +22,22 @@
 
 #include "nfd_common.h"
 #include "nfd_out.uc"   /* for NFD_OUT_MAX_QUEUES only */
+#include "pci_out_sb.h"
+#include "shared/nfd_internal.h"
 
 #define NFD_OUT_SB_WQ_SIZE_LW  1024
 
+/*
+ * Work queue entries a PD ME dequeues before returning them to SB as
+ * credits.  Each PD ME may hold up to a batch less one, so the batch is
+ * halved until all PD MEs together cannot hold all SB credits.
+ */
+#define_eval SB_WQ_CREDIT_BATCH 64
+#while ((NFD_OUT_PD_MES * SB_WQ_CREDIT_BATCH) > \
+        (NFD_OUT_SB_WQ_SIZE_LW / SB_WQ_SIZE_LW))
+    #define_eval SB_WQ_CREDIT_BATCH (SB_WQ_CREDIT_BATCH / 2)
+#endloop
+
 /* Debug parameter */
 #ifndef SB_USE_MU_WORK_QUEUES
 #define SB_USE_MU_WORK_QUEUES 0
@@ -42,6 +55,19 @@
     // WQ credits
     .alloc_mem nfd_out_sb_wq_credits/**/PCIE_ISL ctm island 4 4
 
+    #ifdef NFD_OUT_STRIDE_RX
+
+        // Completion counters of the slots of stride buffers
+        #define_eval __EMEM 'NFD_PCIE/**/PCIE_ISL/**/_EMEM'
+
+        .alloc_mem nfd_out_stride_cnt/**/PCIE_ISL __EMEM global \
+            (NFD_OUT_MAX_QUEUES * NFD_OUT_FL_BUFS_PER_QUEUE * 4) \
+            (NFD_OUT_MAX_QUEUES * NFD_OUT_FL_BUFS_PER_QUEUE * 4)
+
+        #undef __EMEM
+
+    #endif
+
     #if SB_USE_MU_WORK_QUEUES
 
         // MU work queues
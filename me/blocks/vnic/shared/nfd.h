@@ -78,6 +78,15 @@
 #endif
 #endif
 
+/* Capabilities in NFP_NET_CFG_CAP_WORD1 are optional */
+#ifndef NFD_CFG_VF_CAP_WORD1
+#define NFD_CFG_VF_CAP_WORD1 0
+#endif
+
+#ifndef NFD_CFG_PF_CAP_WORD1
+#define NFD_CFG_PF_CAP_WORD1 0
+#endif
+
 
 /* NFP_NET_CFG_CTRL_LSO2 and NFP_NET_CFG_CTRL_TXVLAN use the same bits in the
  * TX descriptor, so they can't be advertised for the same vNIC type. */
@@ -92,6 +101,55 @@
 #endif
 
 
+/* Striding RX, page aligned payloads and size class freelists place
+ * packets in host buffers from PCI.OUT SB and PD, which must be built for
+ * them. */
+#ifndef NFD_OUT_STRIDE_RX
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXSTRIDE)
+#error "NFP_NET_CFG_CTRL_RXSTRIDE requires NFD_OUT_STRIDE_RX"
+#endif
+#endif
+
+#ifndef NFD_OUT_HDR_SPLIT
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXPAYALIGN)
+#error "NFP_NET_CFG_CTRL_RXPAYALIGN requires NFD_OUT_HDR_SPLIT"
+#endif
+#endif
+
+#ifndef NFD_OUT_FL_SIZE_CLASS
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXSIZECLASS)
+#error "NFP_NET_CFG_CTRL_RXSIZECLASS requires NFD_OUT_FL_SIZE_CLASS"
+#endif
+#endif
+
+/* Shared RX completion queues are written by PCI.OUT send_desc */
+#ifndef NFD_OUT_RX_CQ
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXCQ)
+#error "NFP_NET_CFG_CTRL_RXCQ requires NFD_OUT_RX_CQ"
+#endif
+#endif
+
+/* RX ring write back is written by PCI.OUT send_desc */
+#ifndef NFD_OUT_RX_WB
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXRWB)
+#error "NFP_NET_CFG_CTRL_RXRWB requires NFD_OUT_RX_WB"
+#endif
+#endif
+
+/* RX rate limit drops are made by PCI.OUT SB */
+#ifndef NFD_OUT_RX_RATE_LIMIT
+#if ((NFD_CFG_VF_CAP_WORD1 | NFD_CFG_PF_CAP_WORD1) & \
+     NFP_NET_CFG_CTRL_RXRLDROP)
+#error "NFP_NET_CFG_CTRL_RXRLDROP requires NFD_OUT_RX_RATE_LIMIT"
+#endif
+#endif
+
+
 /* NFP6XXX A0 chips have errata related to byte swapping on DMAs */
 #if defined(__NFP_IS_6XXX) && (__REVISION_MIN < __REVISION_B0)
 #error "NFP6XXX A0 chips not supported"
@@ -410,6 +410,140 @@ err:
 #endif /* NFD_USE_TLV */
 
 
+/*
+ * The per RX ring regions that NFD adds to the config BAR, see
+ * nfp_net_ctrl.h, must fit in the BAR clear of each other and of the
+ * TLV block.
+ */
+#define NFD_CFG_BAR_OVERLAP(_s0, _e0, _s1, _e1)                         \
+    (((_s0) < (_e1)) && ((_s1) < (_e0)))
+
+#ifdef NFD_USE_TLV
+#define NFD_CFG_BAR_TLV_OVERLAP(_s, _e)                                 \
+    NFD_CFG_BAR_OVERLAP(_s, _e, NFD_CFG_TLV_BLOCK_OFF,                  \
+                        NFD_CFG_TLV_BLOCK_OFF + NFD_CFG_TLV_BLOCK_SZ)
+#else
+#define NFD_CFG_BAR_TLV_OVERLAP(_s, _e) 0
+#endif
+
+#define NFD_CFG_BAR_SC_END      NFP_NET_CFG_RXR_SC_DROPS(NFP_NET_RXR_MAX)
+
+#if (NFD_CFG_BAR_SC_END > NFP_NET_CFG_BAR_SZ)
+#error "NFP_NET_CFG_RXR_SC_DROPS must fit in the config BAR"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END)
+#error "NFP_NET_CFG_RXR_SC_DROPS overlaps the TLV block"
+#endif
+
+/* NFP_NET_CFG_RXR_BATCH sits between the RX ring priorities and the
+ * interrupt moderation words */
+#define NFD_CFG_BAR_BATCH_START NFP_NET_CFG_RXR_BATCH(0)
+#define NFD_CFG_BAR_BATCH_END   NFP_NET_CFG_RXR_BATCH(NFP_NET_RXR_MAX)
+
+#if ((NFD_CFG_BAR_BATCH_START < NFP_NET_CFG_RXR_PRIO(NFP_NET_RXR_MAX)) || \
+     (NFD_CFG_BAR_BATCH_END > NFP_NET_CFG_RXR_IRQ_MOD(0)))
+#error "NFP_NET_CFG_RXR_BATCH overlaps the RX ring configuration"
+#endif
+
+#if NFD_CFG_BAR_OVERLAP(NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END, \
+                        NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END)
+#error "NFP_NET_CFG_RXR_BATCH overlaps NFP_NET_CFG_RXR_SC_DROPS"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END)
+#error "NFP_NET_CFG_RXR_BATCH overlaps the TLV block"
+#endif
+
+/* The RX completion queue region sits between the general device stats
+ * and the per ring stats */
+#define NFD_CFG_BAR_RXCQ_END    NFP_NET_CFG_RXR_CQ(NFP_NET_RXR_MAX)
+
+#if ((NFP_NET_CFG_RXCQ_ADDR(NFP_NET_RXCQ_MAX) > NFP_NET_CFG_RXCQ_SZ(0)) || \
+     (NFP_NET_CFG_RXCQ_SZ(NFP_NET_RXCQ_MAX) > NFP_NET_CFG_RXR_CQ(0)))
+#error "NFP_NET_CFG_RXCQ_BASE entries overlap"
+#endif
+
+#if ((NFP_NET_CFG_RXCQ_BASE < NFP_NET_CFG_STATS_APP3_BYTES + 8) ||       \
+     (NFD_CFG_BAR_RXCQ_END > NFP_NET_CFG_TXR_STATS_BASE))
+#error "NFP_NET_CFG_RXCQ_BASE overlaps the device or ring stats"
+#endif
+
+#if (NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END,   \
+                         NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END,   \
+                         NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END))
+#error "NFP_NET_CFG_RXCQ_BASE overlaps another NFD region"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END)
+#error "NFP_NET_CFG_RXCQ_BASE overlaps the TLV block"
+#endif
+
+/* The RX ring write back region follows the mailbox */
+#define NFD_CFG_BAR_WB_END      NFP_NET_CFG_RXR_WB_ADDR(NFP_NET_RXR_MAX)
+
+#if (NFP_NET_CFG_RXR_WB_BASE < (NFP_NET_CFG_MBOX_BASE +                   \
+                                NFP_NET_CFG_MBOX_SIMPLE_VAL +           \
+                                NFP_NET_CFG_MBOX_VAL_MAX_SZ))
+#error "NFP_NET_CFG_RXR_WB_BASE overlaps the mailbox"
+#endif
+
+#if (NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END,   \
+                         NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END,   \
+                         NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END,   \
+                         NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END))
+#error "NFP_NET_CFG_RXR_WB_BASE overlaps another NFD region"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END)
+#error "NFP_NET_CFG_RXR_WB_BASE overlaps the TLV block"
+#endif
+
+#define NFD_CFG_BAR_RL_END      NFP_NET_CFG_RXR_RL_DROPS(NFP_NET_RXR_MAX)
+
+#if (NFP_NET_CFG_RXR_RL_RATE(NFP_NET_RXR_MAX) > NFP_NET_CFG_RXR_RL_DROPS(0))
+#error "NFP_NET_CFG_RXR_RL_BASE entries overlap"
+#endif
+
+#if (NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END,   \
+                         NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END,   \
+                         NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END,   \
+                         NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END,   \
+                         NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END))
+#error "NFP_NET_CFG_RXR_RL_BASE overlaps another NFD region"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END)
+#error "NFP_NET_CFG_RXR_RL_BASE overlaps the TLV block"
+#endif
+
+#define NFD_CFG_BAR_STARVE_END  NFP_NET_CFG_RXR_STARVE_DROPS(NFP_NET_RXR_MAX)
+
+#if (NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE, NFD_CFG_BAR_STARVE_END, \
+                         NFD_CFG_BAR_BATCH_START, NFD_CFG_BAR_BATCH_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE, NFD_CFG_BAR_STARVE_END, \
+                         NFP_NET_CFG_RXCQ_BASE, NFD_CFG_BAR_RXCQ_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE, NFD_CFG_BAR_STARVE_END, \
+                         NFP_NET_CFG_RXR_WB_BASE, NFD_CFG_BAR_WB_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE, NFD_CFG_BAR_STARVE_END, \
+                         NFP_NET_CFG_RXR_RL_BASE, NFD_CFG_BAR_RL_END) || \
+     NFD_CFG_BAR_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE, NFD_CFG_BAR_STARVE_END, \
+                         NFP_NET_CFG_RXR_SC_BASE, NFD_CFG_BAR_SC_END))
+#error "NFP_NET_CFG_RXR_STARVE_BASE overlaps another NFD region"
+#endif
+
+#if NFD_CFG_BAR_TLV_OVERLAP(NFP_NET_CFG_RXR_STARVE_BASE,                \
+                            NFD_CFG_BAR_STARVE_END)
+#error "NFP_NET_CFG_RXR_STARVE_BASE overlaps the TLV block"
+#endif
+
+
 /**
  * @param msg_valid     message contains valid information
  * @param error         an error has been detected
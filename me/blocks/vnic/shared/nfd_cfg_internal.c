@@ -505,6 +505,7 @@ _nfd_cfg_init_vf_cfg_bar(unsigned int vid)
                                    NFD_NATQ2QC(q_base, NFD_IN_TX_QUEUE),
                                    NFD_NATQ2QC(q_base, NFD_OUT_FL_QUEUE)};
     __xwrite unsigned int exn_lsc = 0xffffffff;
+    __xwrite unsigned int cap_word1 = NFD_CFG_VF_CAP_WORD1;
     __xwrite unsigned int cfg2[] = {NFD_OUT_RX_OFFSET,
                                     NFD_RSS_HASH_FUNC};
 #ifdef NFD_USE_TLV_VF
@@ -522,6 +523,10 @@ _nfd_cfg_init_vf_cfg_bar(unsigned int vid)
                NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_RX_OFFSET,
                sizeof cfg2);
 
+    mem_write32(&cap_word1,
+                NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_CAP_WORD1,
+                sizeof cap_word1);
+
 #ifdef NFD_USE_TLV_VF
     mem_write32(&tlv_wr,
         NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_TLV_BASE,
@@ -584,6 +589,7 @@ _nfd_cfg_init_pf_cfg_bar(unsigned int vid)
                                    NFD_NATQ2QC(q_base, NFD_IN_TX_QUEUE),
                                    NFD_NATQ2QC(q_base, NFD_OUT_FL_QUEUE)};
     __xwrite unsigned int exn_lsc = 0xffffffff;
+    __xwrite unsigned int cap_word1 = NFD_CFG_PF_CAP_WORD1;
     __xwrite unsigned int cfg2[] = {NFD_OUT_RX_OFFSET,
                                     NFD_RSS_HASH_FUNC};
 #ifdef NFD_USE_TLV_PF
@@ -630,6 +636,10 @@ _nfd_cfg_init_pf_cfg_bar(unsigned int vid)
     mem_write8(&cfg2, NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_RX_OFFSET,
                sizeof cfg2);
 
+    mem_write32(&cap_word1,
+                NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_CAP_WORD1,
+                sizeof cap_word1);
+
 #ifdef NFD_BPF_CAPABLE
     mem_write8(&bpf_cfg,
                NFD_CFG_BAR_ISL(PCIE_ISL, vid) + NFP_NET_CFG_BPF_ABI,
@@ -1338,6 +1348,15 @@ nfd_cfg_parse_msg(struct nfd_cfg_msg *cfg_msg, enum nfd_cfg_component comp)
         cfg_msg->interested = 1;
     }
 
+#ifdef NFD_IN_TXR_COAL
+    /* PCI.IN takes TX.R coalescing thresholds from the TX interrupt
+     * moderation configuration */
+    if (comp == NFD_CFG_PCI_IN0 &&
+        (cfg_bar_data[NFP_NET_CFG_UPDATE >> 2] & NFP_NET_CFG_UPDATE_IRQMOD)) {
+        cfg_msg->interested = 1;
+    }
+#endif
+
     /* Set the queue to process to the final queue */
     cfg_msg->queue = NFD_VID_MAXQS(cfg_msg->vid) - 1;
 
@@ -209,6 +209,7 @@ nfd_flr_init_pf_cfg_bar(unsigned int pcie, unsigned int vid)
                                    NFD_NATQ2QC(q_base, NFD_IN_TX_QUEUE),
                                    NFD_NATQ2QC(q_base, NFD_OUT_FL_QUEUE)};
     __xwrite unsigned int exn_lsc = 0xffffffff;
+    __xwrite unsigned int cap_word1 = NFD_CFG_PF_CAP_WORD1;
     __xwrite unsigned int cfg2[] = {NFD_OUT_RX_OFFSET,
                                     NFD_RSS_HASH_FUNC};
 
@@ -247,6 +248,9 @@ nfd_flr_init_pf_cfg_bar(unsigned int pcie, unsigned int vid)
     mem_write8(&exn_lsc, bar_base + NFP_NET_CFG_LSC, sizeof exn_lsc);
 
     mem_write8(&cfg2, bar_base + NFP_NET_CFG_RX_OFFSET, sizeof cfg2);
+
+    mem_write32(&cap_word1, bar_base + NFP_NET_CFG_CAP_WORD1,
+                sizeof cap_word1);
 #ifdef NFD_BPF_CAPABLE
     mem_write8(&bpf_cfg, bar_base + NFP_NET_CFG_BPF_ABI, sizeof bpf_cfg);
 #endif
@@ -325,6 +329,7 @@ nfd_flr_init_vf_cfg_bar(__emem char *vf_cfg_base, unsigned int pcie,
                                    NFD_NATQ2QC(q_base, NFD_IN_TX_QUEUE),
                                    NFD_NATQ2QC(q_base, NFD_OUT_FL_QUEUE)};
     __xwrite unsigned int exn_lsc = 0xffffffff;
+    __xwrite unsigned int cap_word1 = NFD_CFG_VF_CAP_WORD1;
     __xwrite unsigned int cfg2[] = {NFD_OUT_RX_OFFSET,
                                     NFD_RSS_HASH_FUNC};
     __xread unsigned int vf_cfg_rd[2];
@@ -336,6 +341,9 @@ nfd_flr_init_vf_cfg_bar(__emem char *vf_cfg_base, unsigned int pcie,
 
     mem_write8(&cfg2, bar_base + NFP_NET_CFG_RX_OFFSET, sizeof cfg2);
 
+    mem_write32(&cap_word1, bar_base + NFP_NET_CFG_CAP_WORD1,
+                sizeof cap_word1);
+
     /* XXX should vid technically be vf below? */
     mem_read8(&vf_cfg_rd, NFD_VF_CFG_ADDR(vf_cfg_base, vid),
               NFD_VF_CFG_MAC_SZ);
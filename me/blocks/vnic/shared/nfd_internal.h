@@ -82,12 +82,74 @@
 #define NFD_IN_ISSUE_END_CTX    6
 #define NFD_IN_NOTIFY_MANAGER0  0
 #define NFD_IN_NOTIFY_MANAGER1  1
-#define NFD_IN_NOTIFY_STRIDE    2
+
+/* Notify runs one side per issue_dma ME, with the contexts of the notify
+ * ME interleaved between the sides.  With a single issue_dma ME, all
+ * contexts serve side 0.  With two issue_dma MEs, NFD_IN_NOTIFY_ME1 moves
+ * side 1 to a second notify ME, built with PCI_IN_NOTIFY_IDX set to 1, so
+ * that each side gets all contexts of its own ME.  Each notify ME then
+ * keeps its own TX.R coalescing state, which only holds the queues of its
+ * side, but sequence numbers may span sides and must stay on one ME. */
+#ifdef NFD_IN_NOTIFY_ME1
+#if !defined(NFD_IN_HAS_ISSUE0) || !defined(NFD_IN_HAS_ISSUE1)
+#error "NFD_IN_NOTIFY_ME1 requires both issue_dma MEs"
+#endif
+#ifdef NFD_IN_ADD_SEQN
+#error "NFD_IN_NOTIFY_ME1 is incompatible with NFD_IN_ADD_SEQN"
+#endif
+#define NFD_IN_NOTIFY_SIDES     1
+#define NFD_IN_NOTIFY_SIDE1_ME  NFD_IN_NOTIFY_ME1
+#define NFD_IN_NOTIFY_SIDE1_MANAGER NFD_IN_NOTIFY_MANAGER0
+#else
+#ifdef NFD_IN_HAS_ISSUE1
+#define NFD_IN_NOTIFY_SIDES     2
+#else
+#define NFD_IN_NOTIFY_SIDES     1
+#endif
+#define NFD_IN_NOTIFY_SIDE1_ME  NFD_IN_NOTIFY_ME
+#define NFD_IN_NOTIFY_SIDE1_MANAGER NFD_IN_NOTIFY_MANAGER1
+#endif
+#define NFD_IN_NOTIFY_STRIDE    NFD_IN_NOTIFY_SIDES
 
 
 #define NFD_IN_NOTIFY_RESET_RD  0
 #define NFD_IN_NOTIFY_DATA_RD   1
 #define NFD_IN_NOTIFY_JUMBO_RD  2
+#define NFD_IN_NOTIFY_SEQR_RD   3
+#define NFD_IN_NOTIFY_TXR_COAL_RD 4
+
+
+/* TX.R coalescing configuration words, one per queue in the
+ * nfd_in_txr_coal table.  Zero means the queue is down, any pending
+ * count must be discarded.  A zero tick count disables coalescing for
+ * the queue, matching the interrupt moderation semantics. */
+#define NFD_IN_TXR_COAL_PKTS(_x)        ((_x) >> 16)
+#define NFD_IN_TXR_COAL_TICKS(_x)       ((_x) & 0xffff)
+#define NFD_IN_TXR_COAL_CFG(_pkts, _ticks) (((_pkts) << 16) | (_ticks))
+/* __qc_add_to_ptr_wr() can add at most 63, so leave room for a batch */
+#define NFD_IN_TXR_COAL_MAX_PKTS        (64 - NFD_IN_MAX_BATCH_SZ)
+
+
+/* PCI.IN latency trace records, see NFD_IN_LAT_TRACE.  Each record is a
+ * single journal word so that notify can log without transfer registers.
+ * The sample index is the batch sequence number divided by the sample
+ * rate, which gather, issue_dma and notify all derive independently.
+ * The timestamp is in units of the ME timestamp counter (16 cycles). */
+#define NFD_IN_LAT_STAGE_GATHER         1
+#define NFD_IN_LAT_STAGE_ISSUE          2
+#define NFD_IN_LAT_STAGE_NOTIFY         3
+
+#define NFD_IN_LAT_REC_STAGE_shf        30
+#define NFD_IN_LAT_REC_STAGE_msk        0x3
+#define NFD_IN_LAT_REC_SIDE_shf         29
+#define NFD_IN_LAT_REC_SIDE_msk         0x1
+#define NFD_IN_LAT_REC_IDX_shf          20
+#define NFD_IN_LAT_REC_IDX_msk          0x1ff
+#define NFD_IN_LAT_REC_TS_shf           0
+#define NFD_IN_LAT_REC_TS_msk           0xfffff
+
+#define NFD_IN_LAT_REC_FIELD(_rec, _f)                                  \
+    (((_rec) >> NFD_IN_LAT_REC_##_f##_shf) & NFD_IN_LAT_REC_##_f##_msk)
 
 
 #define NFD_IN_DSTQ_MSK         0x7
@@ -161,6 +223,26 @@
 #define NFD_IN_MAX_LSO_SEQ_CNT      64
 #endif
 
+#ifdef NFD_IN_LAT_TRACE
+#ifndef NFD_IN_LAT_SAMPLE
+#define NFD_IN_LAT_SAMPLE           4096
+#endif
+
+#if ((NFD_IN_LAT_SAMPLE & (NFD_IN_LAT_SAMPLE - 1)) != 0)
+#error "NFD_IN_LAT_SAMPLE must be a power of two"
+#endif
+
+#ifndef NFD_IN_LAT_JRNL_SZ
+#define NFD_IN_LAT_JRNL_SZ          4096
+#endif
+
+/* The record sample index wraps at 512 per side, keep the journal small
+ * enough that records for different samples cannot alias */
+#if (NFD_IN_LAT_JRNL_SZ != 2048 && NFD_IN_LAT_JRNL_SZ != 4096)
+#error "NFD_IN_LAT_JRNL_SZ must be 2048 or 4096"
+#endif
+#endif
+
 #if defined(__NFP_LANG_MICROC) || defined(NFD_DBG)
 /* NFD IN LSO Debug Counters. */
 enum NFD_IN_LSO_CNTR_IDX {
@@ -322,6 +404,47 @@ static const char *nfd_in_lso_cntr_names[] = {
 
 #define NFD_OUT_FL_SOFT_THRESH          (NFD_OUT_FL_BUFS_PER_QUEUE / 4)
 
+#ifdef NFD_OUT_FL_CACHE_ADAPTIVE
+#ifndef NFD_OUT_FL_CACHE_MIN_BUFS
+#define NFD_OUT_FL_CACHE_MIN_BUFS       NFD_OUT_DESC_MAX_BATCH_SZ
+#endif
+
+#ifndef NFD_OUT_FL_CACHE_POOL_BUFS
+#define NFD_OUT_FL_CACHE_POOL_BUFS      \
+    (NFD_OUT_MAX_QUEUES * NFD_OUT_FL_BUFS_PER_QUEUE / 2)
+#endif
+
+#ifndef NFD_OUT_FL_CACHE_ADAPT_TICKS
+#define NFD_OUT_FL_CACHE_ADAPT_TICKS    65536
+#endif
+
+#ifndef NFD_OUT_FL_CACHE_GROW_BATCHES
+#define NFD_OUT_FL_CACHE_GROW_BATCHES   64
+#endif
+
+#if (((NFD_OUT_FL_CACHE_MIN_BUFS & (NFD_OUT_FL_CACHE_MIN_BUFS - 1)) != 0) || \
+     NFD_OUT_FL_CACHE_MIN_BUFS < NFD_OUT_DESC_MAX_BATCH_SZ ||             \
+     NFD_OUT_FL_CACHE_MIN_BUFS > NFD_OUT_FL_BUFS_PER_QUEUE)
+#error "NFD_OUT_FL_CACHE_MIN_BUFS must be a power of two from NFD_OUT_DESC_MAX_BATCH_SZ to NFD_OUT_FL_BUFS_PER_QUEUE"
+#endif
+
+#if (NFD_OUT_FL_BUFS_PER_QUEUE > 16 * NFD_OUT_FL_CACHE_MIN_BUFS)
+#error "NFD_OUT_FL_BUFS_PER_QUEUE may be at most 16 times NFD_OUT_FL_CACHE_MIN_BUFS"
+#endif
+
+/*
+ * The FL cache configuration table holds a word per queue, written by
+ * cache_desc and read by stage_batch.  The upper bits give the byte offset
+ * of the queue's region in the FL cache, and the low bits the log2 of
+ * NFD_OUT_FL_BUFS_PER_QUEUE over the region depth.  The word after the
+ * table is a mailbox holding the queue plus one of a region change that
+ * stage_batch has yet to load, or zero.
+ */
+#define NFD_OUT_FL_CACHE_CFG_SHF_msk    0x1F
+#define NFD_OUT_FL_CACHE_CFG_MBOX_OFF   (NFD_OUT_MAX_QUEUES * 4)
+#define NFD_OUT_FL_CACHE_CFG_SZ         (NFD_OUT_FL_CACHE_CFG_MBOX_OFF + 4)
+#endif
+
 
 #ifndef NFD_PCIE0_FL_CACHE_MEM
 #define NFD_PCIE0_FL_CACHE_MEM          pcie0.ctm
@@ -341,13 +464,173 @@ static const char *nfd_in_lso_cntr_names[] = {
 
 
 #ifndef NFD_OUT_RX_DESC_REQ_BATCH
-#define NFD_OUT_RX_DESC_REQ_BATCH       16
+#define NFD_OUT_RX_DESC_REQ_BATCH       64
+#endif
+
+#if (NFD_OUT_RX_DESC_REQ_BATCH < 1 || \
+     NFD_OUT_RX_DESC_REQ_BATCH > NFD_OUT_DESC_MAX_BATCH_SZ)
+#error "NFD_OUT_RX_DESC_REQ_BATCH must be 1 to NFD_OUT_DESC_MAX_BATCH_SZ"
 #endif
 
 #ifndef NFD_OUT_RX_DESC_LAT_LIMIT
 #define NFD_OUT_RX_DESC_LAT_LIMIT       5000
 #endif
 
+#ifdef NFD_OUT_STRIDE_RX
+#ifndef NFD_OUT_STRIDE_SZ
+#define NFD_OUT_STRIDE_SZ               256
+#endif
+
+#ifndef NFD_OUT_STRIDE_CNT
+#define NFD_OUT_STRIDE_CNT              8
+#endif
+
+#if ((NFD_OUT_STRIDE_SZ & (NFD_OUT_STRIDE_SZ - 1)) != 0)
+#error "NFD_OUT_STRIDE_SZ must be a power of two"
+#endif
+
+#if ((NFD_OUT_STRIDE_CNT & (NFD_OUT_STRIDE_CNT - 1)) != 0 || \
+     NFD_OUT_STRIDE_CNT < 2 || NFD_OUT_STRIDE_CNT > 16)
+#error "NFD_OUT_STRIDE_CNT must be a power of two from 2 to 16"
+#endif
+
+/* Each stride starts with a copy of the RX descriptor of its packet */
+#define NFD_OUT_STRIDE_HDR_SZ           8
+
+/* PD finds the completion counter of a slot from the 10 bit sequence
+ * number of the work queue entry, see pci_out_sb.uc */
+#if (NFD_OUT_FL_BUFS_PER_QUEUE > 1024)
+#error "NFD_OUT_STRIDE_RX supports at most 1024 NFD_OUT_FL_BUFS_PER_QUEUE"
+#endif
+#endif
+
+#ifdef NFD_OUT_HDR_SPLIT
+#ifndef NFD_OUT_HDR_SPLIT_LEN
+#define NFD_OUT_HDR_SPLIT_LEN           128
+#endif
+
+#ifndef NFD_OUT_HDR_SPLIT_DATA_OFF
+#define NFD_OUT_HDR_SPLIT_DATA_OFF      4096
+#endif
+
+#if (NFD_OUT_HDR_SPLIT_LEN > 255)
+#error "NFD_OUT_HDR_SPLIT_LEN must fit the RX descriptor queue field"
+#endif
+
+#if (NFD_OUT_HDR_SPLIT_DATA_OFF < NFD_OUT_HDR_SPLIT_LEN || \
+     NFD_OUT_HDR_SPLIT_DATA_OFF > 0xFFFF)
+#error "NFD_OUT_HDR_SPLIT_DATA_OFF out of range"
+#endif
+
+#ifdef NFD_OUT_STRIDE_RX
+#error "NFD_OUT_HDR_SPLIT and NFD_OUT_STRIDE_RX both use the RX descriptor queue field"
+#endif
+#endif
+
+#ifdef NFD_OUT_FL_SIZE_CLASS
+#ifndef NFD_OUT_FL_SMALL_SZ
+#define NFD_OUT_FL_SMALL_SZ             512
+#endif
+
+#if (NFD_OUT_FL_SMALL_SZ > 0xFFFF)
+#error "NFD_OUT_FL_SMALL_SZ out of range"
+#endif
+
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_HDR_SPLIT))
+#error "NFD_OUT_FL_SIZE_CLASS uses the RX descriptor queue field"
+#endif
+#endif
+
+#ifdef NFD_OUT_RX_SCATTER
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_HDR_SPLIT) || \
+     defined(NFD_OUT_FL_SIZE_CLASS))
+#error "NFD_OUT_RX_SCATTER is incompatible with other RX placement options"
+#endif
+#endif
+
+/* With host issued credits, SB parks requests whose FL cache slot is still
+ * being fetched for its manager context, and polls the slot only when all
+ * park entries are in use, see pci_out_sb.uc.  Only the plain FL read in SB
+ * does this, slots must stay put, and parked requests are completed from
+ * their input ring entry. */
+#ifdef NFD_OUT_CREDITS_HOST_ISSUED
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_FL_SIZE_CLASS) || \
+     defined(NFD_OUT_FL_CACHE_ADAPTIVE) || defined(NFD_OUT_RX_SCATTER) || \
+     defined(NFD_OUT_HDR_SPLIT))
+#error "NFD_OUT_CREDITS_HOST_ISSUED is incompatible with the selected FL options"
+#endif
+
+/* Credits are issued a fetch batch at a time and must only cover slots of
+ * the cache, which cache_desc marks 32B at a time */
+#if ((NFD_OUT_FL_BUFS_PER_QUEUE % NFD_OUT_FL_BATCH_SZ) != 0)
+#error "NFD_OUT_FL_BUFS_PER_QUEUE must be a multiple of NFD_OUT_FL_BATCH_SZ"
+#endif
+#endif
+
+/* Both post a second DMA after each RX descriptor DMA, pick one */
+#if (defined(NFD_OUT_RX_CQ) && defined(NFD_OUT_RX_WB))
+#error "NFD_OUT_RX_CQ and NFD_OUT_RX_WB cannot be used together"
+#endif
+
+#ifdef NFD_OUT_RX_RATE_LIMIT
+/* Token bucket refill period in ME timestamp ticks, a power of two */
+#ifndef NFD_OUT_RX_RL_PERIOD
+#define NFD_OUT_RX_RL_PERIOD            4096
+#endif
+
+#if (NFD_OUT_RX_RL_PERIOD < 1024 || NFD_OUT_RX_RL_PERIOD > 16384 || \
+     (NFD_OUT_RX_RL_PERIOD & (NFD_OUT_RX_RL_PERIOD - 1)) != 0)
+#error "NFD_OUT_RX_RL_PERIOD must be a power of two from 1024 to 16384"
+#endif
+
+/* SB drops and charges per input descriptor, see pci_out_sb.uc */
+#if (defined(NFD_OUT_STRIDE_RX) || defined(NFD_OUT_FL_SIZE_CLASS) || \
+     defined(NFD_OUT_RX_SCATTER))
+#error "NFD_OUT_RX_RATE_LIMIT is incompatible with the selected RX options"
+#endif
+#endif
+
+#ifdef NFD_OUT_FL_STARVE_DROP
+/* ME timestamp ticks a queue may go without FL buffers before apps are
+ * told to drop its packets, see cache_desc_starve() */
+#ifndef NFD_OUT_FL_STARVE_TICKS
+#define NFD_OUT_FL_STARVE_TICKS         65536
+#endif
+
+#if (NFD_OUT_FL_STARVE_TICKS < 4096)
+#error "NFD_OUT_FL_STARVE_TICKS must be 4096 or greater"
+#endif
+#endif
+
+
+/* Number of PCI.OUT PD MEs, NFD_OUT_3_PD_MES is kept for compatibility */
+#ifndef NFD_OUT_PD_MES
+#ifdef NFD_OUT_3_PD_MES
+#define NFD_OUT_PD_MES                  3
+#else
+#define NFD_OUT_PD_MES                  2
+#endif
+#endif
+
+#if (NFD_OUT_PD_MES < 1 || NFD_OUT_PD_MES > 8)
+#error "NFD_OUT_PD_MES must be 1 to 8"
+#endif
+
+/*
+ * Each PD thread commits up to 3 packet blocks of 2 DMAs to the ToPCI low
+ * priority DMA queue, which holds 128 DMAs.  PD MEs run as many threads
+ * as fit, up to 8.
+ */
+#define NFD_OUT_PD_TOPCI_LO_SLOTS       128
+#define NFD_OUT_PD_DMAS_PER_CTX         (3 * 2)
+#if ((NFD_OUT_PD_TOPCI_LO_SLOTS /                                    \
+      (NFD_OUT_PD_MES * NFD_OUT_PD_DMAS_PER_CTX)) > 8)
+#define NFD_OUT_PD_CTXS                 8
+#else
+#define NFD_OUT_PD_CTXS                 (NFD_OUT_PD_TOPCI_LO_SLOTS /    \
+                                         (NFD_OUT_PD_MES *              \
+                                          NFD_OUT_PD_DMAS_PER_CTX))
+#endif
 
 #define NFD_OUT_PD_RST_CTX              0
 #define NFD_OUT_PD_RST_SIG_NO           15
@@ -391,7 +674,8 @@ struct nfd_in_queue_info {
     unsigned int up:1;
     unsigned int ring_base_hi:8;
     unsigned int ring_base_lo;
-    unsigned int dummy[2];
+    unsigned int seqr;          /* Sequencer, used with NFD_IN_SEQR_TBL */
+    unsigned int dummy;
 };
 
 
@@ -560,7 +844,10 @@ struct nfd_out_queue_info {
     unsigned int fl_s;
     unsigned int ring_sz_msk;
     unsigned int requester_id:8;
-    unsigned int spare0:15;
+    unsigned int spare0:3;
+    unsigned int fl_cache_hold:1;
+    unsigned int fl_cache_lg2:3;
+    unsigned int fl_cache_chunk:8;
     unsigned int up:1;
     unsigned int ring_base_hi:8;
     unsigned int ring_base_lo;
@@ -586,7 +873,8 @@ struct nfd_out_fl_desc {
     union {
         struct {
             unsigned int dd:1;          /* Must be zero */
-            unsigned int spare:23;
+            unsigned int spare:22;
+            unsigned int large:1;       /* See PCIE_DESC_FL_LARGE */
             unsigned int dma_addr_hi:8; /* High bits of the buf address */
 
             unsigned int dma_addr_lo;   /* Low bits of the buffer address */
@@ -608,6 +896,59 @@ struct nfd_out_send_desc_msg {
 };
 
 
+/* Per queue RX descriptor batching state, see NFD_OUT_USE_RX_BATCH_TGT */
+struct nfd_out_rx_batch {
+    unsigned int rate:16;   /* EWMA of descriptors per latency limit, 12.4 */
+    unsigned int cfg:8;     /* Target from the CFG BAR, zero for adaptive */
+    unsigned int tgt:8;     /* Current batch target */
+};
+
+
+/* Per queue FL starvation state, see NFD_OUT_FL_STARVE_DROP */
+struct nfd_out_fl_starve {
+    unsigned int fl_s:24;   /* Low bits of fl_s at the last check */
+    unsigned int spare:4;
+    unsigned int starved:1; /* Set while the CTM flag is set */
+    unsigned int checks:3;  /* Checks in a row that found no FL buffers */
+};
+
+
+/* RX completion queue state, see NFD_OUT_RX_CQ */
+struct nfd_out_rx_cq {
+    unsigned int base_lo;       /* Host address of the CQ, low bits */
+    unsigned int spare:16;      /* Unused */
+    unsigned int sz_lg2:8;      /* log2 of the CQ entries */
+    unsigned int base_hi:8;     /* Host address of the CQ, high bits */
+    unsigned int wr;            /* Entries written, free running */
+    unsigned int spare1;        /* Unused */
+};
+
+/*
+ * The RX completion queue memory holds a struct nfd_out_rx_cq per natural
+ * queue number, followed by an entry per RX descriptor DMA in flight that
+ * the CQ entry DMA is sourced from.  CQ "n" of a vNIC uses the state of
+ * ring "n" of the vNIC.
+ */
+#define NFD_OUT_RX_CQ_STATE_SZ      16
+#define NFD_OUT_RX_CQ_ENTRY_SZ      8
+#define NFD_OUT_RX_CQ_STAGE_OFF     (NFD_OUT_MAX_QUEUES * NFD_OUT_RX_CQ_STATE_SZ)
+#define NFD_OUT_RX_CQ_MEM_SZ        (NFD_OUT_RX_CQ_STAGE_OFF +          \
+                                     NFD_OUT_DESC_MAX_IN_FLIGHT *       \
+                                     NFD_OUT_RX_CQ_ENTRY_SZ)
+
+/*
+ * The RX write back memory holds the low word of the host write back
+ * address per natural queue, followed by a word per RX descriptor DMA in
+ * flight that the write back DMA is sourced from.  See NFD_OUT_RX_WB.
+ */
+#define NFD_OUT_RX_WB_STATE_SZ      4
+#define NFD_OUT_RX_WB_ENTRY_SZ      4
+#define NFD_OUT_RX_WB_STAGE_OFF     (NFD_OUT_MAX_QUEUES * NFD_OUT_RX_WB_STATE_SZ)
+#define NFD_OUT_RX_WB_MEM_SZ        (NFD_OUT_RX_WB_STAGE_OFF +          \
+                                     NFD_OUT_DESC_MAX_IN_FLIGHT *       \
+                                     NFD_OUT_RX_WB_ENTRY_SZ)
+
+
 #if defined(__NFP_LANG_MICROC)
 
 #include <nfp_chipres.h>
@@ -628,6 +969,49 @@ struct nfd_out_send_desc_msg {
 #define NFD_RING_DECLARE(_isl, _comp, _sz)                              \
     NFD_RING_DECLARE_IND0(_isl, _comp, _sz)
 
+/* The words after the table hold the last generation each notify ME
+ * loaded, see NFD_IN_NOTIFY_ME1 */
+#define NFD_IN_TXR_COAL_TBL_SZ  (NFD_IN_MAX_QUEUES * 4)
+#define NFD_IN_TXR_COAL_ACK     NFD_IN_MAX_QUEUES
+#define NFD_IN_TXR_COAL_ALLOC   (NFD_IN_TXR_COAL_TBL_SZ + 8)
+
+#define NFD_IN_TXR_COAL_DECL_IND1(_isl, _emem)                          \
+    _NFP_CHIPRES_ASM(.alloc_mem nfd_in_txr_coal##_isl _emem global      \
+                     NFD_IN_TXR_COAL_ALLOC NFD_IN_TXR_COAL_TBL_SZ)
+#define NFD_IN_TXR_COAL_DECL_IND0(_isl)                                 \
+    NFD_IN_TXR_COAL_DECL_IND1(_isl, NFD_PCIE##_isl##_EMEM)
+#define NFD_IN_TXR_COAL_DECL(_isl) NFD_IN_TXR_COAL_DECL_IND0(_isl)
+
+#define NFD_IN_TXR_COAL_LINK_IND(_isl)                                  \
+    ((__mem40 unsigned int *) _link_sym(nfd_in_txr_coal##_isl))
+#define NFD_IN_TXR_COAL_LINK(_isl) NFD_IN_TXR_COAL_LINK_IND(_isl)
+
+#ifdef NFD_IN_LAT_TRACE
+#define NFD_IN_LAT_REC(_stage, _side, _seq, _ts)                        \
+    (((_stage) << NFD_IN_LAT_REC_STAGE_shf) |                           \
+     (((_side) & NFD_IN_LAT_REC_SIDE_msk) << NFD_IN_LAT_REC_SIDE_shf) | \
+     ((((_seq) / NFD_IN_LAT_SAMPLE) & NFD_IN_LAT_REC_IDX_msk) <<        \
+      NFD_IN_LAT_REC_IDX_shf) |                                         \
+     ((_ts) & NFD_IN_LAT_REC_TS_msk))
+
+#define NFD_IN_LAT_SAMPLED(_seq) (((_seq) & (NFD_IN_LAT_SAMPLE - 1)) == 0)
+
+#define NFD_IN_LAT_JRNL_DECL_IND1(_isl, _emem)                          \
+    MEM_RING_INIT_MU(nfd_in_lat_jrnl##_isl, NFD_IN_LAT_JRNL_SZ, _emem)
+#define NFD_IN_LAT_JRNL_DECL_IND0(_isl)                                 \
+    NFD_IN_LAT_JRNL_DECL_IND1(_isl, NFD_PCIE##_isl##_EMEM)
+#define NFD_IN_LAT_JRNL_DECL(_isl) NFD_IN_LAT_JRNL_DECL_IND0(_isl)
+
+/* Log one stage of a sampled batch.  The record is journalled with a
+ * fast journal command, so no transfer registers or signals are used. */
+#define NFD_IN_LAT_LOG_IND(_isl, _stage, _side, _seq)                   \
+    JDBG(nfd_in_lat_jrnl##_isl,                                         \
+         NFD_IN_LAT_REC((_stage), (_side), (_seq),                      \
+                        local_csr_read(local_csr_timestamp_low)))
+#define NFD_IN_LAT_LOG(_isl, _stage, _side, _seq)                       \
+    NFD_IN_LAT_LOG_IND(_isl, _stage, _side, _seq)
+#endif
+
 
 #endif /* __NFP_LANG_MICROC */
 
@@ -19,6 +19,8 @@
 #ifndef _BLOCKS__VNIC_SHARED_NFD_NET_H_
 #define _BLOCKS__VNIC_SHARED_NFD_NET_H_
 
+#include <nfp_net_ctrl.h>
+
 /* XXX consolidate with ns_vnic_cntl.h? */
 
 /*
@@ -61,6 +63,34 @@
 
 /* XXX add defines for RX descriptor? */
 
+/* Packets in the slot's buffer, RX descriptor word 0 with
+ * NFP_NET_CFG_CTRL_RXSTRIDE */
+#define PCIE_DESC_RX_STRIDE_shf     16
+#define PCIE_DESC_RX_STRIDE_msk     0xFF
+
+/* Header length in RX descriptor word 0 with NFP_NET_CFG_CTRL_RXPAYALIGN */
+#define PCIE_DESC_RX_HDR_LEN_shf    16
+#define PCIE_DESC_RX_HDR_LEN_msk    0xFF
+
+/* Data length in RX descriptor word 0 */
+#define PCIE_DESC_RX_DATA_LEN_msk   0xFFFF
+
+/* Size class flags in RX descriptor word 0 with NFP_NET_CFG_CTRL_RXSIZECLASS */
+#define PCIE_DESC_RX_SC_shf         16
+#define PCIE_DESC_RX_SC_LARGE       (1 << 0)    /* Packet in a large buffer */
+#define PCIE_DESC_RX_SC_SPARE       (1 << 1)    /* Slot buffer kept as spare */
+#define PCIE_DESC_RX_SC_DROP        (1 << 2)    /* No large buffer, dropped */
+
+/* Large buffer flag in freelist descriptor word 0, as for the RX flags */
+#define PCIE_DESC_FL_LARGE          (1 << 8)
+
+/* RX completion queue entry word 0 with NFP_NET_CFG_CTRL_RXCQ, word 1
+ * holds the RX ring index of the first descriptor of the batch */
+#define PCIE_DESC_RX_CQ_PHASE       (1 << 31)
+#define PCIE_DESC_RX_CQ_RING_shf    16
+#define PCIE_DESC_RX_CQ_RING_msk    0x7F
+#define PCIE_DESC_RX_CQ_CNT_msk     0xFFFF
+
 
 /*
  * Prepended chained metadata defines
@@ -70,5 +100,297 @@
 /* The maximum supported length of a single metadata value */
 #define NFD_MAX_META_VAL_LEN 60
 
+/* The type word holds at most eight types, each with a 4B value */
+#define NFD_META_PARSE_MAX_LEN  (4 + 8 * 4)
+
+/* Bit set in nfd_meta_parsed.present for each type found */
+#define NFD_META_PRESENT(_type) (1 << (_type))
+
+/* The metadata decoders follow the ABI 4.0 chain layout: 4 bit type
+ * fields in a single type word, the type numbers below, and one 4B value
+ * per type.  The whole chain must fit a single 64B memory read. */
+#if (NFP_NET_META_FIELD_SIZE != 4)
+#error "Metadata decoders require 4 bit metadata type fields"
+#endif
+
+#if (NFP_NET_META_HASH != 1 || NFP_NET_META_MARK != 2 ||                \
+     NFP_NET_META_VLAN != 4 || NFP_NET_META_PORTID != 5 ||              \
+     NFP_NET_META_CSUM != 6)
+#error "Metadata type numbers do not match the ABI 4.0 values"
+#endif
+
+#if (NFD_META_PARSE_MAX_LEN != (4 + (32 / NFP_NET_META_FIELD_SIZE) * 4))
+#error "NFD_META_PARSE_MAX_LEN must cover a full type word of 4B values"
+#endif
+
+#if (NFD_META_PARSE_MAX_LEN > 64)
+#error "NFD_META_PARSE_MAX_LEN must fit a single 64B read"
+#endif
+
+
+#if !defined(__NFP_LANG_ASM)
+
+/*
+ * Result of decoding a whole prepended metadata chain.  Only the fields
+ * whose NFD_META_PRESENT() bit is set in "present" are valid.
+ */
+struct nfd_meta_parsed {
+    unsigned int present;       /* NFD_META_PRESENT() bits */
+    unsigned int hash_type;     /* Inline type of NFP_NET_META_HASH */
+    unsigned int hash;
+    unsigned int mark;
+    unsigned int portid;
+    unsigned int vlan;
+    unsigned int csum;
+};
+
+/* nfd_meta_parsed is seven 4B words in every language */
+typedef char nfd_meta_parsed_sz_chk[(sizeof(struct nfd_meta_parsed) == 28) ?
+                                    1 : -1];
+
+
+#if !defined(__NFP_LANG_MICROC)
+
+/**
+ * Host reference decoder for a prepended metadata chain
+ * @param parsed        Decoded metadata
+ * @param meta          First byte of metadata, i.e. the type word
+ * @param meta_len      Length of metadata in bytes, including the type word
+ *
+ * Metadata words are big endian, as written by the host driver.  Returns
+ * zero on success or -1 if "meta_len" is invalid or a type without a
+ * known 4B value is found.  Firmware decoders must give the same result.
+ */
+static inline int
+nfd_meta_parse_ref(struct nfd_meta_parsed *parsed, const unsigned char *meta,
+                   unsigned int meta_len)
+{
+    unsigned int meta_info;
+    unsigned int type;
+    unsigned int val;
+    unsigned int off;
+
+    parsed->present = 0;
+
+    if (meta_len > NFD_META_PARSE_MAX_LEN || (meta_len & 3) != 0) {
+        return -1;
+    }
+
+    if (meta_len == 0) {
+        return 0;
+    }
+
+    meta_info = ((meta[0] << 24) | (meta[1] << 16) |
+                 (meta[2] << 8) | meta[3]);
+
+    for (off = 4; off < meta_len; off += 4) {
+        val = ((meta[off] << 24) | (meta[off + 1] << 16) |
+               (meta[off + 2] << 8) | meta[off + 3]);
+
+        type = meta_info & NFP_NET_META_FIELD_MASK;
+        meta_info >>= NFP_NET_META_FIELD_SIZE;
+
+        switch (type) {
+        case NFP_NET_META_HASH:
+            parsed->hash_type = meta_info & NFP_NET_META_FIELD_MASK;
+            meta_info >>= NFP_NET_META_FIELD_SIZE;
+            parsed->hash = val;
+            break;
+        case NFP_NET_META_MARK:
+            parsed->mark = val;
+            break;
+        case NFP_NET_META_PORTID:
+            parsed->portid = val;
+            break;
+        case NFP_NET_META_VLAN:
+            parsed->vlan = val;
+            break;
+        case NFP_NET_META_CSUM:
+            parsed->csum = val;
+            break;
+        default:
+            return -1;
+        }
+
+        parsed->present |= NFD_META_PRESENT(type);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Host reference consumer for striding RX (NFP_NET_CFG_CTRL_RXSTRIDE)
+ * @param rxd_w0        RX descriptor word 0 of the ring slot, in host
+ *                      byte order
+ * @param slot_buf      Buffer posted to the freelist for this ring slot
+ * @param stride_sz     Stride size of the firmware, NFD_OUT_STRIDE_SZ
+ * @param idx           Packet of the buffer to locate, from zero
+ * @param hdr           Returns the address of the RX descriptor of the
+ *                      packet, or of the slot descriptor for a buffer
+ *                      holding a single packet
+ * @param pkt_buf       Returns the buffer address that the packet data is
+ *                      placed relative to, as for a non-strided buffer
+ *
+ * Returns the number of packets packed into "slot_buf", or zero if the
+ * buffer holds a single packet described by the slot descriptor itself.
+ * Packet "idx" of a packed buffer starts with an 8B copy of its RX
+ * descriptor, with a zero queue field, at "idx" strides into the buffer,
+ * and is placed relative to the end of that copy.  The slot descriptor
+ * of a packed buffer has zero data and metadata lengths.
+ */
+static inline unsigned int
+nfd_stride_rx_ref(unsigned int rxd_w0, unsigned long long slot_buf,
+                  unsigned int stride_sz, unsigned int idx,
+                  unsigned long long *hdr, unsigned long long *pkt_buf)
+{
+    unsigned int cnt;
+
+    cnt = (rxd_w0 >> PCIE_DESC_RX_STRIDE_shf) & PCIE_DESC_RX_STRIDE_msk;
+
+    if (cnt == 0) {
+        *hdr = 0;
+        *pkt_buf = slot_buf;
+        return 0;
+    }
+
+    *hdr = slot_buf + (unsigned long long)idx * stride_sz;
+    *pkt_buf = *hdr + 8;
+    return cnt;
+}
+
+
+/**
+ * Host reference decode of a page aligned payload RX descriptor
+ * (NFP_NET_CFG_CTRL_RXPAYALIGN)
+ * @param rxd_w0        RX descriptor word 0, in host byte order
+ * @param data_off      Payload offset of the firmware,
+ *                      NFD_OUT_HDR_SPLIT_DATA_OFF
+ * @param hdr_off       Returns the offset of the header in the buffer
+ * @param hdr_len       Returns the header length, metadata included
+ *
+ * Header and payload share the host buffer.  The header, starting with
+ * any prepended metadata, ends at "data_off" and the payload starts
+ * there.  Returns the payload length.
+ */
+static inline unsigned int
+nfd_hdr_split_ref(unsigned int rxd_w0, unsigned int data_off,
+                  unsigned int *hdr_off, unsigned int *hdr_len)
+{
+    unsigned int len;
+
+    len = rxd_w0 & PCIE_DESC_RX_DATA_LEN_msk;
+    *hdr_len = (rxd_w0 >> PCIE_DESC_RX_HDR_LEN_shf) & PCIE_DESC_RX_HDR_LEN_msk;
+    *hdr_off = data_off - *hdr_len;
+
+    return len - *hdr_len;
+}
+
+
+
+/* Per RX ring state for nfd_size_class_rx_ref(), zero when the ring starts */
+struct nfd_size_class_rx_state {
+    unsigned long long spare;   /* Buffer the firmware holds as the spare */
+    unsigned int valid;         /* Non-zero if "spare" is valid */
+};
+
+/**
+ * Host reference consumer for size class freelists
+ * (NFP_NET_CFG_CTRL_RXSIZECLASS)
+ * @param st            RX ring state
+ * @param rxd_w0        RX descriptor word 0, in host byte order
+ * @param slot_buf      Buffer posted to the freelist for this ring slot
+ * @param pkt_buf       Returns the buffer holding the packet
+ *
+ * Large buffers are posted with PCIE_DESC_FL_LARGE set in freelist
+ * descriptor word 0, small ones hold NFD_OUT_FL_SMALL_SZ bytes.  The
+ * firmware holds one buffer per ring as a spare, and PCIE_DESC_RX_SC_SPARE
+ * reports that "slot_buf" became the spare.  Returns 1 if the packet is in
+ * "pkt_buf", 0 if it was dropped for want of a large buffer, or -1 if the
+ * spare is used before it was set.  "slot_buf" may be posted again unless
+ * it holds the packet or became the spare.  The spare is freed with the
+ * other freelist buffers when the ring is stopped.
+ */
+static inline int
+nfd_size_class_rx_ref(struct nfd_size_class_rx_state *st,
+                      unsigned int rxd_w0, unsigned long long slot_buf,
+                      unsigned long long *pkt_buf)
+{
+    unsigned int flags;
+
+    flags = rxd_w0 >> PCIE_DESC_RX_SC_shf;
+    *pkt_buf = slot_buf;
+
+    if (flags & PCIE_DESC_RX_SC_SPARE) {
+        if (!(flags & PCIE_DESC_RX_SC_DROP)) {
+            if (!st->valid) {
+                return -1;
+            }
+            *pkt_buf = st->spare;
+        }
+        st->spare = slot_buf;
+        st->valid = 1;
+    }
+
+    return (flags & PCIE_DESC_RX_SC_DROP) ? 0 : 1;
+}
+
+
+/**
+ * Host reference consumer for shared RX completion queues
+ * (NFP_NET_CFG_CTRL_RXCQ)
+ * @param cq            Completion queue, in host byte order
+ * @param cq_sz_lg2     log2 of the CQ entries, as in NFP_NET_CFG_RXCQ_SZ
+ * @param rd            Entries consumed so far, free running
+ * @param ring          Returns the RX ring of the batch
+ * @param idx           Returns the RX ring index of the first descriptor
+ *
+ * The firmware sets PCIE_DESC_RX_CQ_PHASE on its first pass over the CQ,
+ * which must start zeroed, and flips it on each pass after.  An entry is
+ * written after the RX descriptors that it covers.  Returns the number of
+ * descriptors in the batch, or 0 if the next entry is not written yet.
+ * The CQ must hold an entry per descriptor of the RX rings posting to it.
+ */
+static inline unsigned int
+nfd_rx_cq_ref(const unsigned int *cq, unsigned int cq_sz_lg2, unsigned int rd,
+              unsigned int *ring, unsigned int *idx)
+{
+    const unsigned int *ent;
+    unsigned int phase;
+
+    ent = cq + (rd & ((1 << cq_sz_lg2) - 1)) * 2;
+    phase = ((rd >> cq_sz_lg2) & 1) ? 0 : PCIE_DESC_RX_CQ_PHASE;
+
+    if ((ent[0] & PCIE_DESC_RX_CQ_PHASE) != phase) {
+        return 0;
+    }
+
+    *ring = (ent[0] >> PCIE_DESC_RX_CQ_RING_shf) & PCIE_DESC_RX_CQ_RING_msk;
+    *idx = ent[1];
+
+    return ent[0] & PCIE_DESC_RX_CQ_CNT_msk;
+}
+
+
+/**
+ * Host reference consumer for RX ring write back (NFP_NET_CFG_CTRL_RXRWB)
+ * @param wb            Write back word of the RX ring, in host byte order
+ * @param rd            Descriptors consumed since the ring was enabled
+ *
+ * The firmware writes the number of RX descriptors written to the ring
+ * since it was enabled, after the descriptors themselves.  Returns the
+ * number of descriptors ready from "rd & (ring size - 1)" on, without
+ * reading their DD bits.
+ */
+static inline unsigned int
+nfd_rx_wb_ref(const volatile unsigned int *wb, unsigned int rd)
+{
+    return *wb - rd;
+}
+
+#endif /* !__NFP_LANG_MICROC */
+
+#endif /* !__NFP_LANG_ASM */
+
 
 #endif /* !_BLOCKS__VNIC_SHARED_NFD_NET_H_ */
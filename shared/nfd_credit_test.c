@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2019,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          shared/nfd_credit_test.c
+ * @brief         Host test of PCI.OUT credits with NFD_OUT_CREDITS_HOST_ISSUED
+ *
+ * Models one queue as _fetch_fl() in pci_out/cache_desc.c, SB and the app
+ * see it: credits are issued when a FL batch fetch is issued, the app
+ * spends one credit per packet, SB uses one fetched FL cache slot per
+ * packet, and the credits are zeroed when the queue goes up or down.  The
+ * checks show that credits are never issued for more FL descriptors than
+ * the host supplied.  Build and run with:
+ *
+ *   cc -I. -o nfd_credit_test nfd_credit_test.c
+ *   ./nfd_credit_test
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+
+static int failed;
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond); \
+        failed++;                                                       \
+    }                                                                   \
+} while (0)
+
+#define RING_SZ         256     /* FL ring entries */
+#define CACHE_DEPTH     64      /* NFD_OUT_FL_BUFS_PER_QUEUE */
+#define BATCH_SZ        16      /* NFD_OUT_FL_BATCH_SZ */
+
+struct queue_model {
+    int up;
+    unsigned int fl_w;          /* FL descriptors the host posted */
+    unsigned int fl_s;          /* FL descriptors fetched */
+    unsigned int rx_w;          /* FL cache slots SB has used */
+    unsigned int host_done;     /* RX descriptors the host consumed */
+    unsigned int credits;       /* NFD_OUT_ATOMICS_CREDIT */
+    unsigned int spent;         /* Credits the app spent since up */
+};
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(unsigned int range)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+}
+
+/* The host posts up to "n" buffers into free ring entries */
+static void
+host_post(struct queue_model *q, unsigned int n)
+{
+    unsigned int free = RING_SZ - (q->fl_w - q->host_done);
+
+    q->fl_w += (n < free) ? n : free;
+}
+
+/* The host consumes the RX descriptors SB wrote */
+static void
+host_consume(struct queue_model *q, unsigned int n)
+{
+    unsigned int ready = q->rx_w - q->host_done;
+
+    q->host_done += (n < ready) ? n : ready;
+}
+
+/*
+ * _fetch_fl(): fetch a batch if there is one and cache space for it.  The
+ * queue may go down while the FL.W reread swaps, in which case "down_mid"
+ * takes it down before the credits are added.
+ */
+static void
+fetch_fl(struct queue_model *q, int down_mid)
+{
+    int space_chk;
+
+    if (q->fl_w - q->fl_s < BATCH_SZ) {
+        return;
+    }
+
+    space_chk = (CACHE_DEPTH - BATCH_SZ) + (int)(q->rx_w - q->fl_s);
+    if (space_chk < 0) {
+        return;
+    }
+
+    q->fl_s += BATCH_SZ;
+
+    if (down_mid) {
+        q->up = 0;
+        q->credits = 0;
+    }
+
+    if (q->up) {
+        q->credits += BATCH_SZ;
+    }
+}
+
+/* The app sends a packet if it holds a credit, SB uses the next slot */
+static void
+app_send(struct queue_model *q)
+{
+    if (!q->up || q->credits == 0) {
+        return;
+    }
+
+    q->credits--;
+    q->spent++;
+
+    /* SB waits for the fetch to land, the slot must have been fetched */
+    CHECK(q->rx_w < q->fl_s);
+    q->rx_w++;
+}
+
+/* Queue up and down zero the credits and restart the ring */
+static void
+queue_reset(struct queue_model *q, int up)
+{
+    q->up = up;
+    q->fl_w = 0;
+    q->fl_s = 0;
+    q->rx_w = 0;
+    q->host_done = 0;
+    q->credits = 0;
+    q->spent = 0;
+}
+
+static void
+check_invariants(const struct queue_model *q)
+{
+    /* Credits issued since up never exceed the FL descriptors posted */
+    CHECK(q->credits + q->spent <= q->fl_s);
+    CHECK(q->fl_s <= q->fl_w);
+    CHECK(q->fl_w - q->host_done <= RING_SZ);
+    CHECK(q->fl_s - q->rx_w <= CACHE_DEPTH);
+}
+
+static void
+test_steady(void)
+{
+    struct queue_model q;
+    unsigned int i;
+
+    queue_reset(&q, 1);
+
+    /* No credits before the host posts a full batch */
+    host_post(&q, BATCH_SZ - 1);
+    fetch_fl(&q, 0);
+    CHECK(q.credits == 0);
+    host_post(&q, 1);
+    fetch_fl(&q, 0);
+    CHECK(q.credits == BATCH_SZ);
+
+    for (i = 0; i < 100000; i++) {
+        switch (rnd(4)) {
+        case 0:
+            host_post(&q, rnd(2 * BATCH_SZ));
+            break;
+        case 1:
+            fetch_fl(&q, 0);
+            break;
+        case 2:
+            app_send(&q);
+            break;
+        default:
+            host_consume(&q, rnd(BATCH_SZ));
+            break;
+        }
+        check_invariants(&q);
+    }
+}
+
+static void
+test_cache_full(void)
+{
+    struct queue_model q;
+    unsigned int i;
+
+    /* The host fills the ring, but only the cache depth gets credits */
+    queue_reset(&q, 1);
+    host_post(&q, RING_SZ);
+    for (i = 0; i < RING_SZ / BATCH_SZ; i++) {
+        fetch_fl(&q, 0);
+    }
+    CHECK(q.credits == CACHE_DEPTH);
+    check_invariants(&q);
+
+    /* Credits come back as SB frees cache slots */
+    for (i = 0; i < BATCH_SZ; i++) {
+        app_send(&q);
+    }
+    fetch_fl(&q, 0);
+    CHECK(q.credits == CACHE_DEPTH);
+    check_invariants(&q);
+}
+
+static void
+test_down_mid_fetch(void)
+{
+    struct queue_model q;
+
+    /* Credits zeroed on down must stay zero */
+    queue_reset(&q, 1);
+    host_post(&q, BATCH_SZ);
+    fetch_fl(&q, 1);
+    CHECK(q.up == 0);
+    CHECK(q.credits == 0);
+    app_send(&q);
+    CHECK(q.spent == 0);
+
+    /* The next up starts from nothing */
+    queue_reset(&q, 1);
+    fetch_fl(&q, 0);
+    CHECK(q.credits == 0);
+    check_invariants(&q);
+}
+
+int
+main(void)
+{
+    test_steady();
+    test_cache_full();
+    test_down_mid_fetch();
+
+    if (failed == 0) {
+        printf("nfd_credit: all checks passed\n");
+    }
+
+    return failed;
+}
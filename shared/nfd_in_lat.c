@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          shared/nfd_in_lat.c
+ * @brief         Decode a PCI.IN latency trace journal into histograms
+ *
+ * Firmware built with NFD_IN_LAT_TRACE journals one record per stage for
+ * sampled batches into the nfd_in_lat_jrnl<isl> ring.  Dump the ring
+ * memory (symbol nfd_in_lat_jrnl<isl>_mem) to a file and run:
+ *
+ *   cc -I. -o nfd_in_lat nfd_in_lat.c
+ *   ./nfd_in_lat [-l] [-m <ME MHz>] <dump>
+ *
+ * The dump is read as 32-bit big endian words unless -l is given.  The
+ * records of a batch are matched by side and sample index, and the
+ * latency between stages is reported as log2 histograms of ME timestamp
+ * ticks (16 ME cycles each).  With -m, bucket bounds are also shown in
+ * nanoseconds.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nfd_internal.h"
+
+#define LAT_SIDES       (NFD_IN_LAT_REC_SIDE_msk + 1)
+#define LAT_IDXS        (NFD_IN_LAT_REC_IDX_msk + 1)
+#define LAT_STAGES      (NFD_IN_LAT_STAGE_NOTIFY + 1)
+#define LAT_BUCKETS     21      /* timestamps are 20 bits */
+
+struct lat_sample {
+    uint32_t present;
+    uint32_t ts[LAT_STAGES];
+};
+
+struct lat_hist {
+    const char *name;
+    int from;
+    int to;
+    uint64_t cnt;
+    uint64_t bucket[LAT_BUCKETS];
+};
+
+static struct lat_sample samples[LAT_SIDES][LAT_IDXS];
+
+static struct lat_hist hists[] = {
+    {.name = "gather -> issue_dma",
+     .from = NFD_IN_LAT_STAGE_GATHER, .to = NFD_IN_LAT_STAGE_ISSUE},
+    {.name = "issue_dma -> notify",
+     .from = NFD_IN_LAT_STAGE_ISSUE, .to = NFD_IN_LAT_STAGE_NOTIFY},
+    {.name = "gather -> notify",
+     .from = NFD_IN_LAT_STAGE_GATHER, .to = NFD_IN_LAT_STAGE_NOTIFY},
+};
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-l] [-m <ME MHz>] <dump>\n", prog);
+    exit(1);
+}
+
+static int
+log2_bucket(uint32_t delta)
+{
+    int b = 0;
+
+    while (delta != 0) {
+        delta >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void
+hist_add(struct lat_hist *h, struct lat_sample *s)
+{
+    uint32_t delta;
+
+    if (!(s->present & (1 << h->from)) || !(s->present & (1 << h->to)))
+        return;
+
+    delta = (s->ts[h->to] - s->ts[h->from]) & NFD_IN_LAT_REC_TS_msk;
+    h->bucket[log2_bucket(delta)]++;
+    h->cnt++;
+}
+
+static void
+hist_print(struct lat_hist *h, unsigned int mhz)
+{
+    uint32_t lo, hi;
+    int b;
+
+    printf("%s: %llu samples\n", h->name, (unsigned long long)h->cnt);
+    for (b = 0; b < LAT_BUCKETS; b++) {
+        if (h->bucket[b] == 0)
+            continue;
+
+        lo = b ? (1u << (b - 1)) : 0;
+        hi = b ? ((1u << b) - 1) : 0;
+        if (mhz)
+            printf("  %7u - %7u ticks (<= %7llu ns): %llu\n", lo, hi,
+                   (unsigned long long)hi * 16 * 1000 / mhz,
+                   (unsigned long long)h->bucket[b]);
+        else
+            printf("  %7u - %7u ticks: %llu\n", lo, hi,
+                   (unsigned long long)h->bucket[b]);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *f;
+    unsigned char w[4];
+    uint32_t rec;
+    unsigned int stage, side, idx;
+    unsigned int mhz = 0;
+    unsigned long nrec = 0;
+    int little = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "lm:")) != -1) {
+        switch (opt) {
+        case 'l':
+            little = 1;
+            break;
+        case 'm':
+            mhz = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    /* The dump order does not matter, the journal size is limited so
+     * that a sample index is not reused while its records are present */
+    while (fread(w, sizeof w, 1, f) == 1) {
+        if (little)
+            rec = w[0] | (w[1] << 8) | (w[2] << 16) | ((uint32_t)w[3] << 24);
+        else
+            rec = ((uint32_t)w[0] << 24) | (w[1] << 16) | (w[2] << 8) | w[3];
+
+        /* Unused journal entries are zero, and stage zero is invalid */
+        stage = NFD_IN_LAT_REC_FIELD(rec, STAGE);
+        if (stage == 0)
+            continue;
+
+        side = NFD_IN_LAT_REC_FIELD(rec, SIDE);
+        idx = NFD_IN_LAT_REC_FIELD(rec, IDX);
+        samples[side][idx].present |= 1 << stage;
+        samples[side][idx].ts[stage] = NFD_IN_LAT_REC_FIELD(rec, TS);
+        nrec++;
+    }
+    fclose(f);
+
+    printf("%lu records\n", nrec);
+    for (i = 0; i < (int)(sizeof hists / sizeof hists[0]); i++) {
+        for (side = 0; side < LAT_SIDES; side++) {
+            for (idx = 0; idx < LAT_IDXS; idx++)
+                hist_add(&hists[i], &samples[side][idx]);
+        }
+        hist_print(&hists[i], mhz);
+    }
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2019,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          shared/nfd_meta_parse_test.c
+ * @brief         Host test of the prepended metadata reference decoder
+ *
+ * nfd_meta_parse_ref() is the reference that the firmware decoders,
+ * nfd_in_metadata_parse() in pci_in.c and the nfd_in.uc macro, must
+ * match.  Build and run with:
+ *
+ *   cc -I. -o nfd_meta_parse_test nfd_meta_parse_test.c
+ *   ./nfd_meta_parse_test
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nfd_net.h"
+
+static int failed;
+
+#define CHECK(_cond)                                                    \
+do {                                                                    \
+    if (!(_cond)) {                                                     \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond); \
+        failed++;                                                       \
+    }                                                                   \
+} while (0)
+
+/* Type word from up to eight 4 bit fields, first field in the low bits */
+#define META_INFO(_f0, _f1, _f2, _f3)                                   \
+    ((_f0) | ((_f1) << 4) | ((_f2) << 8) | ((_f3) << 12))
+
+/* Write "cnt" big endian words to "buf", as the host driver does */
+static unsigned int
+meta_build(unsigned char *buf, const unsigned int *words, unsigned int cnt)
+{
+    unsigned int i;
+
+    for (i = 0; i < cnt; i++) {
+        buf[i * 4] = words[i] >> 24;
+        buf[i * 4 + 1] = words[i] >> 16;
+        buf[i * 4 + 2] = words[i] >> 8;
+        buf[i * 4 + 3] = words[i];
+    }
+
+    return cnt * 4;
+}
+
+static void
+test_chain(void)
+{
+    unsigned char buf[NFD_META_PARSE_MAX_LEN];
+    struct nfd_meta_parsed parsed;
+    unsigned int words[] = {
+        META_INFO(NFP_NET_META_HASH, 2, NFP_NET_META_MARK,
+                  NFP_NET_META_PORTID),
+        0x11223344, 0x55667788, 0x99aabbcc
+    };
+    unsigned int len = meta_build(buf, words, 4);
+
+    /* The hash type is carried inline and takes no value word */
+    CHECK(nfd_meta_parse_ref(&parsed, buf, len) == 0);
+    CHECK(parsed.present == (NFD_META_PRESENT(NFP_NET_META_HASH) |
+                             NFD_META_PRESENT(NFP_NET_META_MARK) |
+                             NFD_META_PRESENT(NFP_NET_META_PORTID)));
+    CHECK(parsed.hash_type == 2);
+    CHECK(parsed.hash == 0x11223344);
+    CHECK(parsed.mark == 0x55667788);
+    CHECK(parsed.portid == 0x99aabbcc);
+}
+
+static void
+test_terminal(void)
+{
+    unsigned char buf[NFD_META_PARSE_MAX_LEN];
+    struct nfd_meta_parsed parsed;
+    unsigned int words[9];
+    unsigned int len;
+    unsigned int i;
+
+    /* A full type word, the last field in the top four bits */
+    words[0] = 0;
+    for (i = 0; i < 7; i++) {
+        words[0] |= NFP_NET_META_MARK << (i * 4);
+        words[i + 1] = i;
+    }
+    words[0] |= NFP_NET_META_CSUM << 28;
+    words[8] = 0xdeadbeef;
+    len = meta_build(buf, words, 9);
+
+    CHECK(len == NFD_META_PARSE_MAX_LEN);
+    CHECK(nfd_meta_parse_ref(&parsed, buf, len) == 0);
+    CHECK(parsed.present == (NFD_META_PRESENT(NFP_NET_META_MARK) |
+                             NFD_META_PRESENT(NFP_NET_META_CSUM)));
+    CHECK(parsed.mark == 6);
+    CHECK(parsed.csum == 0xdeadbeef);
+
+    /* A value word past the last field has no type */
+    words[0] = META_INFO(NFP_NET_META_VLAN, 0, 0, 0);
+    len = meta_build(buf, words, 3);
+    CHECK(nfd_meta_parse_ref(&parsed, buf, len) == -1);
+
+    /* Types without a known 4B value are rejected */
+    words[0] = META_INFO(NFP_NET_META_APP, 0, 0, 0);
+    len = meta_build(buf, words, 2);
+    CHECK(nfd_meta_parse_ref(&parsed, buf, len) == -1);
+}
+
+static void
+test_truncated(void)
+{
+    unsigned char buf[NFD_META_PARSE_MAX_LEN + 4];
+    struct nfd_meta_parsed parsed;
+    unsigned int words[] = {
+        META_INFO(NFP_NET_META_HASH, 1, NFP_NET_META_MARK,
+                  NFP_NET_META_VLAN),
+        0x01020304, 0x05060708, 0x090a0b0c
+    };
+    unsigned int len = meta_build(buf, words, 4);
+
+    /* Only the fields with a value inside meta_len are decoded */
+    CHECK(nfd_meta_parse_ref(&parsed, buf, 8) == 0);
+    CHECK(parsed.present == NFD_META_PRESENT(NFP_NET_META_HASH));
+    CHECK(parsed.hash == 0x01020304);
+
+    CHECK(nfd_meta_parse_ref(&parsed, buf, 4) == 0);
+    CHECK(parsed.present == 0);
+
+    CHECK(nfd_meta_parse_ref(&parsed, buf, 0) == 0);
+    CHECK(parsed.present == 0);
+
+    /* Lengths that are not whole words or exceed a type word */
+    CHECK(nfd_meta_parse_ref(&parsed, buf, len - 2) == -1);
+    CHECK(parsed.present == 0);
+    memset(buf, 0, sizeof buf);
+    CHECK(nfd_meta_parse_ref(&parsed, buf, NFD_META_PARSE_MAX_LEN + 4) == -1);
+}
+
+int
+main(void)
+{
+    test_chain();
+    test_terminal();
+    test_truncated();
+
+    if (failed == 0) {
+        printf("nfd_meta_parse_ref: all checks passed\n");
+    }
+
+    return failed;
+}